@@ -25,6 +25,7 @@
 #include "exec/address-spaces.h"
 #include "exec/cpu_ldst.h"
 #include "exec/cputlb.h"
+#include "exec/tlb-range.h"
 #include "exec/memory-internal.h"
 #include "exec/ram_addr.h"
 #include "tcg/tcg.h"
@@ -34,8 +35,10 @@
 #include "qemu/atomic.h"
 #include "qemu/atomic128.h"
 #include "translate-all.h"
+#include "exec/tb-hash.h"
 #include "trace/trace-root.h"
 #include "trace/mem.h"
+#include "sysemu/replay.h"
 #ifdef CONFIG_PLUGIN
 #include "qemu/plugin-memory.h"
 #endif
@@ -264,6 +267,8 @@ void tlb_init(CPUState *cpu)
 
     /* All tlbs are initialized flushed. */
     env_tlb(env)->c.dirty = 0;
+    env_tlb(env)->c.n_pending = 0;
+    env_tlb(env)->c.pending_full = 0;
 
     for (i = 0; i < NB_MMU_MODES; i++) {
         tlb_mmu_init(&env_tlb(env)->d[i], &env_tlb(env)->f[i], now);
@@ -304,10 +309,12 @@ static void flush_all_helper(CPUState *src, run_on_cpu_func fn,
     }
 }
 
-void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
+void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide,
+                      size_t *prange, size_t *prange_full, size_t *pcoalesced)
 {
     CPUState *cpu;
     size_t full = 0, part = 0, elide = 0;
+    size_t range = 0, range_full = 0, coalesced = 0;
 
     CPU_FOREACH(cpu) {
         CPUArchState *env = cpu->env_ptr;
@@ -315,10 +322,16 @@ void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
         full += atomic_read(&env_tlb(env)->c.full_flush_count);
         part += atomic_read(&env_tlb(env)->c.part_flush_count);
         elide += atomic_read(&env_tlb(env)->c.elide_flush_count);
+        range += atomic_read(&env_tlb(env)->c.range_flush_count);
+        range_full += atomic_read(&env_tlb(env)->c.range_fallback_count);
+        coalesced += atomic_read(&env_tlb(env)->c.coalesced_flush_count);
     }
     *pfull = full;
     *ppart = part;
     *pelide = elide;
+    *prange = range;
+    *prange_full = range_full;
+    *pcoalesced = coalesced;
 }
 
 static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
@@ -547,6 +560,21 @@ static void tlb_flush_page_by_mmuidx_async_2(CPUState *cpu,
     g_free(d);
 }
 
+static void tlb_flush_range_queue(CPUState *cpu, const CPUTLBPendingFlush *d);
+
+static void tlb_flush_page_queue(CPUState *cpu, target_ulong addr,
+                                 uint16_t idxmap)
+{
+    CPUTLBPendingFlush d = {
+        .addr = addr,
+        .len = TARGET_PAGE_SIZE,
+        .idxmap = idxmap,
+        .bits = TARGET_LONG_BITS,
+    };
+
+    tlb_flush_range_queue(cpu, &d);
+}
+
 void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, uint16_t idxmap)
 {
     tlb_debug("addr: "TARGET_FMT_lx" mmu_idx:%" PRIx16 "\n", addr, idxmap);
@@ -556,22 +584,8 @@ void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, uint16_t idxmap)
 
     if (qemu_cpu_is_self(cpu)) {
         tlb_flush_page_by_mmuidx_async_0(cpu, addr, idxmap);
-    } else if (idxmap < TARGET_PAGE_SIZE) {
-        /*
-         * Most targets have only a few mmu_idx.  In the case where
-         * we can stuff idxmap into the low TARGET_PAGE_BITS, avoid
-         * allocating memory for this operation.
-         */
-        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
     } else {
-        TLBFlushPageByMMUIdxData *d = g_new(TLBFlushPageByMMUIdxData, 1);
-
-        /* Otherwise allocate a structure, freed by the worker.  */
-        d->addr = addr;
-        d->idxmap = idxmap;
-        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_2,
-                         RUN_ON_CPU_HOST_PTR(d));
+        tlb_flush_page_queue(cpu, addr, idxmap);
     }
 }
 
@@ -583,32 +597,16 @@ void tlb_flush_page(CPUState *cpu, target_ulong addr)
 void tlb_flush_page_by_mmuidx_all_cpus(CPUState *src_cpu, target_ulong addr,
                                        uint16_t idxmap)
 {
+    CPUState *dst_cpu;
+
     tlb_debug("addr: "TARGET_FMT_lx" mmu_idx:%"PRIx16"\n", addr, idxmap);
 
     /* This should already be page aligned */
     addr &= TARGET_PAGE_MASK;
 
-    /*
-     * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
-     */
-    if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
-    } else {
-        CPUState *dst_cpu;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                TLBFlushPageByMMUIdxData *d
-                    = g_new(TLBFlushPageByMMUIdxData, 1);
-
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_flush_page_queue(dst_cpu, addr, idxmap);
         }
     }
 
@@ -624,36 +622,31 @@ void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                               target_ulong addr,
                                               uint16_t idxmap)
 {
+    CPUState *dst_cpu;
+
     tlb_debug("addr: "TARGET_FMT_lx" mmu_idx:%"PRIx16"\n", addr, idxmap);
 
     /* This should already be page aligned */
     addr &= TARGET_PAGE_MASK;
 
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_flush_page_queue(dst_cpu, addr, idxmap);
+        }
+    }
+
     /*
-     * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
+     * Most targets have only a few mmu_idx.  In the case where
+     * we can stuff idxmap into the low TARGET_PAGE_BITS, avoid
+     * allocating memory for this operation.
      */
     if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
         async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_1,
                               RUN_ON_CPU_TARGET_PTR(addr | idxmap));
     } else {
-        CPUState *dst_cpu;
-        TLBFlushPageByMMUIdxData *d;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                d = g_new(TLBFlushPageByMMUIdxData, 1);
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
-        }
+        TLBFlushPageByMMUIdxData *d = g_new(TLBFlushPageByMMUIdxData, 1);
 
-        d = g_new(TLBFlushPageByMMUIdxData, 1);
+        /* Otherwise allocate a structure, freed by the worker.  */
         d->addr = addr;
         d->idxmap = idxmap;
         async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_2,
@@ -666,6 +659,340 @@ void tlb_flush_page_all_cpus_synced(CPUState *src, target_ulong addr)
     tlb_flush_page_by_mmuidx_all_cpus_synced(src, addr, ALL_MMUIDX_BITS);
 }
 
+/* Called with tlb_c.lock held */
+static inline bool tlb_hit_range(target_ulong tlb_addr,
+                                 const CPUTLBPendingFlush *d,
+                                 target_ulong mask)
+{
+    /* Unused entries are all ones, which may well fall in the range */
+    if (tlb_addr & TLB_INVALID_MASK) {
+        return false;
+    }
+    return (tlb_addr & mask) - d->addr < d->len;
+}
+
+/* Called with tlb_c.lock held */
+static bool tlb_flush_entry_range_locked(CPUTLBEntry *tlb_entry,
+                                         const CPUTLBPendingFlush *d,
+                                         target_ulong mask)
+{
+    if (tlb_hit_range(tlb_entry->addr_read, d, mask) ||
+        tlb_hit_range(tlb_addr_write(tlb_entry), d, mask) ||
+        tlb_hit_range(tlb_entry->addr_code, d, mask)) {
+        memset(tlb_entry, -1, sizeof(*tlb_entry));
+        return true;
+    }
+    return false;
+}
+
+/* Called with tlb_c.lock held */
+static void tlb_flush_range_locked(CPUArchState *env, int midx,
+                                   const CPUTLBPendingFlush *d,
+                                   target_ulong mask, int64_t now)
+{
+    CPUTLBDesc *desc = &env_tlb(env)->d[midx];
+    CPUTLBDescFast *fast = &env_tlb(env)->f[midx];
+    target_ulong lp_addr = desc->large_page_addr;
+    target_ulong lp_mask = desc->large_page_mask;
+    target_ulong pages = d->len >> TARGET_PAGE_BITS;
+    size_t working_set = MAX(desc->window_max_entries, desc->n_used_entries);
+    target_ulong i;
+    int k;
+
+    /*
+     * Large pages are not tracked entry by entry, so the whole TLB goes
+     * if the range may touch them.  Otherwise flush everything only when
+     * the range has more pages than the TLB has been holding lately,
+     * because then most of the entries go anyway and refilling the rest
+     * costs less than looking up every page.
+     */
+    if ((lp_addr != (target_ulong)-1 &&
+         (mask != TARGET_PAGE_MASK ||
+          lp_addr - d->addr < d->len || d->addr - lp_addr <= ~lp_mask)) ||
+        pages > MAX(working_set, CPU_VTLB_SIZE)) {
+        tlb_debug("forcing full flush midx %d (" TARGET_FMT_lx "+"
+                  TARGET_FMT_lx ")\n", midx, d->addr, d->len);
+        tlb_flush_one_mmuidx_locked(env, midx, now);
+        atomic_set(&env_tlb(env)->c.range_fallback_count,
+                   env_tlb(env)->c.range_fallback_count + 1);
+        return;
+    }
+
+    if (mask == TARGET_PAGE_MASK) {
+        for (i = 0; i < pages; i++) {
+            target_ulong page = d->addr + (i << TARGET_PAGE_BITS);
+
+            if (tlb_flush_entry_range_locked(tlb_entry(env, midx, page),
+                                             d, mask)) {
+                tlb_n_used_entries_dec(env, midx);
+            }
+        }
+    } else {
+        /* The ignored high bits may select any entry of the table */
+        size_t n = tlb_n_entries(fast);
+
+        for (i = 0; i < n; i++) {
+            if (tlb_flush_entry_range_locked(&fast->table[i], d, mask)) {
+                tlb_n_used_entries_dec(env, midx);
+            }
+        }
+    }
+    for (k = 0; k < CPU_VTLB_SIZE; k++) {
+        if (tlb_flush_entry_range_locked(&desc->vtable[k], d, mask)) {
+            tlb_n_used_entries_dec(env, midx);
+        }
+    }
+    atomic_set(&env_tlb(env)->c.range_flush_count,
+               env_tlb(env)->c.range_flush_count + 1);
+}
+
+/**
+ * tlb_flush_range_by_mmuidx_async_0:
+ * @cpu: cpu on which to flush
+ * @d: page aligned range, set of mmu_idx and significant address bits
+ *
+ * Helper for tlb_flush_range_by_mmuidx and friends, flush the range
+ * from the tlbs indicated by @d->idxmap from @cpu.
+ */
+static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
+                                              CPUTLBPendingFlush d)
+{
+    CPUArchState *env = cpu->env_ptr;
+    target_ulong mask = TARGET_PAGE_MASK;
+    target_ulong i;
+    int64_t now;
+    int mmu_idx;
+
+    assert_cpu_is_self(cpu);
+
+    tlb_debug("range: " TARGET_FMT_lx "+" TARGET_FMT_lx " bits:%d"
+              " mmu_map:0x%x\n", d.addr, d.len, d.bits, d.idxmap);
+
+    if (d.bits < TARGET_PAGE_BITS) {
+        /* Every page matches */
+        tlb_flush_by_mmuidx_async_work(cpu, RUN_ON_CPU_HOST_INT(d.idxmap));
+        return;
+    }
+    if (d.bits < TARGET_LONG_BITS) {
+        mask &= MAKE_64BIT_MASK(0, d.bits);
+        d.addr &= mask;
+    }
+
+    now = get_clock_realtime();
+    qemu_spin_lock(&env_tlb(env)->c.lock);
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        if ((d.idxmap >> mmu_idx) & 1) {
+            tlb_flush_range_locked(env, mmu_idx, &d, mask, now);
+        }
+    }
+    qemu_spin_unlock(&env_tlb(env)->c.lock);
+
+    /* Past a point, every set of the jump cache is hit anyway */
+    if (mask != TARGET_PAGE_MASK ||
+        d.len >> TARGET_PAGE_BITS >= TB_JMP_SET_COUNT / TB_JMP_PAGE_SIZE) {
+        cpu_tb_jmp_cache_clear(cpu);
+    } else {
+        for (i = 0; i < d.len; i += TARGET_PAGE_SIZE) {
+            tb_flush_jmp_cache(cpu, d.addr + i);
+        }
+    }
+}
+
+/**
+ * tlb_flush_range_by_mmuidx_async_1:
+ * @cpu: cpu on which to flush
+ * @data: allocated CPUTLBPendingFlush
+ *
+ * Helper for tlb_flush_range_by_mmuidx_all_cpus_synced, called through
+ * async_safe_run_on_cpu.  Free the structure when done.
+ */
+static void tlb_flush_range_by_mmuidx_async_1(CPUState *cpu,
+                                              run_on_cpu_data data)
+{
+    CPUTLBPendingFlush *d = data.host_ptr;
+
+    tlb_flush_range_by_mmuidx_async_0(cpu, *d);
+    g_free(d);
+}
+
+/**
+ * tlb_flush_pending_async_work:
+ * @cpu: cpu on which to flush
+ * @data: unused
+ *
+ * Flush everything other vCPUs queued with tlb_flush_range_queue
+ * since this work item was queued.
+ */
+static void tlb_flush_pending_async_work(CPUState *cpu, run_on_cpu_data data)
+{
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLBCommon *c = &env_tlb(env)->c;
+    CPUTLBPendingFlush pending[CPU_TLB_PENDING_FLUSHES];
+    uint16_t full;
+    unsigned i, n;
+
+    qemu_spin_lock(&c->lock);
+    n = c->n_pending;
+    full = c->pending_full;
+    memcpy(pending, c->pending, n * sizeof(pending[0]));
+    c->n_pending = 0;
+    c->pending_full = 0;
+    qemu_spin_unlock(&c->lock);
+
+    if (full) {
+        tlb_flush_by_mmuidx_async_work(cpu, RUN_ON_CPU_HOST_INT(full));
+    }
+    for (i = 0; i < n; i++) {
+        pending[i].idxmap &= ~full;
+        if (pending[i].idxmap) {
+            tlb_flush_range_by_mmuidx_async_0(cpu, pending[i]);
+        }
+    }
+}
+
+/* Extend @to to cover @d if they overlap or are adjacent */
+static bool tlb_flush_range_merge(CPUTLBPendingFlush *to,
+                                  const CPUTLBPendingFlush *d)
+{
+    uint64_t addr = to->addr, len = to->len;
+
+    if (to->idxmap != d->idxmap || to->bits != d->bits ||
+        !tlb_range_merge(&addr, &len, d->addr, d->len, TARGET_LONG_BITS)) {
+        return false;
+    }
+    to->addr = addr;
+    to->len = len;
+    return true;
+}
+
+/*
+ * Queue a flush on another vCPU.  Requests that arrive before it gets
+ * around to them share a single work item, and overlapping or adjacent
+ * ranges are merged, so a guest invalidating a large region page by
+ * page does not flood the work queue.  If too many disjoint ranges pile
+ * up, the MMU modes involved are flushed entirely.
+ */
+static void tlb_flush_range_queue(CPUState *cpu, const CPUTLBPendingFlush *d)
+{
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLBCommon *c = &env_tlb(env)->c;
+    bool queued, coalesced = true;
+    unsigned i;
+
+    qemu_spin_lock(&c->lock);
+    queued = c->n_pending || c->pending_full;
+    if (d->bits < TARGET_PAGE_BITS) {
+        /* Every page matches */
+        c->pending_full |= d->idxmap;
+        coalesced = queued;
+    } else if ((d->idxmap & ~c->pending_full) != 0) {
+        for (i = 0; i < c->n_pending; i++) {
+            if (tlb_flush_range_merge(&c->pending[i], d)) {
+                break;
+            }
+        }
+        if (i < c->n_pending) {
+            /* merged */
+        } else if (c->n_pending < CPU_TLB_PENDING_FLUSHES) {
+            c->pending[c->n_pending++] = *d;
+            coalesced = false;
+        } else {
+            for (i = 0; i < c->n_pending; i++) {
+                c->pending_full |= c->pending[i].idxmap;
+            }
+            c->pending_full |= d->idxmap;
+            c->n_pending = 0;
+        }
+    }
+    if (coalesced) {
+        atomic_set(&c->coalesced_flush_count, c->coalesced_flush_count + 1);
+    }
+    qemu_spin_unlock(&c->lock);
+
+    if (!queued) {
+        async_run_on_cpu(cpu, tlb_flush_pending_async_work, RUN_ON_CPU_NULL);
+    }
+}
+
+/* Page align the range; returns false if there is nothing to flush */
+static bool tlb_flush_range_init(CPUTLBPendingFlush *d, target_ulong addr,
+                                 target_ulong len, uint16_t idxmap,
+                                 unsigned bits)
+{
+    uint64_t start = addr, size = len;
+
+    if (len == 0 || idxmap == 0) {
+        return false;
+    }
+    d->idxmap = idxmap;
+    if (!tlb_range_align(&start, &size, TARGET_PAGE_BITS, TARGET_LONG_BITS)) {
+        /* The pages do not fit in @len, flush everything */
+        d->addr = 0;
+        d->len = 0;
+        d->bits = 0;
+        return true;
+    }
+    d->addr = start;
+    d->len = size;
+    d->bits = MIN(bits, TARGET_LONG_BITS);
+    return true;
+}
+
+void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
+                               target_ulong len, uint16_t idxmap,
+                               unsigned bits)
+{
+    CPUTLBPendingFlush d;
+
+    if (!tlb_flush_range_init(&d, addr, len, idxmap, bits)) {
+        return;
+    }
+    if (qemu_cpu_is_self(cpu)) {
+        tlb_flush_range_by_mmuidx_async_0(cpu, d);
+    } else {
+        tlb_flush_range_queue(cpu, &d);
+    }
+}
+
+void tlb_flush_range_by_mmuidx_all_cpus(CPUState *src_cpu,
+                                        target_ulong addr, target_ulong len,
+                                        uint16_t idxmap, unsigned bits)
+{
+    CPUTLBPendingFlush d;
+    CPUState *dst_cpu;
+
+    if (!tlb_flush_range_init(&d, addr, len, idxmap, bits)) {
+        return;
+    }
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_flush_range_queue(dst_cpu, &d);
+        }
+    }
+    tlb_flush_range_by_mmuidx_async_0(src_cpu, d);
+}
+
+void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
+                                               target_ulong addr,
+                                               target_ulong len,
+                                               uint16_t idxmap,
+                                               unsigned bits)
+{
+    CPUTLBPendingFlush d;
+    CPUState *dst_cpu;
+
+    if (!tlb_flush_range_init(&d, addr, len, idxmap, bits)) {
+        return;
+    }
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_flush_range_queue(dst_cpu, &d);
+        }
+    }
+    async_safe_run_on_cpu(src_cpu, tlb_flush_range_by_mmuidx_async_1,
+                          RUN_ON_CPU_HOST_PTR(g_memdup(&d, sizeof(d))));
+}
+
 /* update the TLBs so that writes to code in the virtual page 'addr'
    can be detected */
 void tlb_protect_code(ram_addr_t ram_addr)
@@ -1053,7 +1380,8 @@ static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
         cpu_io_recompile(cpu, retaddr);
     }
 
-    if (mr->global_locking && !qemu_mutex_iothread_locked()) {
+    if (mr->global_locking && !mr->ops->lockless_read &&
+        !qemu_mutex_iothread_locked()) {
         qemu_mutex_lock_iothread();
         locked = true;
     }
@@ -2363,15 +2691,36 @@ void cpu_stq_le_data(CPUArchState *env, target_ulong ptr, uint64_t val)
     cpu_stq_le_data_ra(env, ptr, val, 0);
 }
 
+/*
+ * With record/replay and MTTCG, an atomic operation is an ordering point
+ * of the vCPU, once the lookup could not fault anymore.
+ */
+static void *atomic_mmu_lookup_sync(CPUArchState *env, target_ulong addr,
+                                    TCGMemOpIdx oi, uintptr_t retaddr,
+                                    bool *sync)
+{
+    void *haddr = atomic_mmu_lookup(env, addr, oi, retaddr);
+
+    *sync = unlikely(replay_mttcg) &&
+            replay_vcpu_sync_begin(env_cpu(env), REPLAY_SYNC_LOCK);
+    return haddr;
+}
+
 /* First set of helpers allows passing in of OI and RETADDR.  This makes
    them callable from other helpers.  */
 
 #define EXTRA_ARGS     , TCGMemOpIdx oi, uintptr_t retaddr
 #define ATOMIC_NAME(X) \
     HELPER(glue(glue(glue(atomic_ ## X, SUFFIX), END), _mmu))
-#define ATOMIC_MMU_DECLS
-#define ATOMIC_MMU_LOOKUP atomic_mmu_lookup(env, addr, oi, retaddr)
-#define ATOMIC_MMU_CLEANUP
+#define ATOMIC_MMU_DECLS bool replay_sync
+#define ATOMIC_MMU_LOOKUP \
+    atomic_mmu_lookup_sync(env, addr, oi, retaddr, &replay_sync)
+#define ATOMIC_MMU_CLEANUP                              \
+    do {                                                \
+        if (unlikely(replay_sync)) {                    \
+            replay_vcpu_sync_end(env_cpu(env));         \
+        }                                               \
+    } while (0)
 #define ATOMIC_MMU_IDX   get_mmuidx(oi)
 
 #include "atomic_common.c.inc"
@@ -2402,7 +2751,8 @@ void cpu_stq_le_data(CPUArchState *env, target_ulong ptr, uint64_t val)
 #undef ATOMIC_MMU_LOOKUP
 #define EXTRA_ARGS         , TCGMemOpIdx oi
 #define ATOMIC_NAME(X)     HELPER(glue(glue(atomic_ ## X, SUFFIX), END))
-#define ATOMIC_MMU_LOOKUP  atomic_mmu_lookup(env, addr, oi, GETPC())
+#define ATOMIC_MMU_LOOKUP \
+    atomic_mmu_lookup_sync(env, addr, oi, GETPC(), &replay_sync)
 
 #define DATA_SIZE 1
 #include "atomic_template.h"
@@ -0,0 +1,240 @@
+/*
+ * Linux perf perf-<pid>.map and jit-<pid>.dump integration
+ *
+ * The perf map is a text file listing one symbol per line, which perf
+ * report picks up on its own. It has no notion of time, so once the
+ * code buffer has been flushed and reused, samples may be attributed
+ * to the TB that first occupied an address.
+ *
+ * The jitdump file is a binary log of timestamped code load records,
+ * including a copy of the code. "perf inject --jit" turns it into one
+ * ELF image per TB, which takes care of reuse and also allows perf
+ * annotate to show the host code.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "disas/disas.h"
+#include "elf.h"
+#include "perf.h"
+
+static FILE *perfmap;
+static FILE *jitdump;
+static void *jitdump_header;
+static uint64_t jitdump_index;
+static QemuMutex perf_lock;
+
+/* See tools/perf/util/jitdump.h in the Linux sources */
+#define JITHEADER_MAGIC 0x4A695444
+#define JITHEADER_VERSION 1
+#define JIT_CODE_LOAD 0
+
+struct jitheader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+};
+
+struct jr_prefix {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+};
+
+struct jr_code_load {
+    struct jr_prefix p;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_addr;
+    uint64_t code_size;
+    uint64_t code_index;
+};
+
+static void perf_init(void)
+{
+    static bool initialized;
+
+    if (!initialized) {
+        qemu_mutex_init(&perf_lock);
+        atexit(perf_exit);
+        initialized = true;
+    }
+}
+
+void perf_enable_perfmap(void)
+{
+    g_autofree char *path = g_strdup_printf("%s/perf-%d.map",
+                                            g_get_tmp_dir(), getpid());
+
+    perf_init();
+    perfmap = fopen(path, "w");
+    if (!perfmap) {
+        warn_report("Could not open %s: %s, proceeding without perfmap",
+                    path, strerror(errno));
+    }
+}
+
+/* Perf requires the timestamps to come from CLOCK_MONOTONIC */
+static uint64_t perf_timestamp(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NANOSECONDS_PER_SECOND + ts.tv_nsec;
+}
+
+static uint32_t perf_host_elf_mach(void)
+{
+#if defined(__x86_64__)
+    return EM_X86_64;
+#elif defined(__i386__)
+    return EM_386;
+#elif defined(__aarch64__)
+    return EM_AARCH64;
+#elif defined(__arm__)
+    return EM_ARM;
+#elif defined(__powerpc64__)
+    return EM_PPC64;
+#elif defined(__s390x__)
+    return EM_S390;
+#elif defined(__riscv)
+    return EM_RISCV;
+#elif defined(__mips__)
+    return EM_MIPS;
+#elif defined(__sparc__)
+    return EM_SPARCV9;
+#else
+    return EM_NONE;
+#endif
+}
+
+void perf_enable_jitdump(void)
+{
+    g_autofree char *path = g_strdup_printf("%s/jit-%d.dump",
+                                            g_get_tmp_dir(), getpid());
+    struct jitheader header;
+    int fd;
+
+    perf_init();
+    fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0666);
+    if (fd == -1) {
+        warn_report("Could not open %s: %s, proceeding without jitdump",
+                    path, strerror(errno));
+        return;
+    }
+
+    /*
+     * perf only finds the file through the mmap event it records for
+     * this mapping, which has to be executable to be recorded at all.
+     */
+    jitdump_header = mmap(NULL, qemu_real_host_page_size,
+                          PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+    if (jitdump_header == MAP_FAILED) {
+        warn_report("Could not map %s: %s, proceeding without jitdump",
+                    path, strerror(errno));
+        jitdump_header = NULL;
+        close(fd);
+        return;
+    }
+
+    jitdump = fdopen(fd, "w+");
+    memset(&header, 0, sizeof(header));
+    header.magic = JITHEADER_MAGIC;
+    header.version = JITHEADER_VERSION;
+    header.total_size = sizeof(header);
+    header.elf_mach = perf_host_elf_mach();
+    header.pid = getpid();
+    header.timestamp = perf_timestamp();
+    fwrite(&header, sizeof(header), 1, jitdump);
+}
+
+/* Called with perf_lock held */
+static void perf_write(const void *start, size_t size, uint64_t timestamp,
+                       const char *name)
+{
+    if (perfmap) {
+        fprintf(perfmap, "%"PRIxPTR" %zx %s\n",
+                (uintptr_t)start, size, name);
+    }
+
+    if (jitdump) {
+        struct jr_code_load load;
+        size_t name_size = strlen(name) + 1;
+
+        load.p.id = JIT_CODE_LOAD;
+        load.p.total_size = sizeof(load) + name_size + size;
+        load.p.timestamp = timestamp;
+        load.pid = getpid();
+        load.tid = qemu_get_thread_id();
+        load.vma = (uintptr_t)start;
+        load.code_addr = (uintptr_t)start;
+        load.code_size = size;
+        load.code_index = jitdump_index++;
+        fwrite(&load, sizeof(load), 1, jitdump);
+        fwrite(name, name_size, 1, jitdump);
+        fwrite(start, size, 1, jitdump);
+    }
+}
+
+void perf_report_prologue(const void *start, size_t size)
+{
+    if (!perfmap && !jitdump) {
+        return;
+    }
+    qemu_mutex_lock(&perf_lock);
+    perf_write(start, size, perf_timestamp(), "tcg-prologue-buffer");
+    qemu_mutex_unlock(&perf_lock);
+}
+
+void perf_report_code(TranslationBlock *tb)
+{
+    const char *symbol;
+    g_autofree char *name = NULL;
+    uint64_t timestamp;
+
+    if (!perfmap && !jitdump) {
+        return;
+    }
+
+    timestamp = perf_timestamp();
+    symbol = lookup_symbol(tb->pc);
+    if (symbol[0]) {
+        name = g_strdup_printf("guest-%s-0x" TARGET_FMT_lx, symbol, tb->pc);
+    } else {
+        name = g_strdup_printf("guest-0x" TARGET_FMT_lx, tb->pc);
+    }
+
+    qemu_mutex_lock(&perf_lock);
+    perf_write(tb->tc.ptr, tb->tc.size, timestamp, name);
+    qemu_mutex_unlock(&perf_lock);
+}
+
+void perf_exit(void)
+{
+    if (!perfmap && !jitdump) {
+        return;
+    }
+
+    qemu_mutex_lock(&perf_lock);
+    if (perfmap) {
+        fclose(perfmap);
+        perfmap = NULL;
+    }
+    if (jitdump) {
+        fclose(jitdump);
+        jitdump = NULL;
+        munmap(jitdump_header, qemu_real_host_page_size);
+        jitdump_header = NULL;
+    }
+    qemu_mutex_unlock(&perf_lock);
+}
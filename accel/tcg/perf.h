@@ -0,0 +1,32 @@
+/*
+ * Linux perf perf-<pid>.map and jit-<pid>.dump integration
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#ifndef ACCEL_TCG_PERF_H
+#define ACCEL_TCG_PERF_H
+
+#include "exec/exec-all.h"
+
+/* Start writing perf-<pid>.map */
+void perf_enable_perfmap(void);
+
+/* Start writing jit-<pid>.dump */
+void perf_enable_jitdump(void);
+
+/* Add information about the TCG prologue to profiler maps */
+void perf_report_prologue(const void *start, size_t size);
+
+/*
+ * perf_report_code:
+ * @tb: a freshly generated or restored TB
+ *
+ * Add information about @tb, named after the guest symbol covering
+ * its first instruction when one is known, to profiler maps.
+ */
+void perf_report_code(TranslationBlock *tb);
+
+/* Flush and close the profiler maps */
+void perf_exit(void);
+
+#endif /* ACCEL_TCG_PERF_H */
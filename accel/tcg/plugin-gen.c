@@ -112,27 +112,42 @@ static void do_gen_mem_cb(TCGv vaddr, uint32_t info)
     tcg_temp_free_i32(cpu_index);
 }
 
-static void gen_empty_udata_cb(void)
+/*
+ * Address of the executing vCPU's element of a scoreboard. The data
+ * pointer is loaded at run time so that the scoreboard can be grown
+ * without having to flush the TBs that use it. For a global pointer,
+ * only the first op is copied.
+ */
+static TCGv_ptr gen_empty_plugin_u64_ptr(void)
 {
+    TCGv_ptr ptr = tcg_const_ptr(NULL); /* overwritten later */
+    TCGv_ptr offset = tcg_temp_new_ptr();
     TCGv_i32 cpu_index = tcg_temp_new_i32();
-    TCGv_ptr udata = tcg_const_ptr(NULL); /* will be overwritten later */
+    TCGv_i32 size;
 
+    tcg_gen_ld_ptr(ptr, ptr, 0);
     tcg_gen_ld_i32(cpu_index, cpu_env,
                    -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
-    gen_helper_plugin_vcpu_udata_cb(cpu_index, udata);
+    size = tcg_const_i32(0); /* overwritten later */
+    tcg_gen_mul_i32(cpu_index, cpu_index, size);
+    tcg_gen_ext_i32_ptr(offset, cpu_index);
+    tcg_gen_add_ptr(ptr, ptr, offset);
 
-    tcg_temp_free_ptr(udata);
+    tcg_temp_free_i32(size);
     tcg_temp_free_i32(cpu_index);
+    tcg_temp_free_ptr(offset);
+    return ptr;
 }
 
 /*
- * For now we only support addi_i64.
+ * For now we only support addi_i64, from which a store is made by
+ * replacing the load with zero.
  * When we support more ops, we can generate one empty inline cb for each.
  */
 static void gen_empty_inline_cb(void)
 {
     TCGv_i64 val = tcg_temp_new_i64();
-    TCGv_ptr ptr = tcg_const_ptr(NULL); /* overwritten later */
+    TCGv_ptr ptr = gen_empty_plugin_u64_ptr();
 
     tcg_gen_ld_i64(val, ptr, 0);
     /* pass an immediate != 0 so that it doesn't get optimized away */
@@ -142,6 +157,47 @@ static void gen_empty_inline_cb(void)
     tcg_temp_free_i64(val);
 }
 
+static void do_gen_udata_cb(void)
+{
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+    TCGv_ptr udata = tcg_const_ptr(NULL); /* will be overwritten later */
+
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    gen_helper_plugin_vcpu_udata_cb(cpu_index, udata);
+
+    tcg_temp_free_ptr(udata);
+    tcg_temp_free_i32(cpu_index);
+}
+
+/*
+ * The unconditional callback comes first, followed by the conditional
+ * one. The branch of the latter is only ever emitted here, before any
+ * of the guest insn's ops, so that no guest temp is live across it.
+ */
+static void gen_empty_udata_cb(void)
+{
+    TCGv_ptr ptr;
+    TCGv_i64 val, imm;
+    TCGLabel *skip;
+
+    do_gen_udata_cb();
+
+    ptr = gen_empty_plugin_u64_ptr();
+    val = tcg_temp_new_i64();
+    skip = gen_new_label();
+    tcg_gen_ld_i64(val, ptr, 0);
+    imm = tcg_const_i64(0); /* overwritten later */
+    /* the condition is overwritten later too */
+    tcg_gen_brcond_i64(TCG_COND_NE, val, imm, skip);
+    tcg_temp_free_i64(imm);
+    tcg_temp_free_i64(val);
+    tcg_temp_free_ptr(ptr);
+
+    do_gen_udata_cb();
+    gen_set_label(skip);
+}
+
 static void gen_empty_mem_cb(TCGv addr, uint32_t info)
 {
     do_gen_mem_cb(addr, info);
@@ -196,8 +252,12 @@ static inline void plugin_gen_empty_callback(enum plugin_gen_from from)
                     gen_empty_mem_helper);
         /* fall through */
     case PLUGIN_GEN_FROM_TB:
-        gen_wrapped(from, PLUGIN_GEN_CB_UDATA, gen_empty_udata_cb);
+        /*
+         * Inline ops go first, so that conditional callbacks see the
+         * values updated for this execution.
+         */
         gen_wrapped(from, PLUGIN_GEN_CB_INLINE, gen_empty_inline_cb);
+        gen_wrapped(from, PLUGIN_GEN_CB_UDATA, gen_empty_udata_cb);
         break;
     default:
         g_assert_not_reached();
@@ -353,28 +413,59 @@ static TCGOp *copy_extu_tl_i64(TCGOp **begin_op, TCGOp *op)
     return op;
 }
 
-static TCGOp *copy_ld_i64(TCGOp **begin_op, TCGOp *op)
+static TCGOp *copy_ld_i64(TCGOp **begin_op, TCGOp *op, intptr_t offset)
 {
     if (TCG_TARGET_REG_BITS == 32) {
         /* 2x ld_i32 */
         op = copy_op(begin_op, op, INDEX_op_ld_i32);
+        op->args[2] += offset;
         op = copy_op(begin_op, op, INDEX_op_ld_i32);
+        op->args[2] += offset;
     } else {
         /* ld_i64 */
         op = copy_op(begin_op, op, INDEX_op_ld_i64);
+        op->args[2] += offset;
+    }
+    return op;
+}
+
+/* Replace a load by a move of zero to the same temp */
+static TCGOp *copy_ld_as_zero(TCGOp **begin_op, TCGOp *op, TCGOpcode opc,
+                              TCGOpcode movi)
+{
+    *begin_op = QTAILQ_NEXT(*begin_op, link);
+    tcg_debug_assert(*begin_op && (*begin_op)->opc == opc);
+    op = tcg_op_insert_after(tcg_ctx, op, movi);
+    op->args[0] = (*begin_op)->args[0];
+    op->args[1] = 0;
+    return op;
+}
+
+static TCGOp *copy_ld_i64_as_zero(TCGOp **begin_op, TCGOp *op)
+{
+    if (TCG_TARGET_REG_BITS == 32) {
+        /* 2x ld_i32 */
+        op = copy_ld_as_zero(begin_op, op, INDEX_op_ld_i32, INDEX_op_movi_i32);
+        op = copy_ld_as_zero(begin_op, op, INDEX_op_ld_i32, INDEX_op_movi_i32);
+    } else {
+        /* ld_i64 */
+        op = copy_ld_as_zero(begin_op, op, INDEX_op_ld_i64, INDEX_op_movi_i64);
     }
     return op;
 }
 
-static TCGOp *copy_st_i64(TCGOp **begin_op, TCGOp *op)
+static TCGOp *copy_st_i64(TCGOp **begin_op, TCGOp *op, intptr_t offset)
 {
     if (TCG_TARGET_REG_BITS == 32) {
         /* 2x st_i32 */
         op = copy_op(begin_op, op, INDEX_op_st_i32);
+        op->args[2] += offset;
         op = copy_op(begin_op, op, INDEX_op_st_i32);
+        op->args[2] += offset;
     } else {
         /* st_i64 */
         op = copy_op(begin_op, op, INDEX_op_st_i64);
+        op->args[2] += offset;
     }
     return op;
 }
@@ -398,11 +489,81 @@ static TCGOp *copy_st_ptr(TCGOp **begin_op, TCGOp *op)
         op = copy_op(begin_op, op, INDEX_op_st_i32);
     } else {
         /* st_i64 */
-        op = copy_st_i64(begin_op, op);
+        op = copy_st_i64(begin_op, op, 0);
+    }
+    return op;
+}
+
+static TCGOp *copy_ld_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        /* ld_i32 */
+        op = copy_op(begin_op, op, INDEX_op_ld_i32);
+    } else {
+        /* ld_i64 */
+        op = copy_op(begin_op, op, INDEX_op_ld_i64);
     }
     return op;
 }
 
+static TCGOp *copy_ext_i32_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        /* mov_i32 */
+        op = copy_op(begin_op, op, INDEX_op_mov_i32);
+    } else {
+        /* ext_i32_i64 */
+        op = copy_op(begin_op, op, INDEX_op_ext_i32_i64);
+    }
+    return op;
+}
+
+static TCGOp *copy_add_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        /* add_i32 */
+        op = copy_op(begin_op, op, INDEX_op_add_i32);
+    } else {
+        /* add_i64 */
+        op = copy_op(begin_op, op, INDEX_op_add_i64);
+    }
+    return op;
+}
+
+static TCGOp *copy_brcond_i64(TCGOp **begin_op, TCGOp *op, TCGCond cond,
+                              TCGLabel *l)
+{
+    l->refs++;
+    if (TCG_TARGET_REG_BITS == 32) {
+        /* brcond2_i32 */
+        op = copy_op(begin_op, op, INDEX_op_brcond2_i32);
+        op->args[4] = cond;
+        op->args[5] = label_arg(l);
+    } else {
+        /* brcond_i64 */
+        op = copy_op(begin_op, op, INDEX_op_brcond_i64);
+        op->args[2] = cond;
+        op->args[3] = label_arg(l);
+    }
+    return op;
+}
+
+static TCGOp *copy_set_label(TCGOp **begin_op, TCGOp *op, TCGLabel *l)
+{
+    op = copy_op(begin_op, op, INDEX_op_set_label);
+    op->args[0] = label_arg(l);
+    return op;
+}
+
+/* skip the ops of the template up to and including the first @opc */
+static void skip_ops(TCGOp **begin_op, TCGOpcode opc)
+{
+    do {
+        *begin_op = QTAILQ_NEXT(*begin_op, link);
+        tcg_debug_assert(*begin_op);
+    } while ((*begin_op)->opc != opc);
+}
+
 static TCGOp *copy_call(TCGOp **begin_op, TCGOp *op, void *empty_func,
                         void *func, unsigned tcg_flags, int *cb_idx)
 {
@@ -436,9 +597,116 @@ static TCGOp *copy_call(TCGOp **begin_op, TCGOp *op, void *empty_func,
     return op;
 }
 
+/*
+ * Copy the address computation of gen_empty_plugin_u64_ptr() for @entry,
+ * or only its first op, pointing at @ptr, if @entry is not in a scoreboard.
+ */
+static TCGOp *copy_plugin_u64_ptr(TCGOp **begin_op, TCGOp *op,
+                                  qemu_plugin_u64 entry, void *ptr)
+{
+    struct qemu_plugin_scoreboard *score = entry.score;
+
+    if (!score) {
+        op = copy_const_ptr(begin_op, op, ptr);
+        skip_ops(begin_op, UINTPTR_MAX == UINT32_MAX ?
+                 INDEX_op_add_i32 : INDEX_op_add_i64);
+        return op;
+    }
+
+    /* const_ptr */
+    op = copy_const_ptr(begin_op, op, &score->data);
+
+    /* ld_ptr */
+    op = copy_ld_ptr(begin_op, op);
+
+    /* ld_i32 */
+    op = copy_op(begin_op, op, INDEX_op_ld_i32);
+
+    /* const_i32 == movi_i32 */
+    op = copy_op(begin_op, op, INDEX_op_movi_i32);
+    op->args[1] = score->element_size;
+
+    /* mul_i32 */
+    op = copy_op(begin_op, op, INDEX_op_mul_i32);
+
+    /* ext_i32_ptr */
+    op = copy_ext_i32_ptr(begin_op, op);
+
+    /* add_ptr */
+    op = copy_add_ptr(begin_op, op);
+
+    return op;
+}
+
+static TCGCond plugin_cond_to_tcgcond(enum qemu_plugin_cond cond)
+{
+    switch (cond) {
+    case QEMU_PLUGIN_COND_EQ:
+        return TCG_COND_EQ;
+    case QEMU_PLUGIN_COND_NE:
+        return TCG_COND_NE;
+    case QEMU_PLUGIN_COND_LT:
+        return TCG_COND_LTU;
+    case QEMU_PLUGIN_COND_LE:
+        return TCG_COND_LEU;
+    case QEMU_PLUGIN_COND_GT:
+        return TCG_COND_GTU;
+    case QEMU_PLUGIN_COND_GE:
+        return TCG_COND_GEU;
+    default:
+        /* NEVER is dropped at registration, ALWAYS is unconditional */
+        g_assert_not_reached();
+    }
+}
+
+static TCGOp *append_cond_udata_cb(const struct qemu_plugin_dyn_cb *cb,
+                                   TCGOp *begin_op, TCGOp *op, int *cb_idx)
+{
+    TCGLabel *skip = gen_new_label();
+    TCGCond cond = tcg_invert_cond(plugin_cond_to_tcgcond(cb->cond.cond));
+
+    /* skip the unconditional callback */
+    skip_ops(&begin_op, INDEX_op_call);
+
+    op = copy_plugin_u64_ptr(&begin_op, op, cb->cond.entry, NULL);
+
+    /* ld_i64 */
+    op = copy_ld_i64(&begin_op, op, cb->cond.entry.offset);
+
+    /* const_i64 */
+    op = copy_const_i64(&begin_op, op, cb->cond.imm);
+
+    /* brcond_i64 */
+    op = copy_brcond_i64(&begin_op, op, cond, skip);
+
+    /* const_ptr */
+    op = copy_const_ptr(&begin_op, op, cb->userp);
+
+    /* ld_i32, which is always needed past the branch */
+    op = copy_op(&begin_op, op, INDEX_op_ld_i32);
+
+    /* call */
+    op = copy_call(&begin_op, op, HELPER(plugin_vcpu_udata_cb),
+                   cb->f.vcpu_udata, cb->tcg_flags, cb_idx);
+
+    /* set_label */
+    op = copy_set_label(&begin_op, op, skip);
+
+    /*
+     * The branch ends the basic block, so the cpu_index temp of the
+     * unconditional callback can no longer be shared with the next one.
+     */
+    *cb_idx = -1;
+    return op;
+}
+
 static TCGOp *append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
                               TCGOp *begin_op, TCGOp *op, int *cb_idx)
 {
+    if (cb->cond.cond != QEMU_PLUGIN_COND_ALWAYS) {
+        return append_cond_udata_cb(cb, begin_op, op, cb_idx);
+    }
+
     /* const_ptr */
     op = copy_const_ptr(&begin_op, op, cb->userp);
 
@@ -461,11 +729,22 @@ static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
                                TCGOp *begin_op, TCGOp *op,
                                int *unused)
 {
-    /* const_ptr */
-    op = copy_const_ptr(&begin_op, op, cb->userp);
+    qemu_plugin_u64 entry = cb->inline_insn.entry;
 
-    /* ld_i64 */
-    op = copy_ld_i64(&begin_op, op);
+    op = copy_plugin_u64_ptr(&begin_op, op, entry, cb->userp);
+
+    switch (cb->inline_insn.op) {
+    case QEMU_PLUGIN_INLINE_ADD_U64:
+        /* ld_i64 */
+        op = copy_ld_i64(&begin_op, op, entry.offset);
+        break;
+    case QEMU_PLUGIN_INLINE_STORE_U64:
+        /* ld_i64, made zero so that the add below stores @imm */
+        op = copy_ld_i64_as_zero(&begin_op, op);
+        break;
+    default:
+        g_assert_not_reached();
+    }
 
     /* const_i64 */
     op = copy_const_i64(&begin_op, op, cb->inline_insn.imm);
@@ -474,7 +753,7 @@ static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
     op = copy_add_i64(&begin_op, op);
 
     /* st_i64 */
-    op = copy_st_i64(&begin_op, op);
+    op = copy_st_i64(&begin_op, op, entry.offset);
 
     return op;
 }
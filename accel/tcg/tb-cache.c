@@ -0,0 +1,463 @@
+/*
+ * Persistent translation block cache
+ *
+ * Booting the same firmware over and over spends most of its start up
+ * time translating the same code again. With "-accel tcg,tb-cache=FILE"
+ * the code buffer is written to FILE when QEMU exits, together with a
+ * copy of the guest code each TB was generated from. The next run maps
+ * FILE and, just before its first translation, copies the code back to
+ * the host address it was saved from. tb_gen_code() then reuses a saved
+ * TB instead of translating whenever the guest code at its physical
+ * address is still identical, byte for byte.
+ *
+ * Generated code contains absolute host addresses: helpers, the
+ * epilogue, the TB itself. A saved image is therefore only used by the
+ * same QEMU binary run with the same command line, and only when both
+ * the binary and the code buffer end up at the same addresses, which in
+ * practice means running with address space randomization disabled
+ * (e.g. "setarch -R"). TBs embedding pointers to other host objects are
+ * never saved, see CF_NOPERSIST.
+ *
+ * Only a single TCG context is supported, i.e. thread=single or a
+ * single vCPU.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/memory.h"
+#include "exec/tb-hash.h"
+#include "tcg/tcg.h"
+#include "qapi/error.h"
+#include "qemu/error-report.h"
+#include "qemu/qemu-print.h"
+#include "sysemu/sysemu.h"
+#include "tb-cache.h"
+
+#define TB_CACHE_MAGIC "QEMUTBC1"
+#define TB_CACHE_FINGERPRINT_LEN 32
+
+/*
+ * File layout: the header, @nb_entries TBCacheEntry, @guest_size bytes
+ * of guest code and @image_size bytes of code buffer.
+ */
+typedef struct TBCacheHeader {
+    char magic[8];
+    uint8_t fingerprint[TB_CACHE_FINGERPRINT_LEN];
+    uint64_t text;              /* host address of tb_cache_init() */
+    uint64_t base;              /* host address of the code image */
+    uint64_t image_size;
+    uint64_t nb_entries;
+    uint64_t guest_size;
+} TBCacheHeader;
+
+typedef struct TBCacheEntry {
+    uint64_t tb_offset;         /* of the TranslationBlock within the image */
+    uint64_t guest_offset;      /* of the copy of its guest code */
+    uint64_t phys_pc;
+    uint64_t phys_page2;
+    uint64_t pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    uint32_t trace_vcpu_dstate;
+    uint32_t size;
+} TBCacheEntry;
+
+typedef struct TBCacheSave {
+    void *base;
+    void *end;
+    GArray *entries;
+    GByteArray *guest;
+} TBCacheSave;
+
+static struct {
+    char *path;
+    uint8_t fingerprint[TB_CACHE_FINGERPRINT_LEN];
+    Notifier exit_notifier;
+
+    /* The saved image, if one was found */
+    void *map;
+    size_t map_size;
+    const TBCacheHeader *hdr;
+    const uint8_t *guest;
+    const uint8_t *image;
+    /* Saved TBs not yet restored nor found stale */
+    GHashTable *dormant;
+
+    /* The context generating code */
+    TCGContext *ctx;
+    bool disabled;
+
+    size_t restored;
+    size_t stale;
+} tb_cache;
+
+static guint tb_cache_entry_hash(gconstpointer p)
+{
+    const TBCacheEntry *e = p;
+
+    return tb_hash_func(e->phys_pc, e->pc, e->flags,
+                        e->cflags & CF_HASH_MASK, e->trace_vcpu_dstate);
+}
+
+static gboolean tb_cache_entry_equal(gconstpointer a, gconstpointer b)
+{
+    const TBCacheEntry *ea = a;
+    const TBCacheEntry *eb = b;
+
+    return ea->phys_pc == eb->phys_pc &&
+           ea->pc == eb->pc &&
+           ea->cs_base == eb->cs_base &&
+           ea->flags == eb->flags &&
+           (ea->cflags & CF_HASH_MASK) == (eb->cflags & CF_HASH_MASK) &&
+           ea->trace_vcpu_dstate == eb->trace_vcpu_dstate;
+}
+
+/*
+ * Identify the QEMU binary and its configuration. Anything that changes
+ * the code generated for a given guest state must be covered here.
+ */
+static bool tb_cache_fingerprint(uint8_t *digest, Error **errp)
+{
+#ifdef CONFIG_LINUX
+    g_autoptr(GChecksum) sum = g_checksum_new(G_CHECKSUM_SHA256);
+    g_autofree char *cmdline = NULL;
+    gsize len, digest_len = TB_CACHE_FINGERPRINT_LEN;
+    struct stat st;
+
+    if (stat("/proc/self/exe", &st) < 0) {
+        error_setg_errno(errp, errno, "tb-cache: cannot identify QEMU binary");
+        return false;
+    }
+    if (!g_file_get_contents("/proc/self/cmdline", &cmdline, &len, NULL)) {
+        error_setg(errp, "tb-cache: cannot read the command line");
+        return false;
+    }
+
+    g_checksum_update(sum, (const guchar *)&st.st_dev, sizeof(st.st_dev));
+    g_checksum_update(sum, (const guchar *)&st.st_ino, sizeof(st.st_ino));
+    g_checksum_update(sum, (const guchar *)&st.st_size, sizeof(st.st_size));
+    g_checksum_update(sum, (const guchar *)&st.st_mtime, sizeof(st.st_mtime));
+    g_checksum_update(sum, (const guchar *)cmdline, len);
+    g_checksum_get_digest(sum, digest, &digest_len);
+    return true;
+#else
+    error_setg(errp, "tb-cache is not supported on this host");
+    return false;
+#endif
+}
+
+static bool tb_cache_entry_valid(const TBCacheHeader *hdr,
+                                 const TBCacheEntry *e)
+{
+    return e->size > 0 && e->size <= TARGET_PAGE_SIZE &&
+           e->size <= hdr->guest_size &&
+           e->guest_offset <= hdr->guest_size - e->size &&
+           e->tb_offset <= hdr->image_size - sizeof(TranslationBlock);
+}
+
+static void tb_cache_load(void)
+{
+    const TBCacheHeader *hdr;
+    const TBCacheEntry *entries;
+    struct stat st;
+    uint64_t i, size;
+    void *map;
+    int fd;
+
+    fd = qemu_open(tb_cache.path, O_RDONLY | O_BINARY);
+    if (fd < 0) {
+        /* Nothing saved yet */
+        return;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < sizeof(*hdr)) {
+        goto out;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        goto out;
+    }
+
+    hdr = map;
+    size = st.st_size - sizeof(*hdr);
+    if (memcmp(hdr->magic, TB_CACHE_MAGIC, sizeof(hdr->magic)) ||
+        hdr->nb_entries > size / sizeof(TBCacheEntry) ||
+        hdr->guest_size > size - hdr->nb_entries * sizeof(TBCacheEntry) ||
+        hdr->image_size != size - hdr->nb_entries * sizeof(TBCacheEntry) -
+                           hdr->guest_size ||
+        hdr->image_size < sizeof(TranslationBlock)) {
+        warn_report("tb-cache: ignoring %s, not a TB cache file",
+                    tb_cache.path);
+        munmap(map, st.st_size);
+        goto out;
+    }
+    if (memcmp(hdr->fingerprint, tb_cache.fingerprint,
+               sizeof(hdr->fingerprint))) {
+        /* A different binary or command line, it will be overwritten */
+        munmap(map, st.st_size);
+        goto out;
+    }
+
+    tb_cache.map = map;
+    tb_cache.map_size = st.st_size;
+    tb_cache.hdr = hdr;
+    entries = (const TBCacheEntry *)(hdr + 1);
+    tb_cache.guest = (const uint8_t *)(entries + hdr->nb_entries);
+    tb_cache.image = tb_cache.guest + hdr->guest_size;
+
+    tb_cache.dormant = g_hash_table_new(tb_cache_entry_hash,
+                                        tb_cache_entry_equal);
+    for (i = 0; i < hdr->nb_entries; i++) {
+        if (tb_cache_entry_valid(hdr, &entries[i])) {
+            g_hash_table_add(tb_cache.dormant, (gpointer)&entries[i]);
+        }
+    }
+
+ out:
+    close(fd);
+}
+
+void tb_cache_reset(void)
+{
+    if (tb_cache.dormant) {
+        g_hash_table_destroy(tb_cache.dormant);
+        tb_cache.dormant = NULL;
+    }
+    if (tb_cache.map) {
+        munmap(tb_cache.map, tb_cache.map_size);
+        tb_cache.map = NULL;
+        tb_cache.hdr = NULL;
+    }
+}
+
+/*
+ * Called on the first translation of a TCG context: put the saved image
+ * back where it came from, before anything else is generated there.
+ */
+static bool tb_cache_attach(void)
+{
+    TCGContext *s = tcg_ctx;
+    const TBCacheHeader *hdr = tb_cache.hdr;
+
+    if (tb_cache.disabled) {
+        return false;
+    }
+    if (tb_cache.ctx) {
+        warn_report("tb-cache: disabled, more than one TCG context in use");
+        tb_cache.disabled = true;
+        tb_cache_reset();
+        return false;
+    }
+    tb_cache.ctx = s;
+
+    if (!hdr) {
+        return true;
+    }
+    if (hdr->text != (uintptr_t)tb_cache_init ||
+        hdr->base != (uintptr_t)s->code_gen_buffer) {
+        warn_report("tb-cache: ignoring %s, QEMU or its code buffer moved "
+                    "(is address space randomization disabled?)",
+                    tb_cache.path);
+        tb_cache_reset();
+        return true;
+    }
+    if (s->code_gen_ptr != s->code_gen_buffer ||
+        hdr->image_size > s->code_gen_highwater - s->code_gen_buffer) {
+        tb_cache_reset();
+        return true;
+    }
+
+    memcpy(s->code_gen_buffer, tb_cache.image, hdr->image_size);
+    flush_icache_range((uintptr_t)s->code_gen_buffer,
+                       (uintptr_t)s->code_gen_buffer + hdr->image_size);
+    atomic_set(&s->code_gen_ptr, s->code_gen_buffer + hdr->image_size);
+    return true;
+}
+
+static bool tb_cache_guest_matches(const TBCacheEntry *e,
+                                   tb_page_addr_t phys_page2)
+{
+    const uint8_t *saved = tb_cache.guest + e->guest_offset;
+    size_t len0 = MIN(e->size,
+                      TARGET_PAGE_SIZE - (e->phys_pc & ~TARGET_PAGE_MASK));
+
+    if (memcmp(qemu_map_ram_ptr(NULL, e->phys_pc), saved, len0)) {
+        return false;
+    }
+    if (len0 < e->size) {
+        return phys_page2 != -1 &&
+               !memcmp(qemu_map_ram_ptr(NULL, phys_page2), saved + len0,
+                       e->size - len0);
+    }
+    return true;
+}
+
+TranslationBlock *tb_cache_restore(CPUState *cpu, tb_page_addr_t phys_pc,
+                                   target_ulong pc, target_ulong cs_base,
+                                   uint32_t flags, uint32_t cflags)
+{
+    CPUArchState *env = cpu->env_ptr;
+    tb_page_addr_t phys_page2 = -1;
+    target_ulong virt_page2;
+    TranslationBlock *tb;
+    TBCacheEntry key, *e;
+
+    if (!tb_cache.path) {
+        return NULL;
+    }
+    if (unlikely(tcg_ctx != tb_cache.ctx) && !tb_cache_attach()) {
+        return NULL;
+    }
+    /* Saved TBs know nothing about single stepping or breakpoints */
+    if (!tb_cache.dormant || (cflags & CF_NOCACHE) ||
+        cpu->singlestep_enabled || singlestep ||
+        !QTAILQ_EMPTY(&cpu->breakpoints)) {
+        return NULL;
+    }
+
+    key.phys_pc = phys_pc;
+    key.pc = pc;
+    key.cs_base = cs_base;
+    key.flags = flags;
+    key.cflags = cflags;
+    key.trace_vcpu_dstate = *cpu->trace_dstate;
+    e = g_hash_table_lookup(tb_cache.dormant, &key);
+    if (!e) {
+        return NULL;
+    }
+    /* Whatever happens next, a saved TB is only offered once */
+    g_hash_table_remove(tb_cache.dormant, e);
+
+    virt_page2 = (pc + e->size - 1) & TARGET_PAGE_MASK;
+    if ((pc & TARGET_PAGE_MASK) != virt_page2) {
+        phys_page2 = get_page_addr_code(env, virt_page2);
+    }
+    tb = tb_cache.ctx->code_gen_buffer + e->tb_offset;
+    if (phys_page2 != (tb_page_addr_t)e->phys_page2 ||
+        tb->pc != pc || tb->size != e->size ||
+        !tb_cache_guest_matches(e, phys_page2)) {
+        atomic_set(&tb_cache.stale, tb_cache.stale + 1);
+        return NULL;
+    }
+
+    atomic_set(&tb_cache.restored, tb_cache.restored + 1);
+    return tb;
+}
+
+static gboolean tb_cache_save_iter(gpointer key, gpointer value, gpointer data)
+{
+    const TranslationBlock *tb = value;
+    TBCacheSave *save = data;
+    uint32_t cflags = atomic_read(&tb->cflags);
+    TBCacheEntry e;
+    size_t len0;
+
+    if ((cflags & (CF_NOCACHE | CF_INVALID | CF_NOPERSIST)) ||
+        tb->size == 0 || (const void *)tb < save->base ||
+        tb->tc.ptr + tb->tc.size > save->end) {
+        return false;
+    }
+
+    e.tb_offset = (const void *)tb - save->base;
+    e.guest_offset = save->guest->len;
+    e.phys_pc = tb->page_addr[0] | (tb->pc & ~TARGET_PAGE_MASK);
+    e.phys_page2 = tb->page_addr[1];
+    e.pc = tb->pc;
+    e.cs_base = tb->cs_base;
+    e.flags = tb->flags;
+    e.cflags = cflags;
+    e.trace_vcpu_dstate = tb->trace_vcpu_dstate;
+    e.size = tb->size;
+
+    len0 = MIN(tb->size, TARGET_PAGE_SIZE - (tb->pc & ~TARGET_PAGE_MASK));
+    g_byte_array_append(save->guest, qemu_map_ram_ptr(NULL, e.phys_pc), len0);
+    if (len0 < tb->size) {
+        g_byte_array_append(save->guest,
+                            qemu_map_ram_ptr(NULL, tb->page_addr[1]),
+                            tb->size - len0);
+    }
+    g_array_append_val(save->entries, e);
+    return false;
+}
+
+static void tb_cache_save(Notifier *n, void *unused)
+{
+    TCGContext *s = tb_cache.ctx;
+    g_autofree char *tmp = NULL;
+    TBCacheHeader hdr = {};
+    TBCacheSave save;
+    size_t entries_size;
+    int fd;
+
+    if (!s || tb_cache.disabled) {
+        return;
+    }
+
+    save.base = s->code_gen_buffer;
+    save.end = atomic_read(&s->code_gen_ptr);
+    save.entries = g_array_new(false, false, sizeof(TBCacheEntry));
+    save.guest = g_byte_array_new();
+    tcg_tb_foreach(tb_cache_save_iter, &save);
+
+    memcpy(hdr.magic, TB_CACHE_MAGIC, sizeof(hdr.magic));
+    memcpy(hdr.fingerprint, tb_cache.fingerprint, sizeof(hdr.fingerprint));
+    hdr.text = (uintptr_t)tb_cache_init;
+    hdr.base = (uintptr_t)save.base;
+    hdr.image_size = save.end - save.base;
+    hdr.nb_entries = save.entries->len;
+    hdr.guest_size = save.guest->len;
+    entries_size = save.entries->len * sizeof(TBCacheEntry);
+
+    /* Write a new file, a previous one may still be mapped */
+    tmp = g_strdup_printf("%s.tmp", tb_cache.path);
+    fd = qemu_open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if (fd < 0) {
+        error_report("tb-cache: cannot create %s: %s", tmp, strerror(errno));
+        goto out;
+    }
+    if (qemu_write_full(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        qemu_write_full(fd, save.entries->data, entries_size) != entries_size ||
+        qemu_write_full(fd, save.guest->data, hdr.guest_size) !=
+            hdr.guest_size ||
+        qemu_write_full(fd, save.base, hdr.image_size) != hdr.image_size) {
+        error_report("tb-cache: cannot write %s: %s", tmp, strerror(errno));
+        close(fd);
+        unlink(tmp);
+        goto out;
+    }
+    close(fd);
+    if (rename(tmp, tb_cache.path) < 0) {
+        error_report("tb-cache: cannot rename %s: %s", tmp, strerror(errno));
+        unlink(tmp);
+    }
+
+ out:
+    g_array_free(save.entries, true);
+    g_byte_array_free(save.guest, true);
+}
+
+void tb_cache_init(const char *path, Error **errp)
+{
+    if (!tb_cache_fingerprint(tb_cache.fingerprint, errp)) {
+        return;
+    }
+    tb_cache.path = g_strdup(path);
+    tb_cache_load();
+
+    tb_cache.exit_notifier.notify = tb_cache_save;
+    qemu_add_exit_notifier(&tb_cache.exit_notifier);
+}
+
+void tb_cache_dump_info(void)
+{
+    if (!tb_cache.path) {
+        return;
+    }
+    qemu_printf("TB cache restored   %zu (%zu stale)\n",
+                atomic_read(&tb_cache.restored),
+                atomic_read(&tb_cache.stale));
+}
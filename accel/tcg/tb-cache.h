@@ -0,0 +1,41 @@
+/*
+ * Persistent translation block cache
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#ifndef ACCEL_TCG_TB_CACHE_H
+#define ACCEL_TCG_TB_CACHE_H
+
+#include "exec/exec-all.h"
+
+/*
+ * tb_cache_init:
+ * @path: file the cache is loaded from and saved to
+ * @errp: pointer to Error*, to store an error if it happens.
+ *
+ * Enable the persistent TB cache. Any compatible translations found in
+ * @path are made available to tb_cache_restore(); the current set of
+ * translations is written back to @path when QEMU exits.
+ */
+void tb_cache_init(const char *path, Error **errp);
+
+/*
+ * tb_cache_restore:
+ *
+ * Look for a translation of @pc saved by a previous run, whose guest
+ * code is still identical to what is now at @phys_pc. Returns the TB,
+ * which still needs its jumps reset and to be linked into the page
+ * tables and hash table, or NULL if the block must be translated.
+ *
+ * Called from tb_gen_code() with the memory lock held.
+ */
+TranslationBlock *tb_cache_restore(CPUState *cpu, tb_page_addr_t phys_pc,
+                                   target_ulong pc, target_ulong cs_base,
+                                   uint32_t flags, uint32_t cflags);
+
+/* Forget all saved translations, their code is about to be overwritten */
+void tb_cache_reset(void);
+
+void tb_cache_dump_info(void);
+
+#endif /* ACCEL_TCG_TB_CACHE_H */
@@ -0,0 +1,198 @@
+/*
+ * Speculative translation of direct branch targets
+ *
+ * When a TB is translated, the frontend records the targets of the
+ * direct branches that leave it (translator_note_branch()). Worker
+ * threads pick those up and translate them ahead of execution, so that
+ * by the time a vCPU gets there it only has to look the TB up.
+ *
+ * Only user-mode emulation is supported: guest code is read straight
+ * from host memory, without going through a vCPU's softmmu TLB, and
+ * all translations share a single TCGContext serialised by mmap_lock.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "tcg/tcg.h"
+
+#define TB_PREFETCH_QUEUE_SIZE 256
+
+/* How far to follow branches away from code that has actually run */
+#define TB_PREFETCH_MAX_DEPTH 4
+
+/* Enough for the largest possible TB, see tcg_gen_code() */
+#define TB_PREFETCH_MIN_SPACE (128 * KiB)
+
+typedef struct TBPrefetchReq {
+    CPUState *cpu;
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    int depth;
+} TBPrefetchReq;
+
+static struct {
+    QemuMutex lock;
+    QemuCond cond;
+    unsigned int head;
+    unsigned int tail;
+    TBPrefetchReq ring[TB_PREFETCH_QUEUE_SIZE];
+    unsigned int nthreads;
+} tbp;
+
+/* Depth of the speculative TB being translated by this thread, if any */
+static __thread int tb_prefetch_depth;
+
+/*
+ * A guest write to a page that is not host-writable traps into
+ * page_unprotect(), which needs mmap_lock, so code on such pages
+ * cannot change under our feet. Anything else may be in the middle of
+ * being written by the guest and is left for the vCPU to translate.
+ * Translators never let a TB extend past the page after its first.
+ */
+static bool tb_prefetch_page_ok(target_ulong addr)
+{
+    int flags = page_get_flags(addr);
+
+    return (flags & (PAGE_READ | PAGE_EXEC | PAGE_WRITE)) ==
+           (PAGE_READ | PAGE_EXEC);
+}
+
+static void tb_prefetch_one(TBPrefetchReq *req)
+{
+    TCGContext *s = tcg_ctx;
+    target_ulong page2 = (req->pc & TARGET_PAGE_MASK) + TARGET_PAGE_SIZE;
+
+    mmap_lock();
+    /* Leave running out of code buffer, and the flush, to the vCPUs */
+    if ((uintptr_t)s->code_gen_highwater - (uintptr_t)s->code_gen_ptr <
+        TB_PREFETCH_MIN_SPACE ||
+        !tb_prefetch_page_ok(req->pc) || !tb_prefetch_page_ok(page2)) {
+        mmap_unlock();
+        return;
+    }
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        if (!tb_htable_lookup(req->cpu, req->pc, req->cs_base, req->flags,
+                              req->cflags)) {
+            tb_prefetch_depth = req->depth;
+            tb_gen_code(req->cpu, req->pc, req->cs_base, req->flags,
+                        req->cflags);
+            tb_prefetch_depth = 0;
+        }
+    }
+    mmap_unlock();
+}
+
+static void *tb_prefetch_thread(void *arg)
+{
+    rcu_register_thread();
+    tcg_register_thread();
+
+    qemu_mutex_lock(&tbp.lock);
+    for (;;) {
+        TBPrefetchReq req;
+
+        while (tbp.head == tbp.tail) {
+            qemu_cond_wait(&tbp.cond, &tbp.lock);
+        }
+        req = tbp.ring[tbp.head++ % TB_PREFETCH_QUEUE_SIZE];
+        qemu_mutex_unlock(&tbp.lock);
+
+        tb_prefetch_one(&req);
+        object_unref(OBJECT(req.cpu));
+
+        qemu_mutex_lock(&tbp.lock);
+    }
+    return NULL;
+}
+
+static void tb_prefetch_start_threads(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < tbp.nthreads; i++) {
+        QemuThread thread;
+
+        qemu_thread_create(&thread, "tb-prefetch", tb_prefetch_thread,
+                           NULL, QEMU_THREAD_DETACHED);
+    }
+}
+
+void tb_prefetch_init(unsigned int nthreads)
+{
+    if (nthreads == 0 || singlestep) {
+        return;
+    }
+    qemu_mutex_init(&tbp.lock);
+    qemu_cond_init(&tbp.cond);
+    tbp.nthreads = nthreads;
+    tb_prefetch_start_threads();
+}
+
+/* Called with mmap_lock held, right after @tb has been translated */
+void tb_prefetch_queue(CPUState *cpu, TranslationBlock *tb)
+{
+    TCGContext *s = tcg_ctx;
+    uint32_t cflags = tb_cflags(tb);
+    int i;
+
+    if (!tbp.nthreads || s->nb_branch_dest == 0 ||
+        tb_prefetch_depth >= TB_PREFETCH_MAX_DEPTH ||
+        (cflags & (CF_COUNT_MASK | CF_NOCACHE | CF_HOT))) {
+        return;
+    }
+
+    qemu_mutex_lock(&tbp.lock);
+    for (i = 0; i < s->nb_branch_dest; i++) {
+        TBPrefetchReq *req;
+
+        if (s->branch_dest[i] == tb->pc ||
+            tbp.tail - tbp.head == TB_PREFETCH_QUEUE_SIZE) {
+            continue;
+        }
+        req = &tbp.ring[tbp.tail++ % TB_PREFETCH_QUEUE_SIZE];
+        object_ref(OBJECT(cpu));
+        req->cpu = cpu;
+        req->pc = s->branch_dest[i];
+        req->cs_base = tb->cs_base;
+        req->flags = tb->flags;
+        req->cflags = cflags & CF_HASH_MASK;
+        req->depth = tb_prefetch_depth + 1;
+    }
+    qemu_cond_broadcast(&tbp.cond);
+    qemu_mutex_unlock(&tbp.lock);
+}
+
+void tb_prefetch_fork_start(void)
+{
+    if (tbp.nthreads) {
+        qemu_mutex_lock(&tbp.lock);
+    }
+}
+
+void tb_prefetch_fork_end(int child)
+{
+    if (!tbp.nthreads) {
+        return;
+    }
+    if (child) {
+        /* The workers did not survive the fork, start over */
+        while (tbp.head != tbp.tail) {
+            object_unref(OBJECT(tbp.ring[tbp.head++ %
+                                         TB_PREFETCH_QUEUE_SIZE].cpu));
+        }
+        qemu_mutex_init(&tbp.lock);
+        qemu_cond_init(&tbp.cond);
+        tb_prefetch_start_threads();
+    } else {
+        qemu_mutex_unlock(&tbp.lock);
+    }
+}
@@ -26,6 +26,7 @@
 #include "qemu/osdep.h"
 #include "sysemu/accel.h"
 #include "sysemu/tcg.h"
+#include "sysemu/replay.h"
 #include "qom/object.h"
 #include "cpu.h"
 #include "sysemu/cpus.h"
@@ -35,12 +36,18 @@
 #include "qemu/error-report.h"
 #include "hw/boards.h"
 #include "qapi/qapi-builtin-visit.h"
+#include "tb-cache.h"
+#include "perf.h"
 
 struct TCGState {
     AccelState parent_obj;
 
     bool mttcg_enabled;
     unsigned long tb_size;
+    char *tb_cache;
+    bool perfmap;
+    bool jitdump;
+    bool poll_sleep;
 };
 typedef struct TCGState TCGState;
 
@@ -127,9 +134,31 @@ static int tcg_init(MachineState *ms)
 {
     TCGState *s = TCG_STATE(current_accel());
 
+    if (s->tb_cache) {
+        Error *local_err = NULL;
+
+        if (s->mttcg_enabled && ms->smp.max_cpus > 1) {
+            error_report("tb-cache requires thread=single");
+            return -EINVAL;
+        }
+        tb_cache_init(s->tb_cache, &local_err);
+        if (local_err) {
+            error_report_err(local_err);
+            return -EINVAL;
+        }
+    }
+
+    if (s->perfmap) {
+        perf_enable_perfmap();
+    }
+    if (s->jitdump) {
+        perf_enable_jitdump();
+    }
+
     tcg_exec_init(s->tb_size * 1024 * 1024);
     cpu_interrupt_handler = tcg_handle_interrupt;
     mttcg_enabled = s->mttcg_enabled;
+    tcg_poll_sleep = s->poll_sleep;
     return 0;
 }
 
@@ -147,7 +176,8 @@ static void tcg_set_thread(Object *obj, const char *value, Error **errp)
     if (strcmp(value, "multi") == 0) {
         if (TCG_OVERSIZED_GUEST) {
             error_setg(errp, "No MTTCG when guest word size > hosts");
-        } else if (use_icount) {
+        } else if (use_icount && replay_mode == REPLAY_MODE_NONE) {
+            /* record/replay keeps icount deterministic per vCPU thread */
             error_setg(errp, "No MTTCG when icount is enabled");
         } else {
 #ifndef TARGET_SUPPORTS_MTTCG
@@ -192,6 +222,51 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static char *tcg_get_tb_cache(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->tb_cache);
+}
+
+static void tcg_set_tb_cache(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    g_free(s->tb_cache);
+    s->tb_cache = g_strdup(value);
+}
+
+static bool tcg_get_perfmap(Object *obj, Error **errp)
+{
+    return TCG_STATE(obj)->perfmap;
+}
+
+static void tcg_set_perfmap(Object *obj, bool value, Error **errp)
+{
+    TCG_STATE(obj)->perfmap = value;
+}
+
+static bool tcg_get_jitdump(Object *obj, Error **errp)
+{
+    return TCG_STATE(obj)->jitdump;
+}
+
+static void tcg_set_jitdump(Object *obj, bool value, Error **errp)
+{
+    TCG_STATE(obj)->jitdump = value;
+}
+
+static bool tcg_get_poll_sleep(Object *obj, Error **errp)
+{
+    return TCG_STATE(obj)->poll_sleep;
+}
+
+static void tcg_set_poll_sleep(Object *obj, bool value, Error **errp)
+{
+    TCG_STATE(obj)->poll_sleep = value;
+}
+
 static void tcg_accel_class_init(ObjectClass *oc, void *data)
 {
     AccelClass *ac = ACCEL_CLASS(oc);
@@ -209,6 +284,30 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add_str(oc, "tb-cache",
+                                  tcg_get_tb_cache,
+                                  tcg_set_tb_cache);
+    object_class_property_set_description(oc, "tb-cache",
+        "File to keep translated code in across runs");
+
+    object_class_property_add_bool(oc, "perfmap",
+                                   tcg_get_perfmap,
+                                   tcg_set_perfmap);
+    object_class_property_set_description(oc, "perfmap",
+        "Write translated code symbols to /tmp/perf-<pid>.map");
+
+    object_class_property_add_bool(oc, "jitdump",
+                                   tcg_get_jitdump,
+                                   tcg_set_jitdump);
+    object_class_property_set_description(oc, "jitdump",
+        "Write translated code to /tmp/jit-<pid>.dump");
+
+    object_class_property_add_bool(oc, "poll-sleep",
+                                   tcg_get_poll_sleep,
+                                   tcg_set_poll_sleep);
+    object_class_property_set_description(oc, "poll-sleep",
+        "Sleep in guest polling loops instead of spinning");
+
 }
 
 static const TypeInfo tcg_accel_type = {
@@ -28,9 +28,12 @@
 #include "exec/cpu_ldst.h"
 #include "exec/exec-all.h"
 #include "exec/tb-lookup.h"
+#include "exec/translator.h"
 #include "disas/disas.h"
 #include "exec/log.h"
 #include "tcg/tcg.h"
+#include "qemu/timer.h"
+#include "sysemu/cpus.h"
 
 /* 32-bit helpers */
 
@@ -164,6 +167,56 @@ void *HELPER(lookup_tb_ptr)(CPUArchState *env)
     return tb->tc.ptr;
 }
 
+void HELPER(tb_hot)(CPUArchState *env, void *tb)
+{
+    tb_hot_retranslate(env_cpu(env), tb, GETPC());
+}
+
+/* Longest a polling loop is put to sleep for */
+#define TB_POLL_MAX_MS  1
+
+/*
+ * Called on the back edge of a loop that only loads and compares, see
+ * translator_loop_poll(). Nothing the vCPU can do changes the outcome
+ * of the next iteration, so let time pass instead of spinning.
+ */
+void HELPER(tb_poll)(CPUArchState *env)
+{
+#ifndef CONFIG_USER_ONLY
+    CPUState *cpu = env_cpu(env);
+    int64_t deadline;
+
+    if (use_icount) {
+        /*
+         * Consume the rest of the budget, which runs up to the next
+         * timer deadline, as if the loop had spun until then.
+         */
+        cpu_neg(cpu)->icount_decr.u16.low = 0;
+        cpu->icount_extra = 0;
+        return;
+    }
+
+    /*
+     * Only with poll-sleep=on, and with a single vCPU: round robin TCG
+     * would hold up the other vCPUs, and with MTTCG their stores to RAM
+     * would not wake this one.  Device writes and kicks do, see
+     * qemu_cpu_poll_wake().
+     */
+    if (!tcg_poll_sleep || CPU_NEXT(first_cpu) ||
+        atomic_read(&cpu_neg(cpu)->icount_decr.u16.high)) {
+        return;
+    }
+
+    deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL,
+                                          QEMU_TIMER_ATTR_ALL);
+    if (deadline >= 0 && deadline < TB_POLL_MAX_MS * SCALE_MS) {
+        /* The timer is about to fire anyway */
+        return;
+    }
+    qemu_cpu_poll_sleep(cpu, TB_POLL_MAX_MS);
+#endif
+}
+
 void HELPER(exit_atomic)(CPUArchState *env)
 {
     cpu_loop_exit_atomic(env_cpu(env), GETPC());
@@ -45,11 +45,13 @@
 #endif
 #else
 #include "exec/ram_addr.h"
+#include "tb-cache.h"
 #endif
 
 #include "exec/cputlb.h"
 #include "exec/tb-hash.h"
 #include "translate-all.h"
+#include "perf.h"
 #include "qemu/bitmap.h"
 #include "qemu/error-report.h"
 #include "qemu/qemu-print.h"
@@ -1251,6 +1253,9 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
     page_flush_tb();
 
     tcg_region_reset_all();
+#ifdef CONFIG_SOFTMMU
+    tb_cache_reset();
+#endif
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
     atomic_mb_set(&tb_ctx.tb_flush_count, tb_ctx.tb_flush_count + 1);
@@ -1466,8 +1471,12 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     /* remove the TB from the hash list */
     h = tb_jmp_cache_hash_func(tb->pc);
     CPU_FOREACH(cpu) {
-        if (atomic_read(&cpu->tb_jmp_cache[h]) == tb) {
-            atomic_set(&cpu->tb_jmp_cache[h], NULL);
+        int way;
+
+        for (way = 0; way < TB_JMP_CACHE_WAYS; way++) {
+            if (atomic_read(&cpu->tb_jmp_cache[h + way]) == tb) {
+                atomic_set(&cpu->tb_jmp_cache[h + way], NULL);
+            }
         }
     }
 
@@ -1678,7 +1687,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     TranslationBlock *tb, *existing_tb;
     tb_page_addr_t phys_pc, phys_page2;
     target_ulong virt_page2;
-    tcg_insn_unit *gen_code_buf;
+    tcg_insn_unit *gen_code_buf = NULL;
     int gen_code_size, search_size, max_insns;
 #ifdef CONFIG_PROFILER
     TCGProfile *prof = &tcg_ctx->prof;
@@ -1709,6 +1718,13 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         max_insns = 1;
     }
 
+#ifdef CONFIG_SOFTMMU
+    tb = tb_cache_restore(cpu, phys_pc, pc, cs_base, flags, cflags);
+    if (tb) {
+        goto link;
+    }
+#endif
+
  buffer_overflow:
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
@@ -1728,6 +1744,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->cflags = cflags;
     tb->orig_tb = NULL;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->hot_countdown = TB_HOT_THRESHOLD;
     tcg_ctx->tb_cflags = cflags;
  tb_overflow:
 
@@ -1802,6 +1819,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         goto buffer_overflow;
     }
     tb->tc.size = gen_code_size;
+    if (tcg_ctx->host_ptr_const) {
+        tb->cflags |= CF_NOPERSIST;
+    }
 
 #ifdef CONFIG_PROFILER
     atomic_set(&prof->code_time, prof->code_time + profile_getclock() - ti);
@@ -1873,6 +1893,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         ROUND_UP((uintptr_t)gen_code_buf + gen_code_size + search_size,
                  CODE_GEN_ALIGN));
 
+ link:
     /* init jump list */
     qemu_spin_init(&tb->jmp_lock);
     tb->jmp_list_head = (uintptr_t)NULL;
@@ -1902,17 +1923,57 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     existing_tb = tb_link_page(tb, phys_pc, phys_page2);
     /* if the TB already exists, discard what we just translated */
     if (unlikely(existing_tb != tb)) {
-        uintptr_t orig_aligned = (uintptr_t)gen_code_buf;
+        /* A TB restored from the persistent cache is not at the end */
+        if (gen_code_buf) {
+            uintptr_t orig_aligned = (uintptr_t)gen_code_buf;
 
-        orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
-        atomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
+            orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
+            atomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
+        }
         tb_destroy(tb);
         return existing_tb;
     }
     tcg_tb_insert(tb);
+    perf_report_code(tb);
+#ifdef CONFIG_USER_ONLY
+    tb_prefetch_queue(cpu, tb);
+#endif
     return tb;
 }
 
+/*
+ * Called from the back edge of a loop closing on @tb once the loop has
+ * run TB_HOT_THRESHOLD times: invalidate @tb and go back to cpu_exec(),
+ * which retranslates it with CF_HOT. The branch insn has no other side
+ * effect, so the state at its start with the PC of @tb is the one at
+ * the loop head.
+ */
+void tb_hot_retranslate(CPUState *cpu, TranslationBlock *tb,
+                        uintptr_t retaddr)
+{
+    CPUClass *cc = CPU_GET_CLASS(cpu);
+
+    /* Already replaced, maybe from another vCPU: the jump leaves @tb */
+    if (tb_cflags(tb) & CF_INVALID) {
+        return;
+    }
+
+    cpu_restore_state(cpu, retaddr, true);
+    if (cc->synchronize_from_tb) {
+        cc->synchronize_from_tb(cpu, tb);
+    } else {
+        assert(cc->set_pc);
+        cc->set_pc(cpu, tb->pc);
+    }
+
+    tb_phys_invalidate(tb, -1);
+    atomic_set(&tb_ctx.tb_hot_count, tb_ctx.tb_hot_count + 1);
+
+    /* Translating here could flush and leave with mmap_lock held */
+    cpu->cflags_next_tb = (tb_cflags(tb) & CF_HASH_MASK) | CF_HOT;
+    cpu_loop_exit_noexc(cpu);
+}
+
 /*
  * @p must be non-NULL.
  * user-mode: call with mmap_lock held.
@@ -2272,7 +2333,7 @@ static void tb_jmp_cache_clear_page(CPUState *cpu, target_ulong page_addr)
 {
     unsigned int i, i0 = tb_jmp_cache_hash_page(page_addr);
 
-    for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
+    for (i = 0; i < TB_JMP_PAGE_ENTRIES; i++) {
         atomic_set(&cpu->tb_jmp_cache[i0 + i], NULL);
     }
 }
@@ -2360,6 +2421,9 @@ void dump_exec_info(void)
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
     size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t flush_range, flush_range_full, flush_coalesced;
+    size_t jc_hits = 0, jc_misses = 0, jc_evictions = 0;
+    CPUState *cpu;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -2396,11 +2460,33 @@ void dump_exec_info(void)
                 atomic_read(&tb_ctx.tb_flush_count));
     qemu_printf("TB invalidate count %zu\n",
                 tcg_tb_phys_invalidate_count());
+    qemu_printf("TB hot loop count   %zu\n",
+                atomic_read(&tb_ctx.tb_hot_count));
 
-    tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
+    tlb_flush_counts(&flush_full, &flush_part, &flush_elide,
+                     &flush_range, &flush_range_full, &flush_coalesced);
     qemu_printf("TLB full flushes    %zu\n", flush_full);
     qemu_printf("TLB partial flushes %zu\n", flush_part);
     qemu_printf("TLB elided flushes  %zu\n", flush_elide);
+    qemu_printf("TLB range flushes   %zu (%zu turned into full flushes)\n",
+                flush_range + flush_range_full, flush_range_full);
+    qemu_printf("TLB coalesced flush requests %zu\n", flush_coalesced);
+
+    CPU_FOREACH(cpu) {
+        jc_hits += atomic_read(&cpu->tb_jmp_cache_hits);
+        jc_misses += atomic_read(&cpu->tb_jmp_cache_misses);
+        jc_evictions += atomic_read(&cpu->tb_jmp_cache_evictions);
+    }
+    qemu_printf("TB jmp cache        %d entries, %d-way\n",
+                TB_JMP_CACHE_SIZE, TB_JMP_CACHE_WAYS);
+    qemu_printf("TB jmp cache hits   %zu (%zu%%)\n", jc_hits,
+                jc_hits + jc_misses ?
+                (jc_hits * 100) / (jc_hits + jc_misses) : 0);
+    qemu_printf("TB jmp cache misses %zu\n", jc_misses);
+    qemu_printf("TB jmp cache evicts %zu\n", jc_evictions);
+#ifdef CONFIG_SOFTMMU
+    tb_cache_dump_info();
+#endif
     tcg_dump_info();
 }
 
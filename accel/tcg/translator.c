@@ -9,6 +9,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/error-report.h"
+#include "qemu/bitmap.h"
 #include "cpu.h"
 #include "tcg/tcg.h"
 #include "tcg/tcg-op.h"
@@ -31,6 +32,163 @@ void translator_loop_temp_check(DisasContextBase *db)
     }
 }
 
+/* Limit on the copies of a loop body in a CF_HOT translation */
+#define TB_HOT_MAX_COPIES 8
+
+static bool translator_loop_backedge(DisasContextBase *db, target_ulong dest)
+{
+    /*
+     * Unrolled TBs charge the icount budget for all their insns up front
+     * and repeat guest insns, which plugins and stepping can't cope with.
+     */
+    return dest == db->pc_first &&
+           !(tb_cflags(db->tb) & (CF_USE_ICOUNT | CF_COUNT_MASK)) &&
+           !db->singlestep_enabled && !singlestep &&
+           !db->plugin_enabled;
+}
+
+void translator_loop_count(DisasContextBase *db, target_ulong dest)
+{
+    TCGv_ptr tb_ptr;
+    TCGv_i32 count;
+    TCGLabel *cold;
+
+    if (!translator_loop_backedge(db, dest) ||
+        (tb_cflags(db->tb) & CF_HOT)) {
+        return;
+    }
+
+    tb_ptr = tcg_const_ptr(db->tb);
+    count = tcg_temp_new_i32();
+    cold = gen_new_label();
+    tcg_gen_ld_i32(count, tb_ptr, offsetof(TranslationBlock, hot_countdown));
+    tcg_gen_subi_i32(count, count, 1);
+    tcg_gen_st_i32(count, tb_ptr, offsetof(TranslationBlock, hot_countdown));
+    tcg_gen_brcondi_i32(TCG_COND_GT, count, 0, cold);
+    tcg_temp_free_ptr(tb_ptr);
+    tcg_temp_free_i32(count);
+
+    tb_ptr = tcg_const_ptr(db->tb);
+    gen_helper_tb_hot(cpu_env, tb_ptr);
+    tcg_temp_free_ptr(tb_ptr);
+    gen_set_label(cold);
+}
+
+bool translator_loop_unroll(DisasContextBase *db, target_ulong dest)
+{
+    if (!translator_loop_backedge(db, dest) ||
+        !(tb_cflags(db->tb) & CF_HOT)) {
+        return false;
+    }
+
+    /* The TB starts at the loop head, so everything so far is the body */
+    if (db->loop_insns == 0) {
+        db->loop_insns = db->num_insns;
+    }
+    if (db->loop_copies >= TB_HOT_MAX_COPIES ||
+        db->num_insns + db->loop_insns > db->max_insns ||
+        tcg_op_buf_full()) {
+        return false;
+    }
+    db->loop_copies++;
+    return true;
+}
+
+/*
+ * Scan the ops emitted for the guest insns so far for anything that
+ * could make one iteration of the loop differ from the next: stores,
+ * helper calls, or globals read before being written.
+ */
+static bool translator_loop_is_poll(void)
+{
+    TCGContext *s = tcg_ctx;
+    DECLARE_BITMAP(read, TCG_MAX_TEMPS) = { };
+    DECLARE_BITMAP(written, TCG_MAX_TEMPS) = { };
+    bool started = false;
+    TCGOp *op;
+
+    QTAILQ_FOREACH(op, &s->ops, link) {
+        const TCGOpDef *def = &tcg_op_defs[op->opc];
+        int i;
+
+        /* Skip the icount prologue */
+        if (op->opc == INDEX_op_insn_start) {
+            started = true;
+            continue;
+        }
+        if (!started) {
+            continue;
+        }
+
+        switch (op->opc) {
+        case INDEX_op_call:
+        case INDEX_op_qemu_st_i32:
+        case INDEX_op_qemu_st_i64:
+        case INDEX_op_st8_i32:
+        case INDEX_op_st16_i32:
+        case INDEX_op_st_i32:
+        case INDEX_op_st8_i64:
+        case INDEX_op_st16_i64:
+        case INDEX_op_st32_i64:
+        case INDEX_op_st_i64:
+        case INDEX_op_exit_tb:
+        case INDEX_op_goto_tb:
+        case INDEX_op_goto_ptr:
+            return false;
+        default:
+            if (def->flags & TCG_OPF_VECTOR) {
+                return false;
+            }
+            break;
+        }
+
+        for (i = def->nb_oargs; i < def->nb_oargs + def->nb_iargs; i++) {
+            TCGTemp *ts = arg_temp(op->args[i]);
+
+            if (ts->temp_global && !test_bit(temp_idx(ts), written)) {
+                set_bit(temp_idx(ts), read);
+            }
+        }
+        for (i = 0; i < def->nb_oargs; i++) {
+            TCGTemp *ts = arg_temp(op->args[i]);
+
+            if (ts->temp_global) {
+                if (test_bit(temp_idx(ts), read)) {
+                    return false;
+                }
+                set_bit(temp_idx(ts), written);
+            }
+        }
+    }
+    return started;
+}
+
+bool tcg_poll_sleep;
+
+void translator_loop_poll(DisasContextBase *db, target_ulong dest)
+{
+#ifndef CONFIG_USER_ONLY
+    if (!(use_icount || tcg_poll_sleep) || dest != db->pc_first ||
+        (tb_cflags(db->tb) & CF_COUNT_MASK) ||
+        db->singlestep_enabled || singlestep || db->plugin_enabled ||
+        !translator_loop_is_poll()) {
+        return;
+    }
+    gen_helper_tb_poll(cpu_env);
+#endif
+}
+
+void translator_note_branch(DisasContextBase *db, target_ulong dest)
+{
+    TCGContext *s = tcg_ctx;
+
+    if (db->singlestep_enabled || db->plugin_enabled ||
+        s->nb_branch_dest == ARRAY_SIZE(s->branch_dest)) {
+        return;
+    }
+    s->branch_dest[s->nb_branch_dest++] = dest;
+}
+
 void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
                      CPUState *cpu, TranslationBlock *tb, int max_insns)
 {
@@ -45,6 +203,9 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     db->num_insns = 0;
     db->max_insns = max_insns;
     db->singlestep_enabled = cpu->singlestep_enabled;
+    db->plugin_enabled = false;
+    db->loop_insns = 0;
+    db->loop_copies = 0;
 
     ops->init_disas_context(db, cpu);
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
@@ -58,6 +219,7 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
 
     plugin_enabled = plugin_gen_tb_start(cpu, tb);
+    db->plugin_enabled = plugin_enabled;
 
     while (true) {
         db->num_insns++;
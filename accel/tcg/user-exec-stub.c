@@ -15,6 +15,13 @@ void qemu_init_vcpu(CPUState *cpu)
 
 /* User mode emulation does not support record/replay yet.  */
 
+bool replay_mttcg;
+
+bool replay_vcpu_sync_poll(CPUState *cpu, ReplaySyncKind kind, bool pending)
+{
+    return pending;
+}
+
 bool replay_exception(void)
 {
     return true;
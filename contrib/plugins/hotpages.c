@@ -3,6 +3,10 @@
  *
  * Hot Pages - show which pages saw the most memory accesses.
  *
+ * With the "trace" option, accesses are collected in bulk through a
+ * memory trace and counted by a separate thread, instead of taking a
+ * lock on every access. Only virtual addresses are available then.
+ *
  * License: GNU GPL, version 2 or later.
  *   See the COPYING file in the top-level directory.
  */
@@ -48,6 +52,11 @@ typedef struct {
 static GMutex lock;
 static GHashTable *pages;
 
+static bool do_trace;
+static struct qemu_plugin_mem_trace *trace;
+static GThread *consumer;
+static gint consumer_stop;
+
 static gint cmp_access_count(gconstpointer a, gconstpointer b)
 {
     PageCounters *ea = (PageCounters *) a;
@@ -73,12 +82,66 @@ static gint cmp_access_count(gconstpointer a, gconstpointer b)
 }
 
 
+static void count_access(uint64_t page, unsigned int cpu_index, bool is_store)
+{
+    PageCounters *count;
+
+    g_mutex_lock(&lock);
+    count = (PageCounters *) g_hash_table_lookup(pages, GUINT_TO_POINTER(page));
+
+    if (!count) {
+        count = g_new0(PageCounters, 1);
+        count->page_address = page;
+        g_hash_table_insert(pages, GUINT_TO_POINTER(page), (gpointer) count);
+    }
+    if (is_store) {
+        count->writes++;
+        count->cpu_write |= (1 << cpu_index);
+    } else {
+        count->reads++;
+        count->cpu_read |= (1 << cpu_index);
+    }
+
+    g_mutex_unlock(&lock);
+}
+
+static void count_records(unsigned int cpu_index,
+                          const qemu_plugin_mem_record *records, size_t n,
+                          void *udata)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        count_access(records[i].vaddr & ~page_mask, cpu_index,
+                     qemu_plugin_mem_is_store(records[i].info));
+    }
+}
+
+static gpointer consumer_thread(gpointer data)
+{
+    while (!g_atomic_int_get(&consumer_stop)) {
+        if (!qemu_plugin_mem_trace_drain(trace, count_records, NULL)) {
+            g_usleep(1000);
+        }
+    }
+    return NULL;
+}
+
 static void plugin_exit(qemu_plugin_id_t id, void *p)
 {
-    g_autoptr(GString) report = g_string_new("Addr, RCPUs, Reads, WCPUs, Writes\n");
+    g_autoptr(GString) report = g_string_new("");
     int i;
     GList *counts;
 
+    if (do_trace) {
+        g_atomic_int_set(&consumer_stop, 1);
+        g_thread_join(consumer);
+        qemu_plugin_mem_trace_drain(trace, count_records, NULL);
+        g_string_append_printf(report, "%" PRIu64 " accesses dropped\n",
+                               qemu_plugin_mem_trace_dropped(trace));
+    }
+    g_string_append(report, "Addr, RCPUs, Reads, WCPUs, Writes\n");
+
     counts = g_hash_table_get_values(pages);
     if (counts && g_list_next(counts)) {
         GList *it;
@@ -111,7 +174,6 @@ static void vcpu_haddr(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
 {
     struct qemu_plugin_hwaddr *hwaddr = qemu_plugin_get_hwaddr(meminfo, vaddr);
     uint64_t page;
-    PageCounters *count;
 
     /* We only get a hwaddr for system emulation */
     if (track_io) {
@@ -129,23 +191,7 @@ static void vcpu_haddr(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
     }
     page &= ~page_mask;
 
-    g_mutex_lock(&lock);
-    count = (PageCounters *) g_hash_table_lookup(pages, GUINT_TO_POINTER(page));
-
-    if (!count) {
-        count = g_new0(PageCounters, 1);
-        count->page_address = page;
-        g_hash_table_insert(pages, GUINT_TO_POINTER(page), (gpointer) count);
-    }
-    if (qemu_plugin_mem_is_store(meminfo)) {
-        count->writes++;
-        count->cpu_write |= (1 << cpu_index);
-    } else {
-        count->reads++;
-        count->cpu_read |= (1 << cpu_index);
-    }
-
-    g_mutex_unlock(&lock);
+    count_access(page, cpu_index, qemu_plugin_mem_is_store(meminfo));
 }
 
 static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
@@ -155,9 +201,13 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
 
     for (i = 0; i < n; i++) {
         struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
-        qemu_plugin_register_vcpu_mem_cb(insn, vcpu_haddr,
-                                         QEMU_PLUGIN_CB_NO_REGS,
-                                         rw, NULL);
+        if (do_trace) {
+            qemu_plugin_register_vcpu_mem_trace(insn, rw, trace);
+        } else {
+            qemu_plugin_register_vcpu_mem_cb(insn, vcpu_haddr,
+                                             QEMU_PLUGIN_CB_NO_REGS,
+                                             rw, NULL);
+        }
     }
 }
 
@@ -177,6 +227,8 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
             sort_by = SORT_A;
         } else if (g_strcmp0(opt, "io") == 0) {
             track_io = true;
+        } else if (g_strcmp0(opt, "trace") == 0) {
+            do_trace = true;
         } else if (g_str_has_prefix(opt, "pagesize=")) {
             page_size = g_ascii_strtoull(opt + 9, NULL, 10);
         } else {
@@ -185,7 +237,16 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
         }
     }
 
+    if (do_trace && track_io) {
+        fprintf(stderr, "io and trace are mutually exclusive\n");
+        return -1;
+    }
+
     plugin_init();
+    if (do_trace) {
+        trace = qemu_plugin_mem_trace_new(1 << 16);
+        consumer = g_thread_new("hotpages", consumer_thread, NULL);
+    }
 
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
@@ -0,0 +1,167 @@
+/*
+ * Statistical profiler
+ *
+ * Periodically samples where each vCPU is executing, without
+ * instrumenting any code, and reports either a flat profile or one
+ * line per sampled location in the "folded stacks" format understood
+ * by flamegraph.pl, speedscope and pprof's converters:
+ *
+ *   -plugin contrib/plugins/libsampler.so,arg=period=100000,arg=folded
+ *
+ * Guest call stacks cannot be unwound through the plugin API, so in
+ * folded mode the frames are the vCPU, the MMU index (i.e. privilege
+ * level in system emulation) and the PC, which still lets flame graph
+ * tools split the profile by CPU and mode.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+typedef struct {
+    uint64_t pc;
+    int mmu_idx;
+    unsigned int vcpu_index;
+    uint64_t samples;
+} SampleCount;
+
+/* Plugins need to take care of their own locking */
+static GMutex lock;
+static GHashTable *samples;
+static uint64_t total_samples;
+
+static uint64_t period_ns = 1000000;
+static guint64 limit = 20;
+static bool folded;
+
+static guint sample_hash(gconstpointer key)
+{
+    const SampleCount *s = key;
+
+    return g_int64_hash(&s->pc) ^ (s->mmu_idx << 8) ^ s->vcpu_index;
+}
+
+static gboolean sample_equal(gconstpointer a, gconstpointer b)
+{
+    const SampleCount *sa = a, *sb = b;
+
+    return sa->pc == sb->pc && sa->mmu_idx == sb->mmu_idx &&
+           sa->vcpu_index == sb->vcpu_index;
+}
+
+static gint cmp_samples(gconstpointer a, gconstpointer b)
+{
+    const SampleCount *sa = a, *sb = b;
+
+    return sa->samples > sb->samples ? -1 : sa->samples < sb->samples;
+}
+
+static void vcpu_sample(qemu_plugin_id_t id, unsigned int vcpu_index,
+                        uint64_t pc, int mmu_idx, void *udata)
+{
+    SampleCount key = {
+        .pc = pc,
+        .mmu_idx = mmu_idx,
+        /* the flat profile is summed over all vCPUs */
+        .vcpu_index = folded ? vcpu_index : 0,
+    };
+    SampleCount *cnt;
+
+    g_mutex_lock(&lock);
+    cnt = g_hash_table_lookup(samples, &key);
+    if (!cnt) {
+        cnt = g_memdup(&key, sizeof(key));
+        g_hash_table_add(samples, cnt);
+    }
+    cnt->samples++;
+    total_samples++;
+    g_mutex_unlock(&lock);
+}
+
+static void report_flat(GList *it, GString *report)
+{
+    int i;
+
+    g_string_append_printf(report, "%" PRIu64 " samples, period %" PRIu64
+                           " ns\npc, mmu_idx, samples, %%\n",
+                           total_samples, period_ns);
+    for (i = 0; i < limit && it; i++, it = it->next) {
+        SampleCount *rec = it->data;
+
+        g_string_append_printf(report, "%#016" PRIx64 ", %d, %" PRIu64
+                               ", %.2f\n", rec->pc, rec->mmu_idx,
+                               rec->samples,
+                               100.0 * rec->samples / total_samples);
+    }
+}
+
+static void report_folded(GList *it, GString *report)
+{
+    for (; it; it = it->next) {
+        SampleCount *rec = it->data;
+
+        g_string_append_printf(report, "vcpu%u;mmu%d;0x%" PRIx64 " %"
+                               PRIu64 "\n", rec->vcpu_index, rec->mmu_idx,
+                               rec->pc, rec->samples);
+    }
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autoptr(GString) report = g_string_new("");
+    GList *counts;
+
+    g_mutex_lock(&lock);
+    counts = g_list_sort(g_hash_table_get_keys(samples), cmp_samples);
+    if (folded) {
+        report_folded(counts, report);
+    } else {
+        report_flat(counts, report);
+    }
+    g_list_free(counts);
+    g_mutex_unlock(&lock);
+
+    qemu_plugin_outs(report->str);
+}
+
+QEMU_PLUGIN_EXPORT
+int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
+                        int argc, char **argv)
+{
+    int i;
+
+    for (i = 0; i < argc; i++) {
+        char *opt = argv[i];
+
+        if (g_str_has_prefix(opt, "period=")) {
+            period_ns = g_ascii_strtoull(opt + strlen("period="), NULL, 0);
+        } else if (g_str_has_prefix(opt, "limit=")) {
+            limit = g_ascii_strtoull(opt + strlen("limit="), NULL, 0);
+        } else if (g_strcmp0(opt, "folded") == 0) {
+            folded = true;
+        } else {
+            fprintf(stderr, "option parsing failed: %s\n", opt);
+            return -1;
+        }
+    }
+    if (period_ns == 0) {
+        fprintf(stderr, "period must be non-zero\n");
+        return -1;
+    }
+
+    samples = g_hash_table_new_full(sample_hash, sample_equal, g_free, NULL);
+
+    qemu_plugin_register_vcpu_sample_cb(id, vcpu_sample, period_ns, NULL);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
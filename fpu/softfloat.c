@@ -1885,6 +1885,238 @@ float64_div(float64 a, float64 b, float_status *s)
                         f64_div_pre, f64_div_post);
 }
 
+/*
+ * Batched hardfloat. The lanes of a guest vector are processed a host
+ * vector at a time, using the compiler's generic vector extension so
+ * that it maps onto SSE/AVX (or whatever the host has). The checks are
+ * the same as for the scalar hardfloat functions above: if any lane
+ * fails the pre check, the whole chunk goes through the scalar code,
+ * and lanes whose result may be tiny are recomputed in softfloat.
+ * Unused lanes of a partial chunk are padded with 1.0, which is valid
+ * input to every operation here and raises no exceptions.
+ */
+#if defined(__AVX__)
+# define F32V_LANES 8
+# define F64V_LANES 4
+#else
+# define F32V_LANES 4
+# define F64V_LANES 2
+#endif
+
+typedef float f32v __attribute__((vector_size(F32V_LANES * 4)));
+typedef double f64v __attribute__((vector_size(F64V_LANES * 8)));
+
+typedef union {
+    f32v h;
+    float32 s[F32V_LANES];
+} union_f32v;
+
+typedef union {
+    f64v h;
+    float64 s[F64V_LANES];
+} union_f64v;
+
+typedef f32v (*hard_f32v_op2_fn)(f32v a, f32v b);
+typedef f64v (*hard_f64v_op2_fn)(f64v a, f64v b);
+
+static inline void
+float32_gen2_vec(float32 *d, const float32 *a, const float32 *b, intptr_t n,
+                 float_status *s, hard_f32v_op2_fn hardv,
+                 hard_f32_op2_fn hard, soft_f32_op2_fn soft,
+                 f32_check_fn pre, f32_check_fn post)
+{
+    intptr_t i;
+    int j;
+
+    for (i = 0; i < n; i += F32V_LANES) {
+        int lanes = MIN(n - i, F32V_LANES);
+        union_f32v ua, ub, ur;
+        bool ok = can_use_fpu(s);
+
+        for (j = 0; j < F32V_LANES; j++) {
+            union_float32 ea = { .s = j < lanes ? a[i + j] : float32_one };
+            union_float32 eb = { .s = j < lanes ? b[i + j] : float32_one };
+
+            ok &= pre(ea, eb);
+            ua.s[j] = ea.s;
+            ub.s[j] = eb.s;
+        }
+        if (unlikely(!ok)) {
+            for (j = 0; j < lanes; j++) {
+                d[i + j] = float32_gen2(ua.s[j], ub.s[j], s,
+                                        hard, soft, pre, post);
+            }
+            continue;
+        }
+
+        ur.h = hardv(ua.h, ub.h);
+        for (j = 0; j < lanes; j++) {
+            union_float32 r = { .s = ur.s[j] };
+            union_float32 ea = { .s = ua.s[j] };
+            union_float32 eb = { .s = ub.s[j] };
+
+            if (unlikely(f32_is_inf(r))) {
+                s->float_exception_flags |= float_flag_overflow;
+            } else if (unlikely(fabsf(r.h) <= FLT_MIN) &&
+                       post(ea, eb)) {
+                r.s = soft(ea.s, eb.s, s);
+            }
+            d[i + j] = r.s;
+        }
+    }
+}
+
+static inline void
+float64_gen2_vec(float64 *d, const float64 *a, const float64 *b, intptr_t n,
+                 float_status *s, hard_f64v_op2_fn hardv,
+                 hard_f64_op2_fn hard, soft_f64_op2_fn soft,
+                 f64_check_fn pre, f64_check_fn post)
+{
+    intptr_t i;
+    int j;
+
+    for (i = 0; i < n; i += F64V_LANES) {
+        int lanes = MIN(n - i, F64V_LANES);
+        union_f64v ua, ub, ur;
+        bool ok = can_use_fpu(s);
+
+        for (j = 0; j < F64V_LANES; j++) {
+            union_float64 ea = { .s = j < lanes ? a[i + j] : float64_one };
+            union_float64 eb = { .s = j < lanes ? b[i + j] : float64_one };
+
+            ok &= pre(ea, eb);
+            ua.s[j] = ea.s;
+            ub.s[j] = eb.s;
+        }
+        if (unlikely(!ok)) {
+            for (j = 0; j < lanes; j++) {
+                d[i + j] = float64_gen2(ua.s[j], ub.s[j], s,
+                                        hard, soft, pre, post);
+            }
+            continue;
+        }
+
+        ur.h = hardv(ua.h, ub.h);
+        for (j = 0; j < lanes; j++) {
+            union_float64 r = { .s = ur.s[j] };
+            union_float64 ea = { .s = ua.s[j] };
+            union_float64 eb = { .s = ub.s[j] };
+
+            if (unlikely(f64_is_inf(r))) {
+                s->float_exception_flags |= float_flag_overflow;
+            } else if (unlikely(fabs(r.h) <= DBL_MIN) &&
+                       post(ea, eb)) {
+                r.s = soft(ea.s, eb.s, s);
+            }
+            d[i + j] = r.s;
+        }
+    }
+}
+
+static f32v hard_f32v_add(f32v a, f32v b)
+{
+    return a + b;
+}
+
+static f32v hard_f32v_sub(f32v a, f32v b)
+{
+    return a - b;
+}
+
+static f32v hard_f32v_mul(f32v a, f32v b)
+{
+    return a * b;
+}
+
+static f32v hard_f32v_div(f32v a, f32v b)
+{
+    return a / b;
+}
+
+static f64v hard_f64v_add(f64v a, f64v b)
+{
+    return a + b;
+}
+
+static f64v hard_f64v_sub(f64v a, f64v b)
+{
+    return a - b;
+}
+
+static f64v hard_f64v_mul(f64v a, f64v b)
+{
+    return a * b;
+}
+
+static f64v hard_f64v_div(f64v a, f64v b)
+{
+    return a / b;
+}
+
+void QEMU_FLATTEN
+float32_add_vec(float32 *d, const float32 *a, const float32 *b, intptr_t n,
+                float_status *s)
+{
+    float32_gen2_vec(d, a, b, n, s, hard_f32v_add, hard_f32_add, soft_f32_add,
+                     f32_is_zon2, f32_addsubmul_post);
+}
+
+void QEMU_FLATTEN
+float32_sub_vec(float32 *d, const float32 *a, const float32 *b, intptr_t n,
+                float_status *s)
+{
+    float32_gen2_vec(d, a, b, n, s, hard_f32v_sub, hard_f32_sub, soft_f32_sub,
+                     f32_is_zon2, f32_addsubmul_post);
+}
+
+void QEMU_FLATTEN
+float32_mul_vec(float32 *d, const float32 *a, const float32 *b, intptr_t n,
+                float_status *s)
+{
+    float32_gen2_vec(d, a, b, n, s, hard_f32v_mul, hard_f32_mul, soft_f32_mul,
+                     f32_is_zon2, f32_addsubmul_post);
+}
+
+void QEMU_FLATTEN
+float32_div_vec(float32 *d, const float32 *a, const float32 *b, intptr_t n,
+                float_status *s)
+{
+    float32_gen2_vec(d, a, b, n, s, hard_f32v_div, hard_f32_div, soft_f32_div,
+                     f32_div_pre, f32_div_post);
+}
+
+void QEMU_FLATTEN
+float64_add_vec(float64 *d, const float64 *a, const float64 *b, intptr_t n,
+                float_status *s)
+{
+    float64_gen2_vec(d, a, b, n, s, hard_f64v_add, hard_f64_add, soft_f64_add,
+                     f64_is_zon2, f64_addsubmul_post);
+}
+
+void QEMU_FLATTEN
+float64_sub_vec(float64 *d, const float64 *a, const float64 *b, intptr_t n,
+                float_status *s)
+{
+    float64_gen2_vec(d, a, b, n, s, hard_f64v_sub, hard_f64_sub, soft_f64_sub,
+                     f64_is_zon2, f64_addsubmul_post);
+}
+
+void QEMU_FLATTEN
+float64_mul_vec(float64 *d, const float64 *a, const float64 *b, intptr_t n,
+                float_status *s)
+{
+    float64_gen2_vec(d, a, b, n, s, hard_f64v_mul, hard_f64_mul, soft_f64_mul,
+                     f64_is_zon2, f64_addsubmul_post);
+}
+
+void QEMU_FLATTEN
+float64_div_vec(float64 *d, const float64 *a, const float64 *b, intptr_t n,
+                float_status *s)
+{
+    float64_gen2_vec(d, a, b, n, s, hard_f64v_div, hard_f64_div, soft_f64_div,
+                     f64_div_pre, f64_div_post);
+}
+
 /*
  * Returns the result of dividing the bfloat16
  * value `a' by the corresponding value `b'.
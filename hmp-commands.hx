@@ -353,6 +353,51 @@ SRST
   Since 4.0, loadvm stopped accepting snapshot id as parameter.
 ERST
 
+    {
+        .name       = "savevm-mem",
+        .args_type  = "",
+        .params     = "",
+        .help       = "save a snapshot of the VM in host memory",
+        .cmd        = hmp_savevm_mem,
+    },
+
+SRST
+``savevm-mem``
+  Take a snapshot of the virtual machine in host memory, replacing the
+  previous one. Block devices are not included in the snapshot. The
+  guest RAM is captured copy-on-write, which makes ``loadvm-mem`` cheap
+  enough to reset the VM to a known state thousands of times per second.
+ERST
+
+    {
+        .name       = "loadvm-mem",
+        .args_type  = "",
+        .params     = "",
+        .help       = "restore the snapshot saved by savevm-mem",
+        .cmd        = hmp_loadvm_mem,
+    },
+
+SRST
+``loadvm-mem``
+  Set the virtual machine to the snapshot taken by the last ``savevm-mem``.
+ERST
+
+    {
+        .name       = "replay_seek",
+        .args_type  = "icount:l",
+        .params     = "icount",
+        .help       = "restore the last snapshot of the replay log "
+                      "taken before the instruction",
+        .cmd        = hmp_replay_seek,
+    },
+
+SRST
+``replay_seek`` *icount*
+  When replaying, set the virtual machine to the last snapshot saved
+  while recording at or before the instruction *icount*. The snapshots
+  are found through the index of the replay log.
+ERST
+
     {
         .name       = "delvm",
         .args_type  = "name:s",
@@ -0,0 +1,267 @@
+/*
+ * Cortex-M fleet: many independent M-profile boards in one process
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 or
+ *  (at your option) any later version.
+ */
+
+/*
+ * Firmware regression farms run the same image on hundreds of small
+ * boards.  Running one QEMU process per board means translating the
+ * same firmware hundreds of times and paying for as many code buffers
+ * and main loops.  This machine instead creates one minimal board per
+ * CPU requested with -smp:
+ *
+ *  0x00000000 .. 0x003fffff : flash (4MB, read-only, shared by all boards)
+ *  0x20000000 .. RAM size   : SRAM (-m, private to each board)
+ *  0x40000000 .. 0x40000fff : CMSDK APB timer (IRQ 8)
+ *  0x40004000 .. 0x40004fff : CMSDK APB UART (IRQ 0 TX, IRQ 1 RX)
+ *
+ * Each board has its own address space, NVIC, SysTick, timer and UART,
+ * and a guest reset request (AIRCR.SYSRESETREQ) only resets that board.
+ * Since the flash is the same RAM block in every address space, its
+ * code is translated once and the TBs are shared by all the boards.
+ * With MTTCG (the default where supported) each board gets a host
+ * thread.
+ *
+ * UART n is connected to the n-th -serial option; with the "log-dir"
+ * machine property set, UARTs without one are logged to
+ * <log-dir>/node<n>.log instead.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qapi/error.h"
+#include "qemu/error-report.h"
+#include "hw/arm/boot.h"
+#include "hw/arm/armv7m.h"
+#include "hw/boards.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "sysemu/sysemu.h"
+#include "chardev/char.h"
+#include "hw/char/cmsdk-apb-uart.h"
+#include "hw/timer/cmsdk-apb-timer.h"
+#include "qom/object.h"
+
+#define FLASH_SIZE (4 * MiB)
+#define SRAM_BASE 0x20000000
+#define TIMER_BASE 0x40000000
+#define UART_BASE 0x40004000
+#define NUM_IRQ 32
+
+/* Main SYSCLK frequency in Hz */
+#define SYSCLK_FRQ 25000000
+
+typedef struct FleetNode {
+    ARMv7MState armv7m;
+    MemoryRegion container;
+    MemoryRegion flash;
+    MemoryRegion sram;
+    CMSDKAPBTIMER timer;
+    CMSDKAPBUART uart;
+    qemu_irq sysresetreq;
+} FleetNode;
+
+struct FleetMachineState {
+    MachineState parent;
+
+    MemoryRegion flash;
+    FleetNode *nodes;
+    char *log_dir;
+};
+typedef struct FleetMachineState FleetMachineState;
+
+#define TYPE_FLEET_MACHINE MACHINE_TYPE_NAME("cortex-m-fleet")
+
+DECLARE_INSTANCE_CHECKER(FleetMachineState, FLEET_MACHINE,
+                         TYPE_FLEET_MACHINE)
+
+static void fleet_node_reset_work(CPUState *cs, run_on_cpu_data data)
+{
+    FleetNode *node = data.host_ptr;
+    int i;
+
+    device_cold_reset(DEVICE(&node->timer));
+    device_cold_reset(DEVICE(&node->uart));
+    device_cold_reset(DEVICE(&node->armv7m.nvic));
+    for (i = 0; i < ARRAY_SIZE(node->armv7m.nvic.systick); i++) {
+        device_cold_reset(DEVICE(&node->armv7m.nvic.systick[i]));
+    }
+    cpu_reset(cs);
+}
+
+/*
+ * The request comes from the board's own vCPU in the middle of an NVIC
+ * register write, so defer the reset until it leaves the execution loop.
+ */
+static void fleet_node_sysresetreq(void *opaque, int n, int level)
+{
+    FleetNode *node = opaque;
+
+    if (level) {
+        async_run_on_cpu(CPU(node->armv7m.cpu), fleet_node_reset_work,
+                         RUN_ON_CPU_HOST_PTR(node));
+    }
+}
+
+static Chardev *fleet_node_chardev(FleetMachineState *fms, int i)
+{
+    g_autofree char *label = NULL;
+    g_autofree char *path = NULL;
+    Chardev *chr;
+
+    if (serial_hd(i) || !fms->log_dir) {
+        return serial_hd(i);
+    }
+
+    label = g_strdup_printf("fleet-uart%d", i);
+    path = g_strdup_printf("file:%s/node%d.log", fms->log_dir, i);
+    chr = qemu_chr_new(label, path, NULL);
+    if (!chr) {
+        error_report("Could not open %s", path + strlen("file:"));
+        exit(1);
+    }
+    return chr;
+}
+
+static void fleet_node_init(FleetMachineState *fms, FleetNode *node, int i)
+{
+    MachineState *machine = MACHINE(fms);
+    char *name;
+    DeviceState *armv7m;
+    SysBusDevice *sbd;
+
+    name = g_strdup_printf("node%d.memory", i);
+    memory_region_init(&node->container, OBJECT(fms), name, UINT64_MAX);
+    g_free(name);
+
+    name = g_strdup_printf("node%d.flash", i);
+    memory_region_init_alias(&node->flash, OBJECT(fms), name, &fms->flash,
+                             0, FLASH_SIZE);
+    memory_region_add_subregion(&node->container, 0, &node->flash);
+    g_free(name);
+
+    name = g_strdup_printf("node%d.sram", i);
+    memory_region_init_ram(&node->sram, OBJECT(fms), name, machine->ram_size,
+                           &error_fatal);
+    memory_region_add_subregion(&node->container, SRAM_BASE, &node->sram);
+    g_free(name);
+
+    name = g_strdup_printf("node%d.armv7m", i);
+    object_initialize_child(OBJECT(fms), name, &node->armv7m, TYPE_ARMV7M);
+    g_free(name);
+    armv7m = DEVICE(&node->armv7m);
+    qdev_prop_set_uint32(armv7m, "num-irq", NUM_IRQ);
+    qdev_prop_set_string(armv7m, "cpu-type", machine->cpu_type);
+    qdev_prop_set_bit(armv7m, "enable-bitband", true);
+    object_property_set_link(OBJECT(&node->armv7m), "memory",
+                             OBJECT(&node->container), &error_abort);
+    sysbus_realize(SYS_BUS_DEVICE(&node->armv7m), &error_fatal);
+
+    node->sysresetreq = qemu_allocate_irq(fleet_node_sysresetreq, node, 0);
+    qdev_connect_gpio_out_named(armv7m, "SYSRESETREQ", 0, node->sysresetreq);
+
+    name = g_strdup_printf("node%d.timer", i);
+    object_initialize_child(OBJECT(fms), name, &node->timer,
+                            TYPE_CMSDK_APB_TIMER);
+    g_free(name);
+    qdev_prop_set_uint32(DEVICE(&node->timer), "pclk-frq", SYSCLK_FRQ);
+    sbd = SYS_BUS_DEVICE(&node->timer);
+    sysbus_realize(sbd, &error_fatal);
+    memory_region_add_subregion(&node->container, TIMER_BASE,
+                                sysbus_mmio_get_region(sbd, 0));
+    sysbus_connect_irq(sbd, 0, qdev_get_gpio_in(armv7m, 8));
+
+    name = g_strdup_printf("node%d.uart", i);
+    object_initialize_child(OBJECT(fms), name, &node->uart,
+                            TYPE_CMSDK_APB_UART);
+    g_free(name);
+    qdev_prop_set_chr(DEVICE(&node->uart), "chardev",
+                      fleet_node_chardev(fms, i));
+    qdev_prop_set_uint32(DEVICE(&node->uart), "pclk-frq", SYSCLK_FRQ);
+    sbd = SYS_BUS_DEVICE(&node->uart);
+    sysbus_realize(sbd, &error_fatal);
+    memory_region_add_subregion(&node->container, UART_BASE,
+                                sysbus_mmio_get_region(sbd, 0));
+    sysbus_connect_irq(sbd, 0, qdev_get_gpio_in(armv7m, 0));
+    sysbus_connect_irq(sbd, 1, qdev_get_gpio_in(armv7m, 1));
+
+    /*
+     * The image is loaded once, by the first board, since the flash is
+     * shared.  The others only get their CPU reset handler: rom_ptr()
+     * finds the vector table whatever the address space, and once the
+     * ROM blob has been copied to the flash, each CPU reads the vector
+     * table through its own alias of the flash.
+     */
+    armv7m_load_kernel(node->armv7m.cpu,
+                       i == 0 ? machine->kernel_filename : NULL, FLASH_SIZE);
+}
+
+static void fleet_init(MachineState *machine)
+{
+    FleetMachineState *fms = FLEET_MACHINE(machine);
+    unsigned int n = machine->smp.cpus;
+    int i;
+
+    if (machine->ram_size > 512 * MiB) {
+        error_report("RAM size per board must be at most 512MB");
+        exit(EXIT_FAILURE);
+    }
+
+    memory_region_init_rom(&fms->flash, NULL, "fleet.flash", FLASH_SIZE,
+                           &error_fatal);
+
+    system_clock_scale = NANOSECONDS_PER_SECOND / SYSCLK_FRQ;
+
+    fms->nodes = g_new0(FleetNode, n);
+    for (i = 0; i < n; i++) {
+        fleet_node_init(fms, &fms->nodes[i], i);
+    }
+}
+
+static char *fleet_get_log_dir(Object *obj, Error **errp)
+{
+    FleetMachineState *fms = FLEET_MACHINE(obj);
+
+    return g_strdup(fms->log_dir);
+}
+
+static void fleet_set_log_dir(Object *obj, const char *value, Error **errp)
+{
+    FleetMachineState *fms = FLEET_MACHINE(obj);
+
+    g_free(fms->log_dir);
+    fms->log_dir = g_strdup(value);
+}
+
+static void fleet_class_init(ObjectClass *oc, void *data)
+{
+    MachineClass *mc = MACHINE_CLASS(oc);
+
+    mc->desc = "Many independent Cortex-M boards sharing one code cache";
+    mc->init = fleet_init;
+    mc->max_cpus = 1024;
+    mc->default_ram_size = 256 * KiB;
+    mc->default_cpu_type = ARM_CPU_TYPE_NAME("cortex-m3");
+
+    object_class_property_add_str(oc, "log-dir", fleet_get_log_dir,
+                                  fleet_set_log_dir);
+    object_class_property_set_description(oc, "log-dir",
+        "Directory for the output of the UARTs not given a -serial option");
+}
+
+static const TypeInfo fleet_info = {
+    .name = TYPE_FLEET_MACHINE,
+    .parent = TYPE_MACHINE,
+    .instance_size = sizeof(FleetMachineState),
+    .class_init = fleet_class_init,
+};
+
+static void fleet_machine_init(void)
+{
+    type_register_static(&fleet_info);
+}
+
+type_init(fleet_machine_init);
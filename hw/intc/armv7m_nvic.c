@@ -87,6 +87,48 @@ static int nvic_pending_prio(NVICState *s)
     return s->vectpending_prio;
 }
 
+/* Update irq_live for exception number irq; must be called after
+ * changing the enabled, pending or active state of an external interrupt.
+ * This is a no-op for the internal exceptions, which are never in irq_live.
+ */
+static inline void nvic_irq_live_update(NVICState *s, int irq)
+{
+    VecInfo *vec = &s->vectors[irq];
+
+    if (irq < NVIC_FIRST_IRQ) {
+        return;
+    }
+    if (vec->active || (vec->enabled && vec->pending)) {
+        set_bit(irq, s->irq_live);
+    } else {
+        clear_bit(irq, s->irq_live);
+    }
+}
+
+static void nvic_irq_live_rebuild(NVICState *s)
+{
+    int i;
+
+    bitmap_zero(s->irq_live, NVIC_MAX_VECTORS);
+    for (i = NVIC_FIRST_IRQ; i < s->num_irq; i++) {
+        nvic_irq_live_update(s, i);
+    }
+}
+
+/* Return the next exception number after irq which could affect
+ * vectpending or exception_prio, or s->num_irq if there is none.
+ * The internal exceptions are always visited; external interrupts
+ * only if they are set in irq_live.
+ */
+static inline int nvic_next_live_irq(NVICState *s, int irq)
+{
+    irq++;
+    if (irq < NVIC_FIRST_IRQ) {
+        return irq;
+    }
+    return find_next_bit(s->irq_live, s->num_irq, irq);
+}
+
 /* Return the value of the ISCR RETTOBASE bit:
  * 1 if there is exactly one active exception
  * 0 if there is more than one active exception
@@ -106,7 +148,8 @@ static bool nvic_rettobase(NVICState *s)
     int irq, nhand = 0;
     bool check_sec = arm_feature(&s->cpu->env, ARM_FEATURE_M_SECURITY);
 
-    for (irq = ARMV7M_EXCP_RESET; irq < s->num_irq; irq++) {
+    for (irq = ARMV7M_EXCP_RESET; irq < s->num_irq;
+         irq = nvic_next_live_irq(s, irq)) {
         if (s->vectors[irq].active ||
             (check_sec && irq < NVIC_INTERNAL_VECTORS &&
              s->sec_vectors[irq].active)) {
@@ -242,7 +285,7 @@ static void nvic_recompute_state_secure(NVICState *s)
      * Annoyingly, now we have two prigroup values (for S and NS)
      * we can't do the loop comparison on raw priority values.
      */
-    for (i = 1; i < s->num_irq; i++) {
+    for (i = 1; i < s->num_irq; i = nvic_next_live_irq(s, i)) {
         for (bank = M_REG_S; bank >= M_REG_NS; bank--) {
             VecInfo *vec;
             int prio, subprio;
@@ -306,7 +349,7 @@ static void nvic_recompute_state(NVICState *s)
         return;
     }
 
-    for (i = 1; i < s->num_irq; i++) {
+    for (i = 1; i < s->num_irq; i = nvic_next_live_irq(s, i)) {
         VecInfo *vec = &s->vectors[i];
 
         if (vec->enabled && vec->pending && vec->prio < pend_prio) {
@@ -524,6 +567,7 @@ static void armv7m_nvic_clear_pending(void *opaque, int irq, bool secure)
     trace_nvic_clear_pending(irq, secure, vec->enabled, vec->prio);
     if (vec->pending) {
         vec->pending = 0;
+        nvic_irq_live_update(s, irq);
         nvic_irq_update(s);
     }
 }
@@ -664,6 +708,7 @@ static void do_armv7m_nvic_set_pending(void *opaque, int irq, bool secure,
 
     if (!vec->pending) {
         vec->pending = 1;
+        nvic_irq_live_update(s, irq);
         nvic_irq_update(s);
     }
 }
@@ -800,6 +845,7 @@ void armv7m_nvic_acknowledge_irq(void *opaque)
 
     vec->active = 1;
     vec->pending = 0;
+    nvic_irq_live_update(s, pending);
 
     write_v7m_exception(env, s->vectpending);
 
@@ -901,6 +947,7 @@ int armv7m_nvic_complete_irq(void *opaque, int irq, bool secure)
         assert(irq >= NVIC_FIRST_IRQ);
         vec->pending = 1;
     }
+    nvic_irq_live_update(s, irq);
 
     nvic_irq_update(s);
 
@@ -1783,6 +1830,7 @@ static void nvic_writel(NVICState *s, uint32_t offset, uint32_t value,
                 return;
             }
             cpu->env.pmsav8.rbar[attrs.secure][region] = value;
+            arm_mpu_cache_invalidate(cpu);
             tlb_flush(CPU(cpu));
             return;
         }
@@ -1808,6 +1856,7 @@ static void nvic_writel(NVICState *s, uint32_t offset, uint32_t value,
         }
 
         cpu->env.pmsav7.drbar[region] = value & ~0x1f;
+        arm_mpu_cache_invalidate(cpu);
         tlb_flush(CPU(cpu));
         break;
     }
@@ -1833,6 +1882,7 @@ static void nvic_writel(NVICState *s, uint32_t offset, uint32_t value,
                 return;
             }
             cpu->env.pmsav8.rlar[attrs.secure][region] = value;
+            arm_mpu_cache_invalidate(cpu);
             tlb_flush(CPU(cpu));
             return;
         }
@@ -1843,6 +1893,7 @@ static void nvic_writel(NVICState *s, uint32_t offset, uint32_t value,
 
         cpu->env.pmsav7.drsr[region] = value & 0xff3f;
         cpu->env.pmsav7.dracr[region] = (value >> 16) & 0x173f;
+        arm_mpu_cache_invalidate(cpu);
         tlb_flush(CPU(cpu));
         break;
     }
@@ -2262,6 +2313,7 @@ static MemTxResult nvic_sysreg_write(void *opaque, hwaddr addr,
             if (value & (1 << i) &&
                 (attrs.secure || s->itns[startvec + i])) {
                 s->vectors[startvec + i].enabled = setval;
+                nvic_irq_live_update(s, startvec + i);
             }
         }
         nvic_irq_update(s);
@@ -2280,6 +2332,7 @@ static MemTxResult nvic_sysreg_write(void *opaque, hwaddr addr,
             if (value & (1 << i) &&
                 (attrs.secure || s->itns[startvec + i])) {
                 s->vectors[startvec + i].pending = setval;
+                nvic_irq_live_update(s, startvec + i);
             }
         }
         nvic_irq_update(s);
@@ -2457,6 +2510,7 @@ static int nvic_post_load(void *opaque, int version_id)
         }
     }
 
+    nvic_irq_live_rebuild(s);
     nvic_recompute_state(s);
 
     return 0;
@@ -2550,6 +2604,7 @@ static void armv7m_nvic_reset(DeviceState *dev)
 
     memset(s->vectors, 0, sizeof(s->vectors));
     memset(s->sec_vectors, 0, sizeof(s->sec_vectors));
+    bitmap_zero(s->irq_live, NVIC_MAX_VECTORS);
     s->prigroup[M_REG_NS] = 0;
     s->prigroup[M_REG_S] = 0;
 
@@ -47,6 +47,7 @@ static const MemoryRegionOps unimp_ops = {
     .valid.min_access_size = 1,
     .valid.max_access_size = 8,
     .endianness = DEVICE_NATIVE_ENDIAN,
+    .lockless_read = true,
 };
 
 static void unimp_realize(DeviceState *dev, Error **errp)
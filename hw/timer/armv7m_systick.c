@@ -39,6 +39,51 @@ static inline int64_t systick_scale(SysTickState *s)
     }
 }
 
+/*
+ * We only run a host timer while SYST_CSR.TICKINT is set. With TICKINT
+ * clear a wrap has no effect beyond setting COUNTFLAG and reloading the
+ * counter, and both of those can be worked out from the current time
+ * when the guest next looks at the registers; so an RTOS which polls
+ * COUNTFLAG (or a halted CPU with SysTick still counting) doesn't cost
+ * a host timer callback on every wrap.
+ */
+static void systick_arm_timer(SysTickState *s)
+{
+    if ((s->control & (SYSTICK_ENABLE | SYSTICK_TICKINT)) ==
+        (SYSTICK_ENABLE | SYSTICK_TICKINT)) {
+        timer_mod(s->timer, s->tick);
+    } else {
+        timer_del(s->timer);
+    }
+}
+
+/*
+ * Account for any wraps which happened while the host timer was not
+ * running. Must be called before the register state is looked at or
+ * changed.
+ */
+static void systick_catch_up(SysTickState *s)
+{
+    int64_t now, period;
+
+    if ((s->control & SYSTICK_ENABLE) == 0 || timer_pending(s->timer)) {
+        return;
+    }
+
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    if (now < s->tick) {
+        return;
+    }
+
+    s->control |= SYSTICK_COUNTFLAG;
+    if (s->reload == 0) {
+        s->control &= ~SYSTICK_ENABLE;
+        return;
+    }
+    period = (s->reload + 1) * systick_scale(s);
+    s->tick += ((now - s->tick) / period + 1) * period;
+}
+
 static void systick_reload(SysTickState *s, int reset)
 {
     /* The Cortex-M3 Devices Generic User Guide says that "When the
@@ -56,7 +101,7 @@ static void systick_reload(SysTickState *s, int reset)
         s->tick = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
     }
     s->tick += (s->reload + 1) * systick_scale(s);
-    timer_mod(s->timer, s->tick);
+    systick_arm_timer(s);
 }
 
 static void systick_timer_tick(void *opaque)
@@ -88,6 +133,8 @@ static MemTxResult systick_read(void *opaque, hwaddr addr, uint64_t *data,
         return MEMTX_ERROR;
     }
 
+    systick_catch_up(s);
+
     switch (addr) {
     case 0x0: /* SysTick Control and Status.  */
         val = s->control;
@@ -146,6 +193,8 @@ static MemTxResult systick_write(void *opaque, hwaddr addr,
 
     trace_systick_write(addr, value, size);
 
+    systick_catch_up(s);
+
     switch (addr) {
     case 0x0: /* SysTick Control and Status.  */
     {
@@ -158,7 +207,7 @@ static MemTxResult systick_write(void *opaque, hwaddr addr,
             if (value & SYSTICK_ENABLE) {
                 if (s->tick) {
                     s->tick += now;
-                    timer_mod(s->timer, s->tick);
+                    systick_arm_timer(s);
                 } else {
                     systick_reload(s, 1);
                 }
@@ -173,6 +222,8 @@ static MemTxResult systick_write(void *opaque, hwaddr addr,
             /* This is a hack. Force the timer to be reloaded
                when the reference clock is changed.  */
             systick_reload(s, 1);
+        } else if ((oldval ^ value) & SYSTICK_TICKINT) {
+            systick_arm_timer(s);
         }
         break;
     }
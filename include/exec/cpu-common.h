@@ -101,6 +101,7 @@ typedef int (RAMBlockIterFunc)(RAMBlock *rb, void *opaque);
 
 int qemu_ram_foreach_block(RAMBlockIterFunc func, void *opaque);
 int ram_block_discard_range(RAMBlock *rb, uint64_t start, size_t length);
+void qemu_ram_block_advise(RAMBlock *rb, void *addr, size_t length);
 
 #endif
 
@@ -191,6 +191,20 @@ typedef struct CPUTLBDescFast {
     CPUTLBEntry *table;
 } CPUTLBDescFast QEMU_ALIGNED(2 * sizeof(void *));
 
+/*
+ * A range of virtual addresses to flush from a set of MMU modes, as
+ * queued by another vCPU.  Only the low @bits of the addresses are
+ * significant.
+ */
+typedef struct CPUTLBPendingFlush {
+    target_ulong addr;
+    target_ulong len;
+    uint16_t idxmap;
+    uint8_t bits;
+} CPUTLBPendingFlush;
+
+#define CPU_TLB_PENDING_FLUSHES 8
+
 /*
  * Data elements that are shared between all MMU modes.
  */
@@ -203,6 +217,15 @@ typedef struct CPUTLBCommon {
      * Protected by tlb_c.lock.
      */
     uint16_t dirty;
+    /*
+     * Range flushes queued by other vCPUs and not yet picked up by the
+     * owner, merged where they overlap.  When they do not fit, the MMU
+     * modes in pending_full are flushed entirely instead.
+     * Protected by tlb_c.lock.
+     */
+    CPUTLBPendingFlush pending[CPU_TLB_PENDING_FLUSHES];
+    unsigned n_pending;
+    uint16_t pending_full;
     /*
      * Statistics.  These are not lock protected, but are read and
      * written atomically.  This allows the monitor to print a snapshot
@@ -211,6 +234,9 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    size_t range_flush_count;
+    size_t range_fallback_count;
+    size_t coalesced_flush_count;
 } CPUTLBCommon;
 
 /*
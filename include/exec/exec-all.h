@@ -70,6 +70,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
                               target_ulong pc, target_ulong cs_base,
                               uint32_t flags,
                               int cflags);
+void tb_hot_retranslate(CPUState *cpu, TranslationBlock *tb,
+                        uintptr_t retaddr);
 
 void QEMU_NORETURN cpu_loop_exit(CPUState *cpu);
 void QEMU_NORETURN cpu_loop_exit_restore(CPUState *cpu, uintptr_t pc);
@@ -251,6 +253,52 @@ void tlb_flush_by_mmuidx_all_cpus(CPUState *cpu, uint16_t idxmap);
  * depend on when the guests translation ends the TB.
  */
 void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *cpu, uint16_t idxmap);
+/**
+ * tlb_flush_range_by_mmuidx:
+ * @cpu: CPU whose TLB should be flushed
+ * @addr: virtual address of the start of the range to be flushed
+ * @len: length of the range to be flushed
+ * @idxmap: bitmap of MMU indexes to flush
+ * @bits: number of significant bits in the addresses
+ *
+ * Flush all pages overlapping [@addr, @addr + @len) from the TLB of the
+ * specified CPU, for the specified MMU indexes.  Only the low @bits of
+ * the virtual addresses are compared, for targets that ignore the top
+ * byte of addresses.  Flushes that other vCPUs have not processed yet
+ * are merged, and large ranges may cause a full flush of the MMU index.
+ */
+void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
+                               target_ulong len, uint16_t idxmap,
+                               unsigned bits);
+/**
+ * tlb_flush_range_by_mmuidx_all_cpus:
+ * @cpu: Originating CPU of the flush
+ * @addr: virtual address of the start of the range to be flushed
+ * @len: length of the range to be flushed
+ * @idxmap: bitmap of MMU indexes to flush
+ * @bits: number of significant bits in the addresses
+ *
+ * Like tlb_flush_range_by_mmuidx, for the TLBs of all CPUs.
+ */
+void tlb_flush_range_by_mmuidx_all_cpus(CPUState *cpu, target_ulong addr,
+                                        target_ulong len, uint16_t idxmap,
+                                        unsigned bits);
+/**
+ * tlb_flush_range_by_mmuidx_all_cpus_synced:
+ * @cpu: Originating CPU of the flush
+ * @addr: virtual address of the start of the range to be flushed
+ * @len: length of the range to be flushed
+ * @idxmap: bitmap of MMU indexes to flush
+ * @bits: number of significant bits in the addresses
+ *
+ * Like tlb_flush_range_by_mmuidx_all_cpus except the source vCPUs work
+ * is scheduled as safe work, as for tlb_flush_by_mmuidx_all_cpus_synced.
+ */
+void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *cpu,
+                                               target_ulong addr,
+                                               target_ulong len,
+                                               uint16_t idxmap,
+                                               unsigned bits);
 /**
  * tlb_set_page_with_attrs:
  * @cpu: CPU to add this TLB entry for
@@ -337,6 +385,27 @@ static inline void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *cpu,
                                                        uint16_t idxmap)
 {
 }
+static inline void tlb_flush_range_by_mmuidx(CPUState *cpu,
+                                             target_ulong addr,
+                                             target_ulong len,
+                                             uint16_t idxmap,
+                                             unsigned bits)
+{
+}
+static inline void tlb_flush_range_by_mmuidx_all_cpus(CPUState *cpu,
+                                                      target_ulong addr,
+                                                      target_ulong len,
+                                                      uint16_t idxmap,
+                                                      unsigned bits)
+{
+}
+static inline void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *cpu,
+                                                             target_ulong addr,
+                                                             target_ulong len,
+                                                             uint16_t idxmap,
+                                                             unsigned bits)
+{
+}
 #endif
 /**
  * probe_access:
@@ -430,6 +499,8 @@ struct TranslationBlock {
 #define CF_USE_ICOUNT  0x00020000
 #define CF_INVALID     0x00040000 /* TB is stale. Set with @jmp_lock held */
 #define CF_PARALLEL    0x00080000 /* Generate code for a parallel context */
+#define CF_NOPERSIST   0x00100000 /* Code embeds host pointers, see tb-cache.c */
+#define CF_HOT         0x00200000 /* Retranslation of a hot loop */
 #define CF_CLUSTER_MASK 0xff000000 /* Top 8 bits are cluster ID */
 #define CF_CLUSTER_SHIFT 24
 /* cflags' mask for hashing/comparison */
@@ -439,6 +510,13 @@ struct TranslationBlock {
     /* Per-vCPU dynamic tracing state used to generate this TB */
     uint32_t trace_vcpu_dstate;
 
+    /*
+     * Remaining iterations of a loop closing on this TB before it is
+     * retranslated with CF_HOT, see translator_loop_count().
+     */
+    int32_t hot_countdown;
+#define TB_HOT_THRESHOLD 1024
+
     struct tb_tc tc;
 
     /* original tb when cflags has CF_NOCACHE */
@@ -560,6 +638,12 @@ void mmap_lock(void);
 void mmap_unlock(void);
 bool have_mmap_lock(void);
 
+/* Speculative translation, see accel/tcg/tb-prefetch.c */
+void tb_prefetch_init(unsigned int nthreads);
+void tb_prefetch_queue(CPUState *cpu, TranslationBlock *tb);
+void tb_prefetch_fork_start(void);
+void tb_prefetch_fork_end(int child);
+
 /**
  * get_page_addr_code() - user-mode version
  * @env: CPUArchState
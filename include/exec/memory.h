@@ -199,6 +199,15 @@ struct MemoryRegionOps {
          */
         bool unaligned;
     } impl;
+
+    /*
+     * If true, reads do not depend on the QEMU global lock and TCG calls
+     * the read callbacks without taking it, even if the region has
+     * global locking enabled.  Only suitable for devices whose reads
+     * have no side effects and only look at state that is updated
+     * atomically, e.g. status registers that guest software polls.
+     */
+    bool lockless_read;
 };
 
 typedef struct MemoryRegionClass {
@@ -375,6 +384,9 @@ struct MemoryRegion {
     bool global_locking;
     uint8_t dirty_log_mask;
     bool is_iommu;
+    /* Accesses that map to a single callback, see memory_region_set_ops */
+    uint8_t direct_read;
+    uint8_t direct_write;
     RAMBlock *ram_block;
     Object *owner;
 
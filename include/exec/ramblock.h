@@ -39,6 +39,13 @@ struct RAMBlock {
     QLIST_HEAD(, RAMBlockNotifier) ramblock_notifiers;
     int fd;
     size_t page_size;
+    /*
+     * Mapped privately from an in-memory snapshot (see ram_snapshot_save),
+     * so MADV_DONTNEED brings back the snapshot rather than zero pages.
+     */
+    bool snapshot_mapped;
+    /* Parts of it were discarded, and no longer map the snapshot */
+    bool snapshot_discarded;
     /* dirty bitmap used during migration */
     unsigned long *bmap;
     /* bitmap of already received pages in postcopy */
@@ -35,6 +35,7 @@ struct TBContext {
 
     /* statistics */
     unsigned tb_flush_count;
+    size_t tb_hot_count;
 };
 
 extern TBContext tb_ctx;
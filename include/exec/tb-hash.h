@@ -24,29 +24,40 @@
 #include "exec/exec-all.h"
 #include "qemu/xxhash.h"
 
+/*
+ * The jump cache hash functions return the index of the first entry of
+ * the set for a pc; the set's TB_JMP_CACHE_WAYS entries follow it.
+ */
+#define TB_JMP_SET_BITS (TB_JMP_CACHE_BITS - TB_JMP_CACHE_WAY_BITS)
+#define TB_JMP_SET_COUNT (1 << TB_JMP_SET_BITS)
+
 #ifdef CONFIG_SOFTMMU
 
-/* Only the bottom TB_JMP_PAGE_BITS of the jump cache hash bits vary for
+/* Only the bottom TB_JMP_PAGE_BITS of the jump cache set index vary for
    addresses on the same page.  The top bits are the same.  This allows
    TLB invalidation to quickly clear a subset of the hash table.  */
-#define TB_JMP_PAGE_BITS (TB_JMP_CACHE_BITS / 2)
+#define TB_JMP_PAGE_BITS (TB_JMP_SET_BITS / 2)
 #define TB_JMP_PAGE_SIZE (1 << TB_JMP_PAGE_BITS)
 #define TB_JMP_ADDR_MASK (TB_JMP_PAGE_SIZE - 1)
-#define TB_JMP_PAGE_MASK (TB_JMP_CACHE_SIZE - TB_JMP_PAGE_SIZE)
+#define TB_JMP_PAGE_MASK (TB_JMP_SET_COUNT - TB_JMP_PAGE_SIZE)
+
+/* Number of consecutive jump cache entries used by one guest page */
+#define TB_JMP_PAGE_ENTRIES (TB_JMP_PAGE_SIZE << TB_JMP_CACHE_WAY_BITS)
 
 static inline unsigned int tb_jmp_cache_hash_page(target_ulong pc)
 {
     target_ulong tmp;
     tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS));
-    return (tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK;
+    return ((tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK)
+        << TB_JMP_CACHE_WAY_BITS;
 }
 
 static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
 {
     target_ulong tmp;
     tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS));
-    return (((tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK)
-           | (tmp & TB_JMP_ADDR_MASK));
+    return ((((tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK)
+             | (tmp & TB_JMP_ADDR_MASK)) << TB_JMP_CACHE_WAY_BITS);
 }
 
 #else
@@ -54,7 +65,8 @@ static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
 /* In user-mode we can get better hashing because we do not have a TLB */
 static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
 {
-    return (pc ^ (pc >> TB_JMP_CACHE_BITS)) & (TB_JMP_CACHE_SIZE - 1);
+    return ((pc ^ (pc >> TB_JMP_SET_BITS)) & (TB_JMP_SET_COUNT - 1))
+        << TB_JMP_CACHE_WAY_BITS;
 }
 
 #endif /* CONFIG_SOFTMMU */
@@ -16,6 +16,34 @@
 #include "exec/exec-all.h"
 #include "exec/tb-hash.h"
 
+/*
+ * Make @tb the most recently used entry of the jump cache set starting
+ * at @hash, moving the entries in ways [0, @way) down by one. Anything
+ * previously in @way is dropped.
+ */
+static inline void tb_jmp_cache_set_mru(CPUState *cpu, uint32_t hash,
+                                        int way, TranslationBlock *tb)
+{
+    for (; way > 0; way--) {
+        atomic_set(&cpu->tb_jmp_cache[hash + way],
+                   atomic_read(&cpu->tb_jmp_cache[hash + way - 1]));
+    }
+    atomic_set(&cpu->tb_jmp_cache[hash], tb);
+}
+
+/* Insert a newly looked up or generated TB into the jump cache */
+static inline void tb_jmp_cache_insert(CPUState *cpu, uint32_t hash,
+                                       TranslationBlock *tb)
+{
+    int last = TB_JMP_CACHE_WAYS - 1;
+
+    if (atomic_read(&cpu->tb_jmp_cache[hash + last])) {
+        atomic_set(&cpu->tb_jmp_cache_evictions,
+                   cpu->tb_jmp_cache_evictions + 1);
+    }
+    tb_jmp_cache_set_mru(cpu, hash, last, tb);
+}
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *
 tb_lookup__cpu_state(CPUState *cpu, target_ulong *pc, target_ulong *cs_base,
@@ -24,27 +52,36 @@ tb_lookup__cpu_state(CPUState *cpu, target_ulong *pc, target_ulong *cs_base,
     CPUArchState *env = (CPUArchState *)cpu->env_ptr;
     TranslationBlock *tb;
     uint32_t hash;
+    int way;
 
     cpu_get_tb_cpu_state(env, pc, cs_base, flags);
     hash = tb_jmp_cache_hash_func(*pc);
-    tb = atomic_rcu_read(&cpu->tb_jmp_cache[hash]);
 
     cf_mask &= ~CF_CLUSTER_MASK;
     cf_mask |= cpu->cluster_index << CF_CLUSTER_SHIFT;
 
-    if (likely(tb &&
-               tb->pc == *pc &&
-               tb->cs_base == *cs_base &&
-               tb->flags == *flags &&
-               tb->trace_vcpu_dstate == *cpu->trace_dstate &&
-               (tb_cflags(tb) & (CF_HASH_MASK | CF_INVALID)) == cf_mask)) {
-        return tb;
+    for (way = 0; way < TB_JMP_CACHE_WAYS; way++) {
+        tb = atomic_rcu_read(&cpu->tb_jmp_cache[hash + way]);
+        if (likely(tb &&
+                   tb->pc == *pc &&
+                   tb->cs_base == *cs_base &&
+                   tb->flags == *flags &&
+                   tb->trace_vcpu_dstate == *cpu->trace_dstate &&
+                   (tb_cflags(tb) & (CF_HASH_MASK | CF_INVALID)) == cf_mask)) {
+            if (way) {
+                tb_jmp_cache_set_mru(cpu, hash, way, tb);
+            }
+            atomic_set(&cpu->tb_jmp_cache_hits, cpu->tb_jmp_cache_hits + 1);
+            return tb;
+        }
     }
+    atomic_set(&cpu->tb_jmp_cache_misses, cpu->tb_jmp_cache_misses + 1);
+
     tb = tb_htable_lookup(cpu, *pc, *cs_base, *flags, cf_mask);
     if (tb == NULL) {
         return NULL;
     }
-    atomic_set(&cpu->tb_jmp_cache[hash], tb);
+    tb_jmp_cache_insert(cpu, hash, tb);
     return tb;
 }
 
@@ -0,0 +1,80 @@
+/*
+ * Page ranges of virtual addresses flushed from the softmmu TLB
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef EXEC_TLB_RANGE_H
+#define EXEC_TLB_RANGE_H
+
+#include "qemu/bitops.h"
+
+/*
+ * The helpers below take the page size and the width of the address
+ * space as arguments, rather than using the TARGET_* macros, so that
+ * they can be unit tested.
+ */
+
+/**
+ * tlb_range_align:
+ * @addr: start of the range, replaced by the start of its first page
+ * @len: non-zero length of the range, replaced by the length of its pages
+ * @page_bits: log2 of the page size
+ * @addr_bits: width of the address space
+ *
+ * Page align [@addr, @addr + @len), which may wrap around the end of the
+ * address space.  Returns false, leaving @addr and @len untouched, if
+ * the range covers every page, because then its page aligned length
+ * does not fit in @addr_bits.
+ */
+static inline bool tlb_range_align(uint64_t *addr, uint64_t *len,
+                                   unsigned page_bits, unsigned addr_bits)
+{
+    uint64_t mask = MAKE_64BIT_MASK(0, addr_bits);
+    uint64_t page_size = 1ULL << page_bits;
+    uint64_t offset = *addr & (page_size - 1);
+
+    if (*len > ((mask - page_size + 1) - offset)) {
+        return false;
+    }
+    *addr -= offset;
+    *len = (offset + *len + page_size - 1) & -page_size;
+    return true;
+}
+
+/**
+ * tlb_range_merge:
+ * @to_addr: start of the range to extend
+ * @to_len: non-zero length of the range to extend
+ * @addr: start of the range to add
+ * @len: non-zero length of the range to add
+ * @addr_bits: width of the address space
+ *
+ * Extend [@to_addr, @to_addr + @to_len) to cover [@addr, @addr + @len)
+ * if the two ranges overlap or are adjacent.  Ranges that reach the end
+ * of the address space are not merged.  Returns whether @to_addr and
+ * @to_len were updated.
+ */
+static inline bool tlb_range_merge(uint64_t *to_addr, uint64_t *to_len,
+                                   uint64_t addr, uint64_t len,
+                                   unsigned addr_bits)
+{
+    uint64_t mask = MAKE_64BIT_MASK(0, addr_bits);
+    uint64_t to_end, end, start;
+
+    if (*to_len > mask - *to_addr || len > mask - addr) {
+        return false;
+    }
+    to_end = *to_addr + *to_len;
+    end = addr + len;
+    if (addr > to_end || *to_addr > end) {
+        return false;
+    }
+    start = MIN(*to_addr, addr);
+    *to_len = MAX(to_end, end) - start;
+    *to_addr = start;
+    return true;
+}
+
+#endif
@@ -63,6 +63,9 @@ typedef enum DisasJumpType {
  * @num_insns: Number of translated instructions (including current).
  * @max_insns: Maximum number of instructions to be translated in this TB.
  * @singlestep_enabled: "Hardware" single stepping enabled.
+ * @plugin_enabled: TCG plugin instrumentation is being generated.
+ * @loop_insns: Number of insns in the body of an unrolled loop.
+ * @loop_copies: Number of extra copies of the loop body translated so far.
  *
  * Architecture-agnostic disassembly context.
  */
@@ -74,6 +77,9 @@ typedef struct DisasContextBase {
     int num_insns;
     int max_insns;
     bool singlestep_enabled;
+    bool plugin_enabled;
+    int loop_insns;
+    int loop_copies;
 } DisasContextBase;
 
 /**
@@ -145,6 +151,57 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
 void translator_loop_temp_check(DisasContextBase *db);
 
+/**
+ * translator_loop_count:
+ * @db: Disassembly context.
+ * @dest: Target of a direct branch ending the current insn.
+ *
+ * To be called on the taken path of a loop back edge, in an insn with
+ * no side effect other than the branch. If @dest is the start of the
+ * TB, emit code counting the iterations of the loop; once it has run
+ * TB_HOT_THRESHOLD times the vCPU leaves the TB at the loop head, and
+ * the TB is retranslated with CF_HOT.
+ */
+void translator_loop_count(DisasContextBase *db, target_ulong dest);
+
+/**
+ * translator_loop_unroll:
+ * @db: Disassembly context.
+ * @dest: Target of a direct branch ending the current insn.
+ *
+ * Return true if @db is a CF_HOT translation of a loop closing on @dest
+ * and there is room for another copy of the loop body. The caller must
+ * then emit a side exit for the not taken path of the branch and
+ * continue translating at @dest instead of ending the TB.
+ */
+bool translator_loop_unroll(DisasContextBase *db, target_ulong dest);
+
+/**
+ * translator_loop_poll:
+ * @db: Disassembly context.
+ * @dest: Target of a direct branch ending the current insn.
+ *
+ * To be called on the taken path of a loop back edge, before any other
+ * code for it is emitted. If @dest is the start of the TB and the loop
+ * only loads, compares and branches, without feeding any register back
+ * into itself, every iteration will do the same until memory changes
+ * or an interrupt arrives: emit a call that lets time pass instead.
+ */
+void translator_loop_poll(DisasContextBase *db, target_ulong dest);
+
+/* Let polling loops sleep without icount, -accel tcg,poll-sleep=on */
+extern bool tcg_poll_sleep;
+
+/**
+ * translator_note_branch:
+ * @db: Disassembly context.
+ * @dest: Target of a direct branch out of the TB.
+ *
+ * Record @dest as a block that is likely to run soon, so that it can be
+ * translated ahead of time once the current TB is complete.
+ */
+void translator_note_branch(DisasContextBase *db, target_ulong dest);
+
 /*
  * Translator Load Functions
  *
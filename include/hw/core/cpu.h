@@ -278,8 +278,17 @@ struct kvm_run;
 
 struct hax_vcpu_state;
 
-#define TB_JMP_CACHE_BITS 12
+struct ReplayVCPU;
+
+/*
+ * The TB jump cache is set-associative: TB_JMP_CACHE_SIZE entries are
+ * grouped into sets of TB_JMP_CACHE_WAYS consecutive entries, with the
+ * most recently used TB of each set kept in its first entry.
+ */
+#define TB_JMP_CACHE_BITS 13
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
+#define TB_JMP_CACHE_WAY_BITS 1
+#define TB_JMP_CACHE_WAYS (1 << TB_JMP_CACHE_WAY_BITS)
 
 /* work queue */
 
@@ -351,6 +360,7 @@ struct qemu_work_item;
  *                        to @trace_dstate).
  * @trace_dstate: Dynamic tracing state of events for this vCPU (bitmask).
  * @plugin_mask: Plugin event bitmap. Modified only via async work.
+ * @plugin_sample_pending: A plugin sample is queued in @work_list.
  * @ignore_memory_transaction_failures: Cached copy of the MachineState
  *    flag of the same name: allows the board to suppress calling of the
  *    CPU do_transaction_failed hook function.
@@ -390,6 +400,9 @@ struct CPUState {
     int singlestep_enabled;
     int64_t icount_budget;
     int64_t icount_extra;
+    /* instructions executed by this vCPU, for record/replay with MTTCG */
+    int64_t icount_total;
+    int64_t icount_pending;
     uint64_t random_seed;
     sigjmp_buf jmp_env;
 
@@ -406,6 +419,13 @@ struct CPUState {
 
     /* Accessed in parallel; all accesses must be atomic */
     struct TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];
+    /*
+     * Jump cache statistics, for "info jit". Only written by the vCPU
+     * thread, but read by the monitor, so accesses must be atomic.
+     */
+    size_t tb_jmp_cache_hits;
+    size_t tb_jmp_cache_misses;
+    size_t tb_jmp_cache_evictions;
 
     struct GDBRegisterState *gdb_regs;
     int gdb_num_regs;
@@ -437,6 +457,7 @@ struct CPUState {
 
 #ifdef CONFIG_PLUGIN
     GArray *plugin_mem_cbs;
+    bool plugin_sample_pending;
     /* saved iotlb data from io_writex */
     SavedIOTLB saved_iotlb;
 #endif
@@ -460,6 +481,9 @@ struct CPUState {
 
     struct hax_vcpu_state *hax_vcpu;
 
+    /* Only used with record/replay and MTTCG */
+    struct ReplayVCPU *replay_vcpu;
+
     int hvf_fd;
 
     /* track IOMMUs whose translations we've cached in the TCG TLB */
@@ -13,6 +13,7 @@
 #include "target/arm/cpu.h"
 #include "hw/sysbus.h"
 #include "hw/timer/armv7m_systick.h"
+#include "qemu/bitmap.h"
 #include "qom/object.h"
 
 #define TYPE_NVIC "armv7m_nvic"
@@ -78,6 +79,11 @@ struct NVICState {
     bool vectpending_is_s_banked;
     int exception_prio; /* group prio of the highest prio active exception */
     int vectpending_prio; /* group prio of the exeception in vectpending */
+    /* External interrupts which are active, or both enabled and pending.
+     * Only these can affect the cached state above, so recomputing it
+     * need not look at the other external interrupts.
+     */
+    DECLARE_BITMAP(irq_live, NVIC_MAX_VECTORS);
 
     MemoryRegion sysregmem;
     MemoryRegion sysreg_ns_mem;
@@ -17,5 +17,7 @@
 
 int save_snapshot(const char *name, Error **errp);
 int load_snapshot(const char *name, Error **errp);
+int save_snapshot_mem(Error **errp);
+int load_snapshot_mem(Error **errp);
 
 #endif
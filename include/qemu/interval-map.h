@@ -0,0 +1,76 @@
+/*
+ * Sorted interval map
+ *
+ * Maps every 64-bit key to a 16-bit value, by splitting the key space
+ * into contiguous intervals. Only the start of each interval is stored,
+ * in a dense sorted array that is searched without branches, so that a
+ * lookup touches a handful of cache lines even for maps with hundreds
+ * of intervals. The map is built by appending intervals in ascending
+ * order; keys not covered by any of them map to a default value.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef QEMU_INTERVAL_MAP_H
+#define QEMU_INTERVAL_MAP_H
+
+typedef struct IntervalMap {
+    /* starts[0] is always 0, so that every key falls in an interval */
+    uint64_t *starts;
+    uint16_t *values;
+    unsigned nb;
+    unsigned nb_alloc;
+    uint16_t dflt;
+} IntervalMap;
+
+/**
+ * interval_map_init:
+ * @map: the map
+ * @dflt: value of the keys not covered by any interval
+ */
+void interval_map_init(IntervalMap *map, uint16_t dflt);
+
+void interval_map_destroy(IntervalMap *map);
+
+/**
+ * interval_map_append:
+ * @map: the map
+ * @start: first key of the interval
+ * @len: number of keys in the interval, 0 meaning up to 2^64 - 1
+ * @value: value to map the keys to
+ *
+ * The interval must start at or after the end of the previously
+ * appended one.
+ */
+void interval_map_append(IntervalMap *map, uint64_t start, uint64_t len,
+                         uint16_t value);
+
+/**
+ * interval_map_trim:
+ * @map: the map
+ *
+ * Release the memory reserved for further appends.
+ */
+void interval_map_trim(IntervalMap *map);
+
+static inline unsigned interval_map_find(const IntervalMap *map, uint64_t key)
+{
+    const uint64_t *base = map->starts;
+    unsigned n = map->nb;
+
+    while (n > 1) {
+        unsigned half = n / 2;
+
+        base = base[half] <= key ? base + half : base;
+        n -= half;
+    }
+    return base - map->starts;
+}
+
+static inline uint16_t interval_map_lookup(const IntervalMap *map,
+                                           uint64_t key)
+{
+    return map->values[interval_map_find(map, key)];
+}
+
+#endif /* QEMU_INTERVAL_MAP_H */
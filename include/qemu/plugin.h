@@ -22,6 +22,7 @@ enum qemu_plugin_event {
     QEMU_PLUGIN_EV_VCPU_TB_TRANS,
     QEMU_PLUGIN_EV_VCPU_IDLE,
     QEMU_PLUGIN_EV_VCPU_RESUME,
+    QEMU_PLUGIN_EV_VCPU_SAMPLE,
     QEMU_PLUGIN_EV_VCPU_SYSCALL,
     QEMU_PLUGIN_EV_VCPU_SYSCALL_RET,
     QEMU_PLUGIN_EV_FLUSH,
@@ -56,6 +57,7 @@ union qemu_plugin_cb_sig {
     qemu_plugin_vcpu_mem_cb_t        vcpu_mem;
     qemu_plugin_vcpu_syscall_cb_t    vcpu_syscall;
     qemu_plugin_vcpu_syscall_ret_cb_t vcpu_syscall_ret;
+    qemu_plugin_vcpu_sample_cb_t     vcpu_sample;
     void *generic;
 };
 
@@ -88,10 +90,29 @@ struct qemu_plugin_dyn_cb {
         struct {
             enum qemu_plugin_op op;
             uint64_t imm;
+            /* if @entry.score is set, @userp is unused */
+            qemu_plugin_u64 entry;
         } inline_insn;
+        /* regular insn/tb callbacks only */
+        struct {
+            enum qemu_plugin_cond cond;
+            uint64_t imm;
+            qemu_plugin_u64 entry;
+        } cond;
     };
 };
 
+/*
+ * The elements of all scoreboards are reallocated together when a vCPU
+ * beyond the current allocation is created. Generated code loads @data
+ * every time, so that only needs to be done while no vCPU is running.
+ */
+struct qemu_plugin_scoreboard {
+    void *data;
+    size_t element_size;
+    QLIST_ENTRY(qemu_plugin_scoreboard) entry;
+};
+
 struct qemu_plugin_insn {
     GByteArray *data;
     uint64_t vaddr;
@@ -52,7 +52,7 @@ typedef uint64_t qemu_plugin_id_t;
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 0
+#define QEMU_PLUGIN_VERSION 1
 
 typedef struct {
     /* string describing architecture */
@@ -180,6 +180,46 @@ void qemu_plugin_register_vcpu_idle_cb(qemu_plugin_id_t id,
 void qemu_plugin_register_vcpu_resume_cb(qemu_plugin_id_t id,
                                          qemu_plugin_vcpu_simple_cb_t cb);
 
+/**
+ * typedef qemu_plugin_vcpu_sample_cb_t - vCPU sample callback
+ * @id: the unique qemu_plugin_id_t
+ * @vcpu_index: the sampled vCPU
+ * @pc: guest virtual address of the next instruction, which is also
+ *      the start of the TB about to be executed
+ * @mmu_idx: the target specific MMU index the vCPU is running with,
+ *           telling e.g. kernel and user mode apart. Always -1 in
+ *           user-mode emulation.
+ * @userdata: the data passed at registration
+ */
+typedef void (*qemu_plugin_vcpu_sample_cb_t)(qemu_plugin_id_t id,
+                                             unsigned int vcpu_index,
+                                             uint64_t pc, int mmu_idx,
+                                             void *userdata);
+
+/**
+ * qemu_plugin_register_vcpu_sample_cb() - register a vCPU sampling callback
+ * @id: plugin ID
+ * @cb: callback function
+ * @period_ns: sampling period, in nanoseconds
+ * @userdata: any plugin data to pass to the @cb
+ *
+ * Every @period_ns, each running vCPU is interrupted at its next TB
+ * boundary and @cb is called from its thread. Nothing is added to the
+ * translated code, so this is much cheaper than counting TB executions
+ * when only a statistical profile is needed.
+ *
+ * In system emulation the period is measured on the virtual clock,
+ * which does not advance while the VM is stopped and, with -icount,
+ * follows the instruction count so that samples are deterministic. In
+ * user-mode emulation it is measured in host time.
+ *
+ * There is a single sampling period: if plugins ask for different
+ * ones, the shortest is used for all of them.
+ */
+void qemu_plugin_register_vcpu_sample_cb(qemu_plugin_id_t id,
+                                         qemu_plugin_vcpu_sample_cb_t cb,
+                                         uint64_t period_ns, void *userdata);
+
 /*
  * Opaque types that the plugin is given during the translation and
  * instrumentation phase.
@@ -187,6 +227,68 @@ void qemu_plugin_register_vcpu_resume_cb(qemu_plugin_id_t id,
 struct qemu_plugin_tb;
 struct qemu_plugin_insn;
 
+/**
+ * struct qemu_plugin_scoreboard - per-vCPU storage
+ *
+ * A scoreboard holds one element of a plugin defined size for each
+ * vCPU. Inline operations generated for a vCPU only ever touch that
+ * vCPU's element, so no locking or atomics are needed to update it.
+ * Elements are zeroed when allocated.
+ */
+struct qemu_plugin_scoreboard;
+
+/**
+ * typedef qemu_plugin_u64 - uint64_t member of a scoreboard element
+ * @score: the scoreboard
+ * @offset: offset of the uint64_t within each element
+ */
+typedef struct {
+    struct qemu_plugin_scoreboard *score;
+    size_t offset;
+} qemu_plugin_u64;
+
+/**
+ * qemu_plugin_scoreboard_new() - allocate a scoreboard
+ * @element_size: size of the per-vCPU element, in bytes
+ *
+ * Returns a scoreboard with room for every vCPU, present or future.
+ */
+struct qemu_plugin_scoreboard *qemu_plugin_scoreboard_new(size_t element_size);
+
+/**
+ * qemu_plugin_scoreboard_free() - free a scoreboard
+ * @score: the scoreboard
+ *
+ * No code using @score must be able to run anymore, i.e. this is only
+ * safe from an atexit callback or after a reset.
+ */
+void qemu_plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
+
+/**
+ * qemu_plugin_scoreboard_find() - get the element of a vCPU
+ * @score: the scoreboard
+ * @vcpu_index: the vCPU
+ *
+ * The pointer is only valid until the next vCPU is created, at which
+ * point the scoreboard may be reallocated.
+ */
+void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                                  unsigned int vcpu_index);
+
+/* Make a qemu_plugin_u64 for the whole element, or a field of it */
+#define qemu_plugin_scoreboard_u64(score) \
+    ((qemu_plugin_u64) { .score = (score), .offset = 0 })
+#define qemu_plugin_scoreboard_u64_in_struct(score, type, member) \
+    ((qemu_plugin_u64) { .score = (score), .offset = offsetof(type, member) })
+
+/* Access the value of @entry for one vCPU, or summed over all of them */
+void qemu_plugin_u64_add(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t added);
+uint64_t qemu_plugin_u64_get(qemu_plugin_u64 entry, unsigned int vcpu_index);
+void qemu_plugin_u64_set(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t val);
+uint64_t qemu_plugin_u64_sum(qemu_plugin_u64 entry);
+
 enum qemu_plugin_cb_flags {
     QEMU_PLUGIN_CB_NO_REGS, /* callback does not access the CPU's regs */
     QEMU_PLUGIN_CB_R_REGS,  /* callback reads the CPU's regs */
@@ -233,6 +335,22 @@ void qemu_plugin_register_vcpu_tb_exec_cb(struct qemu_plugin_tb *tb,
 
 enum qemu_plugin_op {
     QEMU_PLUGIN_INLINE_ADD_U64,
+    QEMU_PLUGIN_INLINE_STORE_U64,
+};
+
+/*
+ * Conditions for the *_cond_cb functions, comparing a scoreboard value
+ * against an immediate. Comparisons are unsigned.
+ */
+enum qemu_plugin_cond {
+    QEMU_PLUGIN_COND_NEVER,
+    QEMU_PLUGIN_COND_ALWAYS,
+    QEMU_PLUGIN_COND_EQ,
+    QEMU_PLUGIN_COND_NE,
+    QEMU_PLUGIN_COND_LT,
+    QEMU_PLUGIN_COND_LE,
+    QEMU_PLUGIN_COND_GT,
+    QEMU_PLUGIN_COND_GE,
 };
 
 /**
@@ -250,6 +368,43 @@ void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
                                               enum qemu_plugin_op op,
                                               void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu() - per-vCPU inline op
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: the scoreboard value to operate on
+ * @imm: the op data (e.g. 1)
+ *
+ * As qemu_plugin_register_vcpu_tb_exec_inline(), but operating on the
+ * executing vCPU's element of a scoreboard.
+ */
+void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+    struct qemu_plugin_tb *tb, enum qemu_plugin_op op,
+    qemu_plugin_u64 entry, uint64_t imm);
+
+/**
+ * qemu_plugin_register_vcpu_tb_exec_cond_cb() - conditional execution cb
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @cond: condition on the executing vCPU's value of @entry
+ * @entry: the scoreboard value to test
+ * @imm: the value @entry is compared with
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * As qemu_plugin_register_vcpu_tb_exec_cb(), but @cb is only called if
+ * "@entry @cond @imm" holds. The test is done inline, so combined with
+ * an inline op on the same @entry this lets plugins count cheaply and
+ * only call out when a threshold is reached. Inline ops on the same
+ * TB are executed before the test.
+ */
+void qemu_plugin_register_vcpu_tb_exec_cond_cb(struct qemu_plugin_tb *tb,
+                                               qemu_plugin_vcpu_udata_cb_t cb,
+                                               enum qemu_plugin_cb_flags flags,
+                                               enum qemu_plugin_cond cond,
+                                               qemu_plugin_u64 entry,
+                                               uint64_t imm, void *userdata);
+
 /**
  * qemu_plugin_register_vcpu_insn_exec_cb() - register insn execution cb
  * @insn: the opaque qemu_plugin_insn handle for an instruction
@@ -279,6 +434,37 @@ void qemu_plugin_register_vcpu_insn_exec_inline(struct qemu_plugin_insn *insn,
                                                 enum qemu_plugin_op op,
                                                 void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu() - per-vCPU inline op
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: the scoreboard value to operate on
+ * @imm: the op data (e.g. 1)
+ *
+ * As qemu_plugin_register_vcpu_insn_exec_inline(), but operating on the
+ * executing vCPU's element of a scoreboard.
+ */
+void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+    struct qemu_plugin_insn *insn, enum qemu_plugin_op op,
+    qemu_plugin_u64 entry, uint64_t imm);
+
+/**
+ * qemu_plugin_register_vcpu_insn_exec_cond_cb() - conditional insn cb
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @cond: condition on the executing vCPU's value of @entry
+ * @entry: the scoreboard value to test
+ * @imm: the value @entry is compared with
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * See qemu_plugin_register_vcpu_tb_exec_cond_cb().
+ */
+void qemu_plugin_register_vcpu_insn_exec_cond_cb(
+    struct qemu_plugin_insn *insn, qemu_plugin_vcpu_udata_cb_t cb,
+    enum qemu_plugin_cb_flags flags, enum qemu_plugin_cond cond,
+    qemu_plugin_u64 entry, uint64_t imm, void *userdata);
+
 /*
  * Helpers to query information about the instructions in a block
  */
@@ -351,6 +537,103 @@ void qemu_plugin_register_vcpu_mem_inline(struct qemu_plugin_insn *insn,
                                           enum qemu_plugin_op op, void *ptr,
                                           uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_mem_inline_per_vcpu() - per-vCPU inline op
+ * @insn: handle for instruction to instrument
+ * @rw: apply to reads, writes or both
+ * @op: the op, of type qemu_plugin_op
+ * @entry: the scoreboard value to operate on
+ * @imm: immediate data for @op
+ *
+ * As qemu_plugin_register_vcpu_mem_inline(), but operating on the
+ * executing vCPU's element of a scoreboard.
+ */
+void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+    struct qemu_plugin_insn *insn, enum qemu_plugin_mem_rw rw,
+    enum qemu_plugin_op op, qemu_plugin_u64 entry, uint64_t imm);
+
+/**
+ * struct qemu_plugin_mem_trace - bulk memory access trace
+ *
+ * Rather than calling into the plugin on every access, a memory trace
+ * appends a record for each access to a ring buffer owned by the
+ * executing vCPU, and the plugin drains the rings in batches from a
+ * thread of its own. The vCPU side takes no lock; when a ring is full,
+ * records are dropped and counted rather than stalling the vCPU.
+ *
+ * Only one thread at a time may drain a given trace.
+ */
+struct qemu_plugin_mem_trace;
+
+/**
+ * typedef qemu_plugin_mem_record - one traced access
+ * @vaddr: virtual address of the access
+ * @pc: virtual address of the instruction making the access
+ * @info: as for memory callbacks. Only the qemu_plugin_mem_* queries
+ *        that decode @info can be used on it, since the vCPU has moved
+ *        on by the time it is drained.
+ */
+typedef struct {
+    uint64_t vaddr;
+    uint64_t pc;
+    qemu_plugin_meminfo_t info;
+} qemu_plugin_mem_record;
+
+/**
+ * qemu_plugin_mem_trace_new() - allocate a memory trace
+ * @n_records: capacity of each vCPU's ring, rounded up to a power of 2
+ */
+struct qemu_plugin_mem_trace *qemu_plugin_mem_trace_new(size_t n_records);
+
+/**
+ * qemu_plugin_mem_trace_free() - free a memory trace
+ * @trace: the trace
+ *
+ * As for scoreboards, no code appending to @trace may run anymore.
+ */
+void qemu_plugin_mem_trace_free(struct qemu_plugin_mem_trace *trace);
+
+/**
+ * qemu_plugin_register_vcpu_mem_trace() - trace an instruction's accesses
+ * @insn: handle for instruction to instrument
+ * @rw: trace reads, writes or both
+ * @trace: the trace to append to
+ */
+void qemu_plugin_register_vcpu_mem_trace(struct qemu_plugin_insn *insn,
+                                         enum qemu_plugin_mem_rw rw,
+                                         struct qemu_plugin_mem_trace *trace);
+
+/**
+ * typedef qemu_plugin_mem_trace_cb_t - consumer of traced accesses
+ * @vcpu_index: the vCPU that made the accesses
+ * @records: the records, oldest first
+ * @n: number of records
+ * @userdata: as passed to qemu_plugin_mem_trace_drain()
+ *
+ * @records are only valid until the callback returns.
+ */
+typedef void (*qemu_plugin_mem_trace_cb_t)(unsigned int vcpu_index,
+                                           const qemu_plugin_mem_record *records,
+                                           size_t n, void *userdata);
+
+/**
+ * qemu_plugin_mem_trace_drain() - consume the pending records
+ * @trace: the trace
+ * @cb: called on each batch of records, in order for each vCPU
+ * @userdata: passed to @cb
+ *
+ * Returns the number of records consumed.
+ */
+size_t qemu_plugin_mem_trace_drain(struct qemu_plugin_mem_trace *trace,
+                                   qemu_plugin_mem_trace_cb_t cb,
+                                   void *userdata);
+
+/**
+ * qemu_plugin_mem_trace_dropped() - count of records lost to full rings
+ * @trace: the trace
+ */
+uint64_t qemu_plugin_mem_trace_dropped(struct qemu_plugin_mem_trace *trace);
+
 
 
 typedef void
@@ -22,6 +22,12 @@ void dump_drift_info(void);
 
 /* Unblock cpu */
 void qemu_cpu_kick_self(void);
+/* Wait until the VM is resumed, for a vCPU waiting for its replay turn */
+void qemu_cpu_replay_park(CPUState *cpu);
+/* Sleep up to @ms in a polling loop of the guest, see HELPER(tb_poll) */
+void qemu_cpu_poll_sleep(CPUState *cpu, int ms);
+/* Wake the vCPU sleeping in qemu_cpu_poll_sleep, e.g. after a RAM write */
+void qemu_cpu_poll_wake(void);
 void qemu_timer_notify_cb(void *opaque, QEMUClockType type);
 
 void cpu_synchronize_all_states(void);
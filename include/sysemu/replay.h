@@ -62,6 +62,60 @@ extern char *replay_snapshot;
 void replay_mutex_lock(void);
 void replay_mutex_unlock(void);
 
+/* Multi-threaded TCG
+ *
+ * With one thread per vCPU, the replay_lock is taken by the vCPU threads
+ * at their ordering points only: BQL acquisitions, guest atomics and
+ * virtual clock reads, interrupt checks and returns from cpu_exec.
+ * The order of the turns goes to the log, and the instruction count of
+ * the vCPU at each of its turns goes to a log of its own.  The replay
+ * grants the turns in the same order, and stops each vCPU at its next
+ * ordering point.
+ */
+
+/* Ordering points of a vCPU.  Any change needs to bump REPLAY_VERSION */
+enum ReplaySyncKind {
+    /* BQL, guest atomic or clock read; always taken */
+    REPLAY_SYNC_LOCK,
+    /* return from cpu_exec */
+    REPLAY_SYNC_EXIT,
+    /* pending interrupt request */
+    REPLAY_SYNC_INTERRUPT,
+    /* interrupt poll of a halted vCPU */
+    REPLAY_SYNC_HALT_POLL,
+    /* wakeup of an idle vCPU */
+    REPLAY_SYNC_IDLE,
+    REPLAY_SYNC_COUNT
+};
+typedef enum ReplaySyncKind ReplaySyncKind;
+
+/*! True when recording or replaying with multi-threaded TCG */
+extern bool replay_mttcg;
+
+/*! Takes the turn of the vCPU for a deterministic ordering point, until
+    replay_vcpu_sync_end.  Returns false if the vCPU already has it. */
+bool replay_vcpu_sync_begin(CPUState *cpu, ReplaySyncKind kind);
+/*! Gives the turn of the vCPU back. */
+void replay_vcpu_sync_end(CPUState *cpu);
+/*! Called at an asynchronous ordering point, with @pending true if the
+    vCPU would stop there.  Returns true if it stops there, in which case
+    it holds its turn until it releases the BQL. */
+bool replay_vcpu_sync_poll(CPUState *cpu, ReplaySyncKind kind, bool pending);
+/*! Called by the vCPU thread when it releases the BQL. */
+void replay_vcpu_sync_iothread_unlocked(CPUState *cpu);
+/*! Returns true if the vCPU holds its turn. */
+bool replay_vcpu_in_sync(CPUState *cpu);
+/*! Returns true if the next ordering point of the vCPU in the log
+    is @kind, at its current instruction count. */
+bool replay_vcpu_sync_pending(CPUState *cpu, ReplaySyncKind kind);
+/*! Returns number of instructions the vCPU executes before its next
+    ordering point in replay mode. */
+int64_t replay_vcpu_get_instructions(CPUState *cpu);
+
+#define replay_vcpu_poll(cpu, kind, pending)                    \
+    (unlikely(replay_mttcg)                                     \
+     ? replay_vcpu_sync_poll((cpu), (kind), (pending)) : (pending))
+
 /* Replay process control functions */
 
 /*! Enables recording or saving event log with specified parameters */
@@ -202,5 +256,11 @@ void replay_vmstate_init(void);
 /*! Called to ensure that replay state is consistent and VM snapshot
     can be created */
 bool replay_can_snapshot(void);
+/*! Called after saving a VM snapshot, adds it to the index
+    of the log when recording */
+void replay_snapshot_saved(const char *name);
+/*! Loads the last snapshot in the index of the log taken at or before
+    the specified instruction in replay mode */
+void replay_seek(int64_t icount, Error **errp);
 
 #endif
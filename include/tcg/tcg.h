@@ -600,6 +600,7 @@ struct TCGContext {
 
     TCGRegSet reserved_regs;
     uint32_t tb_cflags; /* cflags of the current TB */
+    bool host_ptr_const; /* the current TB embeds a host pointer */
     intptr_t current_frame_offset;
     intptr_t frame_start;
     intptr_t frame_end;
@@ -675,6 +676,10 @@ struct TCGContext {
 
     uint16_t gen_insn_end_off[TCG_MAX_INSNS];
     target_ulong gen_insn_data[TCG_MAX_INSNS][TARGET_INSN_START_WORDS];
+
+    /* Direct branch targets of the current TB, see translator_note_branch */
+    int nb_branch_dest;
+    target_ulong branch_dest[2];
 };
 
 extern TCGContext tcg_init_ctx;
@@ -1057,12 +1062,26 @@ TCGv_vec tcg_const_ones_vec(TCGType);
 TCGv_vec tcg_const_zeros_vec_matching(TCGv_vec);
 TCGv_vec tcg_const_ones_vec_matching(TCGv_vec);
 
+/*
+ * Host pointers are only meaningful to the current process, so TBs that
+ * embed one in their code must not be saved to the persistent TB cache.
+ */
+static inline intptr_t tcg_host_ptr(intptr_t ptr)
+{
+    tcg_ctx->host_ptr_const = true;
+    return ptr;
+}
+
 #if UINTPTR_MAX == UINT32_MAX
-# define tcg_const_ptr(x)        ((TCGv_ptr)tcg_const_i32((intptr_t)(x)))
-# define tcg_const_local_ptr(x)  ((TCGv_ptr)tcg_const_local_i32((intptr_t)(x)))
+# define tcg_const_ptr(x) \
+    ((TCGv_ptr)tcg_const_i32(tcg_host_ptr((intptr_t)(x))))
+# define tcg_const_local_ptr(x) \
+    ((TCGv_ptr)tcg_const_local_i32(tcg_host_ptr((intptr_t)(x))))
 #else
-# define tcg_const_ptr(x)        ((TCGv_ptr)tcg_const_i64((intptr_t)(x)))
-# define tcg_const_local_ptr(x)  ((TCGv_ptr)tcg_const_local_i64((intptr_t)(x)))
+# define tcg_const_ptr(x) \
+    ((TCGv_ptr)tcg_const_i64(tcg_host_ptr((intptr_t)(x))))
+# define tcg_const_local_ptr(x) \
+    ((TCGv_ptr)tcg_const_local_i64(tcg_host_ptr((intptr_t)(x))))
 #endif
 
 TCGLabel *gen_new_label(void);
@@ -47,6 +47,7 @@
 #include "target_elf.h"
 #include "cpu_loop-common.h"
 #include "crypto/init.h"
+#include "accel/tcg/perf.h"
 
 char *exec_path;
 
@@ -128,12 +129,14 @@ void fork_start(void)
 {
     start_exclusive();
     mmap_fork_start();
+    tb_prefetch_fork_start();
     cpu_list_lock();
 }
 
 void fork_end(int child)
 {
     mmap_fork_end(child);
+    tb_prefetch_fork_end(child);
     if (child) {
         CPUState *cpu, *next_cpu;
         /* Child processes created by fork() only have a single thread.
@@ -379,6 +382,22 @@ static void handle_arg_strace(const char *arg)
     enable_strace = true;
 }
 
+static void handle_arg_perfmap(const char *arg)
+{
+    perf_enable_perfmap();
+}
+
+static void handle_arg_jitdump(const char *arg)
+{
+    perf_enable_jitdump();
+}
+
+static unsigned int translate_threads;
+static void handle_arg_translate_threads(const char *arg)
+{
+    translate_threads = atoi(arg);
+}
+
 static void handle_arg_version(const char *arg)
 {
     printf("qemu-" TARGET_NAME " version " QEMU_FULL_VERSION
@@ -456,6 +475,13 @@ static const struct qemu_argument arg_table[] = {
      "",           "run in singlestep mode"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
+    {"perfmap",    "QEMU_PERFMAP",     false, handle_arg_perfmap,
+     "",           "Generate a /tmp/perf-${pid}.map file for perf"},
+    {"jitdump",    "QEMU_JITDUMP",     false, handle_arg_jitdump,
+     "",           "Generate a /tmp/jit-${pid}.dump file for perf"},
+    {"translate-threads", "QEMU_TRANSLATE_THREADS", true,
+     handle_arg_translate_threads,
+     "n",          "translate branch targets ahead of time in 'n' threads"},
     {"seed",       "QEMU_RAND_SEED",   true,  handle_arg_seed,
      "",           "Seed for pseudo-random number generator"},
     {"trace",      "QEMU_TRACE",       true,  handle_arg_trace,
@@ -849,6 +875,7 @@ int main(int argc, char **argv, char **envp)
        the real value of GUEST_BASE into account.  */
     tcg_prologue_init(tcg_ctx);
     tcg_region_init();
+    tb_prefetch_init(translate_threads);
 
     target_cpu_copy_regs(env, regs);
 
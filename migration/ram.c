@@ -56,6 +56,9 @@
 #include "savevm.h"
 #include "qemu/iov.h"
 #include "multifd.h"
+#include "qemu/memfd.h"
+#include "sysemu/tcg.h"
+#include "exec/exec-all.h"
 
 /***********************************************************/
 /* ram save/restore */
@@ -3783,6 +3786,313 @@ static int ram_resume_prepare(MigrationState *s, void *opaque)
     return 0;
 }
 
+/*
+ * In-memory snapshots
+ *
+ * The RAM is copied once to a memfd, which is then mapped privately
+ * over each RAM block, so that the guest from then on writes to
+ * copy-on-write pages.  Going back to the snapshot only needs to drop
+ * these pages: the next access faults the snapshot contents back in from
+ * the page cache, without copying anything.
+ */
+typedef struct RAMSnapshotBlock {
+    RAMBlock *rb;
+    uint8_t *host;
+    ram_addr_t used_length;
+    ram_addr_t max_length;
+    off_t offset;
+} RAMSnapshotBlock;
+
+static struct {
+    int fd;
+    unsigned int nb_blocks;
+    RAMSnapshotBlock *blocks;
+} ram_snapshot = {
+    .fd = -1,
+};
+
+#ifdef CONFIG_LINUX
+static void ram_snapshot_drop(void)
+{
+    if (ram_snapshot.fd >= 0) {
+        close(ram_snapshot.fd);
+    }
+    g_free(ram_snapshot.blocks);
+    ram_snapshot.fd = -1;
+    ram_snapshot.nb_blocks = 0;
+    ram_snapshot.blocks = NULL;
+}
+
+static int ram_snapshot_copy_block(int fd, RAMSnapshotBlock *b)
+{
+    size_t pagesize = qemu_host_page_size;
+    ram_addr_t start = 0, end;
+
+    /* The memfd starts out as a hole, only write the non-zero pages */
+    while (start < b->used_length) {
+        if (buffer_is_zero(b->host + start, pagesize)) {
+            start += pagesize;
+            continue;
+        }
+        end = start + pagesize;
+        while (end < b->used_length && !buffer_is_zero(b->host + end,
+                                                        pagesize)) {
+            end += pagesize;
+        }
+        while (start < end) {
+            ssize_t len = pwrite(fd, b->host + start, end - start,
+                                 b->offset + start);
+            if (len < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -errno;
+            }
+            start += len;
+        }
+    }
+    return 0;
+}
+
+/*
+ * ram_snapshot_save: take an in-memory snapshot of the RAM
+ *
+ * Replaces the previous snapshot, if any.  Must be called with the VM
+ * stopped and the iothread lock held.
+ */
+int ram_snapshot_save(Error **errp)
+{
+    RAMSnapshotBlock *blocks;
+    unsigned int nb_blocks = 0, i;
+    off_t size = 0;
+    RAMBlock *rb;
+    int fd, ret;
+
+    RCU_READ_LOCK_GUARD();
+
+    RAMBLOCK_FOREACH_MIGRATABLE(rb) {
+        if (rb->fd >= 0 || qemu_ram_is_shared(rb)) {
+            error_setg(errp, "RAM block '%s' is not private anonymous memory",
+                       rb->idstr);
+            return -ENOTSUP;
+        }
+        nb_blocks++;
+    }
+
+    blocks = g_new0(RAMSnapshotBlock, nb_blocks);
+    i = 0;
+    RAMBLOCK_FOREACH_MIGRATABLE(rb) {
+        blocks[i].rb = rb;
+        blocks[i].host = rb->host;
+        blocks[i].used_length = rb->used_length;
+        blocks[i].max_length = rb->max_length;
+        blocks[i].offset = size;
+        size += rb->max_length;
+        i++;
+    }
+
+    fd = qemu_memfd_create("ram-snapshot", size, false, 0, 0, errp);
+    if (fd < 0) {
+        g_free(blocks);
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < nb_blocks; i++) {
+        ret = ram_snapshot_copy_block(fd, &blocks[i]);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Could not copy RAM block '%s'",
+                             blocks[i].rb->idstr);
+            close(fd);
+            g_free(blocks);
+            return ret;
+        }
+    }
+
+    /*
+     * Past this point the old contents of the RAM blocks are gone.  If a
+     * mapping fails the RAM is still intact, since the memfd holds the
+     * same contents, but the snapshot cannot be used.
+     */
+    for (i = 0; i < nb_blocks; i++) {
+        RAMSnapshotBlock *b = &blocks[i];
+
+        if (mmap(b->host, b->max_length, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_FIXED, fd, b->offset) == MAP_FAILED) {
+            ret = -errno;
+            error_setg_errno(errp, -ret,
+                             "Could not map snapshot of RAM block '%s'",
+                             b->rb->idstr);
+            close(fd);
+            g_free(blocks);
+            ram_snapshot_drop();
+            return ret;
+        }
+        qemu_ram_block_advise(b->rb, b->host, b->max_length);
+        b->rb->snapshot_mapped = true;
+        b->rb->snapshot_discarded = false;
+    }
+
+    ram_snapshot_drop();
+    ram_snapshot.fd = fd;
+    ram_snapshot.nb_blocks = nb_blocks;
+    ram_snapshot.blocks = blocks;
+    trace_ram_snapshot_save(nb_blocks, size);
+    return 0;
+}
+
+#ifdef CONFIG_TCG
+#define PAGEMAP_PRESENT (1ULL << 63)
+#define PAGEMAP_SWAPPED (1ULL << 62)
+#define PAGEMAP_FILE    (1ULL << 61)
+
+/*
+ * Invalidates the TBs of the pages of @b that the guest wrote since the
+ * snapshot, before they go back to their snapshot contents.  Only the
+ * pages holding TBs matter, i.e. those whose DIRTY_MEMORY_CODE bit is
+ * clean; they were written if they are private anonymous copies, which
+ * /proc/self/pagemap tells apart from the page cache of the memfd.
+ *
+ * Returns false if the pages cannot be told apart and TCG must drop all
+ * of its TBs instead.
+ */
+static bool ram_snapshot_invalidate_code(RAMSnapshotBlock *b)
+{
+    static int pagemap_fd = -1;
+    uintptr_t host_page, last_host_page = UINTPTR_MAX;
+    uint64_t entry = 0;
+    ram_addr_t addr;
+
+    if (b->rb->snapshot_discarded) {
+        return false;
+    }
+    if (pagemap_fd < 0) {
+        pagemap_fd = open("/proc/self/pagemap", O_RDONLY);
+        if (pagemap_fd < 0) {
+            return false;
+        }
+    }
+
+    for (addr = 0; addr < b->used_length; addr += TARGET_PAGE_SIZE) {
+        ram_addr_t start = b->rb->offset + addr;
+
+        if (cpu_physical_memory_get_dirty(start, TARGET_PAGE_SIZE,
+                                          DIRTY_MEMORY_CODE)) {
+            continue;
+        }
+        host_page = (uintptr_t)(b->host + addr) / qemu_real_host_page_size;
+        if (host_page != last_host_page) {
+            if (pread(pagemap_fd, &entry, sizeof(entry),
+                      host_page * sizeof(entry)) != sizeof(entry)) {
+                return false;
+            }
+            last_host_page = host_page;
+        }
+        if ((entry & PAGEMAP_SWAPPED) ||
+            ((entry & PAGEMAP_PRESENT) && !(entry & PAGEMAP_FILE))) {
+            tb_invalidate_phys_range(start, start + TARGET_PAGE_SIZE);
+        }
+    }
+    return true;
+}
+#endif
+
+/*
+ * ram_snapshot_load: revert the RAM to the last in-memory snapshot
+ *
+ * Must be called with the VM stopped and the iothread lock held.
+ */
+int ram_snapshot_load(Error **errp)
+{
+    bool flush = false;
+    RAMBlock *rb;
+    unsigned int i = 0;
+
+    if (ram_snapshot.fd < 0) {
+        error_setg(errp, "No in-memory snapshot of the RAM");
+        return -ENOENT;
+    }
+
+    RCU_READ_LOCK_GUARD();
+
+    RAMBLOCK_FOREACH_MIGRATABLE(rb) {
+        RAMSnapshotBlock *b = &ram_snapshot.blocks[i];
+
+        if (i == ram_snapshot.nb_blocks || b->rb != rb ||
+            b->host != rb->host || b->used_length != rb->used_length ||
+            b->max_length != rb->max_length) {
+            break;
+        }
+        i++;
+    }
+    if (rb || i != ram_snapshot.nb_blocks) {
+        error_setg(errp, "RAM blocks changed since the snapshot was taken");
+        return -EINVAL;
+    }
+
+    for (i = 0; i < ram_snapshot.nb_blocks; i++) {
+        RAMSnapshotBlock *b = &ram_snapshot.blocks[i];
+
+#ifdef CONFIG_TCG
+        if (tcg_enabled() && !flush) {
+            flush = !ram_snapshot_invalidate_code(b);
+        }
+#endif
+
+        if (b->rb->snapshot_discarded) {
+            /* Discarded ranges map zero pages, map the snapshot again */
+            if (mmap(b->host, b->max_length, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_FIXED, ram_snapshot.fd,
+                     b->offset) == MAP_FAILED) {
+                error_setg_errno(errp, errno,
+                                 "Could not map snapshot of RAM block '%s'",
+                                 b->rb->idstr);
+                return -errno;
+            }
+            qemu_ram_block_advise(b->rb, b->host, b->max_length);
+            b->rb->snapshot_discarded = false;
+        } else if (qemu_madvise(b->host, b->used_length,
+                                QEMU_MADV_DONTNEED) < 0) {
+            /* Drops the private copies of the pages written since the save */
+            error_setg_errno(errp, errno, "Could not revert RAM block '%s'",
+                             b->rb->idstr);
+            return -errno;
+        }
+        /* The pages holding TBs that are still valid stay write-protected */
+        cpu_physical_memory_set_dirty_range(b->rb->offset, b->used_length,
+                                            DIRTY_CLIENTS_NOCODE);
+    }
+
+#ifdef CONFIG_TCG
+    if (tcg_enabled()) {
+        CPUState *cpu;
+
+        if (flush) {
+            tb_flush(first_cpu);
+        }
+        /* The page tables changed behind TCG's back */
+        CPU_FOREACH(cpu) {
+            tlb_flush(cpu);
+        }
+    }
+#endif
+
+    trace_ram_snapshot_load(ram_snapshot.nb_blocks, flush);
+    return 0;
+}
+#else
+int ram_snapshot_save(Error **errp)
+{
+    error_setg(errp, "In-memory snapshots are not supported on this host");
+    return -ENOTSUP;
+}
+
+int ram_snapshot_load(Error **errp)
+{
+    error_setg(errp, "No in-memory snapshot of the RAM");
+    return -ENOENT;
+}
+#endif
+
 static SaveVMHandlers savevm_ram_handlers = {
     .save_setup = ram_save_setup,
     .save_live_iterate = ram_save_iterate,
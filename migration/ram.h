@@ -63,6 +63,9 @@ int64_t ramblock_recv_bitmap_send(QEMUFile *file,
                                   const char *block_name);
 int ram_dirty_bitmap_reload(MigrationState *s, RAMBlock *rb);
 
+int ram_snapshot_save(Error **errp);
+int ram_snapshot_load(Error **errp);
+
 /* ram cache */
 int colo_init_ram_cache(void);
 void colo_flush_ram_cache(void);
@@ -2770,6 +2770,7 @@ int save_snapshot(const char *name, Error **errp)
         goto the_end;
     }
 
+    replay_snapshot_saved(sn->name);
     ret = 0;
 
  the_end:
@@ -2954,6 +2955,144 @@ err_drain:
     return ret;
 }
 
+/* Device state of the in-memory snapshot, the RAM is kept by ram.c */
+static uint8_t *mem_snapshot_state;
+static size_t mem_snapshot_state_size;
+
+int save_snapshot_mem(Error **errp)
+{
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    uint8_t *state = NULL;
+    size_t state_size = 0;
+    int saved_vm_running;
+    int ret;
+
+    if (migration_is_blocked(errp)) {
+        return -EINVAL;
+    }
+
+    if (!replay_can_snapshot()) {
+        error_setg(errp, "Record/replay does not allow making snapshot "
+                   "right now. Try once more later.");
+        return -EINVAL;
+    }
+
+    if (xen_enabled()) {
+        error_setg(errp, "In-memory snapshots are not supported with Xen");
+        return -ENOTSUP;
+    }
+
+    saved_vm_running = runstate_is_running();
+
+    ret = global_state_store();
+    if (ret) {
+        error_setg(errp, "Error saving global state");
+        return ret;
+    }
+    vm_stop(RUN_STATE_SAVE_VM);
+
+    bioc = qio_channel_buffer_new(4096);
+    qio_channel_set_name(QIO_CHANNEL(bioc), "migration-mem-snapshot");
+    f = qemu_fopen_channel_output(QIO_CHANNEL(bioc));
+    ret = qemu_save_device_state(f);
+    qemu_fflush(f);
+    if (ret == 0) {
+        ret = qemu_file_get_error(f);
+    }
+    if (ret == 0) {
+        /* Closing the channel frees its buffer */
+        state = g_memdup(bioc->data, bioc->usage);
+        state_size = bioc->usage;
+    }
+    qemu_fclose(f);
+    object_unref(OBJECT(bioc));
+    if (ret < 0) {
+        error_setg(errp, "Error %d while writing VM state", ret);
+        goto the_end;
+    }
+
+    ret = ram_snapshot_save(errp);
+    if (ret < 0) {
+        g_free(state);
+        goto the_end;
+    }
+
+    g_free(mem_snapshot_state);
+    mem_snapshot_state = state;
+    mem_snapshot_state_size = state_size;
+
+ the_end:
+    if (saved_vm_running) {
+        vm_start();
+    }
+    return ret;
+}
+
+/* Must be called with the VM stopped */
+int load_snapshot_mem(Error **errp)
+{
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    int ret;
+
+    if (!mem_snapshot_state) {
+        error_setg(errp, "No in-memory snapshot");
+        return -ENOENT;
+    }
+
+    if (!replay_can_snapshot()) {
+        error_setg(errp, "Record/replay does not allow loading snapshot "
+                   "right now. Try once more later.");
+        return -EINVAL;
+    }
+
+    ret = ram_snapshot_load(errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    bioc = qio_channel_buffer_new(mem_snapshot_state_size);
+    qio_channel_set_name(QIO_CHANNEL(bioc), "migration-mem-snapshot");
+    qio_channel_write_all(QIO_CHANNEL(bioc), (char *)mem_snapshot_state,
+                          mem_snapshot_state_size, &error_abort);
+    qio_channel_io_seek(QIO_CHANNEL(bioc), 0, SEEK_SET, &error_abort);
+    f = qemu_fopen_channel_input(QIO_CHANNEL(bioc));
+    object_unref(OBJECT(bioc));
+
+    /* qemu_save_device_state() wrote a header but no configuration */
+    if (qemu_get_be32(f) != QEMU_VM_FILE_MAGIC ||
+        qemu_get_be32(f) != QEMU_VM_FILE_VERSION) {
+        error_setg(errp, "Invalid in-memory snapshot");
+        ret = -EINVAL;
+    } else {
+        ret = qemu_load_device_state(f);
+        if (ret < 0) {
+            error_setg(errp, "Error %d while loading VM state", ret);
+        }
+    }
+    qemu_fclose(f);
+    migration_incoming_state_destroy();
+
+    return ret;
+}
+
+void qmp_x_snapshot_save_mem(Error **errp)
+{
+    save_snapshot_mem(errp);
+}
+
+void qmp_x_snapshot_load_mem(Error **errp)
+{
+    int saved_vm_running = runstate_is_running();
+
+    vm_stop(RUN_STATE_RESTORE_VM);
+
+    if (load_snapshot_mem(errp) == 0 && saved_vm_running) {
+        vm_start();
+    }
+}
+
 void vmstate_register_ram(MemoryRegion *mr, DeviceState *dev)
 {
     qemu_ram_set_idstr(mr->ram_block,
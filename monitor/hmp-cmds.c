@@ -20,6 +20,7 @@
 #include "chardev/char.h"
 #include "sysemu/block-backend.h"
 #include "sysemu/runstate.h"
+#include "sysemu/replay.h"
 #include "qemu/config-file.h"
 #include "qemu/option.h"
 #include "qemu/timer.h"
@@ -1135,6 +1136,30 @@ void hmp_savevm(Monitor *mon, const QDict *qdict)
     hmp_handle_error(mon, err);
 }
 
+void hmp_loadvm_mem(Monitor *mon, const QDict *qdict)
+{
+    Error *err = NULL;
+
+    qmp_x_snapshot_load_mem(&err);
+    hmp_handle_error(mon, err);
+}
+
+void hmp_savevm_mem(Monitor *mon, const QDict *qdict)
+{
+    Error *err = NULL;
+
+    qmp_x_snapshot_save_mem(&err);
+    hmp_handle_error(mon, err);
+}
+
+void hmp_replay_seek(Monitor *mon, const QDict *qdict)
+{
+    Error *err = NULL;
+
+    replay_seek(qdict_get_int(qdict, "icount"), &err);
+    hmp_handle_error(mon, err);
+}
+
 void hmp_delvm(Monitor *mon, const QDict *qdict)
 {
     BlockDriverState *bs;
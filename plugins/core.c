@@ -19,7 +19,10 @@
 #include "qemu/option.h"
 #include "qemu/rcu_queue.h"
 #include "qemu/xxhash.h"
+#include "qemu/host-utils.h"
 #include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
 #include "hw/core/cpu.h"
 #include "exec/cpu-common.h"
 
@@ -194,6 +197,66 @@ plugin_register_cb_udata(qemu_plugin_id_t id, enum qemu_plugin_event ev,
     do_plugin_register_cb(id, ev, func, udata);
 }
 
+/* Called with plugin.lock held */
+static void plugin_vcpu_seen__locked(CPUState *cpu)
+{
+    if (cpu->cpu_index >= plugin.num_vcpus) {
+        atomic_set(&plugin.num_vcpus, cpu->cpu_index + 1);
+    }
+}
+
+struct plugin_scoreboard_old {
+    struct rcu_head rcu;
+    void *data;
+};
+
+static void plugin_scoreboard_old_free(struct plugin_scoreboard_old *old)
+{
+    g_free(old->data);
+    g_free(old);
+}
+
+/*
+ * Called with plugin.lock held.  Generated code loads the data pointer
+ * every time, within cpu_exec's RCU critical section, so the old array
+ * stays valid for the vCPUs that are still running.  Their updates that
+ * land in it after the copy are lost, which can only happen when a vCPU
+ * is added beyond the current size while others run.
+ */
+static void plugin_scoreboard_grow(struct qemu_plugin_scoreboard *score,
+                                   size_t old_size, size_t new_size)
+{
+    struct plugin_scoreboard_old *old = g_new(struct plugin_scoreboard_old, 1);
+    void *data = g_malloc0(score->element_size * new_size);
+
+    memcpy(data, score->data, score->element_size * old_size);
+    old->data = score->data;
+    atomic_rcu_set(&score->data, data);
+    call_rcu(old, plugin_scoreboard_old_free, rcu);
+}
+
+/*
+ * Called with plugin.lock held.  This runs when the vCPU is created,
+ * before it has a thread of its own, so it cannot wait for the vCPU.
+ */
+static void plugin_grow_scoreboards__locked(CPUState *cpu)
+{
+    struct qemu_plugin_scoreboard *score;
+    size_t old_size, new_size;
+
+    old_size = plugin.scoreboard_alloc_size;
+    new_size = old_size;
+    while (new_size <= cpu->cpu_index) {
+        new_size *= 2;
+    }
+    if (new_size != old_size) {
+        QLIST_FOREACH(score, &plugin.scoreboards, entry) {
+            plugin_scoreboard_grow(score, old_size, new_size);
+        }
+        atomic_set(&plugin.scoreboard_alloc_size, new_size);
+    }
+}
+
 void qemu_plugin_vcpu_init_hook(CPUState *cpu)
 {
     bool success;
@@ -203,6 +266,8 @@ void qemu_plugin_vcpu_init_hook(CPUState *cpu)
     success = g_hash_table_insert(plugin.cpu_ht, &cpu->cpu_index,
                                   &cpu->cpu_index);
     g_assert(success);
+    plugin_grow_scoreboards__locked(cpu);
+    plugin_vcpu_seen__locked(cpu);
     qemu_rec_mutex_unlock(&plugin.lock);
 
     plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_INIT);
@@ -276,6 +341,24 @@ void plugin_register_inline_op(GArray **arr,
     dyn_cb->rw = rw;
     dyn_cb->inline_insn.op = op;
     dyn_cb->inline_insn.imm = imm;
+    dyn_cb->inline_insn.entry.score = NULL;
+}
+
+void plugin_register_inline_op_per_vcpu(GArray **arr,
+                                        enum qemu_plugin_mem_rw rw,
+                                        enum qemu_plugin_op op,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = NULL;
+    dyn_cb->type = PLUGIN_CB_INLINE;
+    dyn_cb->rw = rw;
+    dyn_cb->inline_insn.op = op;
+    dyn_cb->inline_insn.imm = imm;
+    dyn_cb->inline_insn.entry = entry;
 }
 
 static inline uint32_t cb_to_tcg_flags(enum qemu_plugin_cb_flags flags)
@@ -307,6 +390,30 @@ plugin_register_dyn_cb__udata(GArray **arr,
     dyn_cb->tcg_flags = cb_to_tcg_flags(flags);
     dyn_cb->f.vcpu_udata = cb;
     dyn_cb->type = PLUGIN_CB_REGULAR;
+    dyn_cb->cond.cond = QEMU_PLUGIN_COND_ALWAYS;
+}
+
+void
+plugin_register_dyn_cond_cb__udata(GArray **arr,
+                                   qemu_plugin_vcpu_udata_cb_t cb,
+                                   enum qemu_plugin_cb_flags flags,
+                                   enum qemu_plugin_cond cond,
+                                   qemu_plugin_u64 entry,
+                                   uint64_t imm, void *udata)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    if (cond == QEMU_PLUGIN_COND_NEVER) {
+        return;
+    }
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = udata;
+    dyn_cb->tcg_flags = cb_to_tcg_flags(flags);
+    dyn_cb->f.vcpu_udata = cb;
+    dyn_cb->type = PLUGIN_CB_REGULAR;
+    dyn_cb->cond.cond = cond;
+    dyn_cb->cond.imm = imm;
+    dyn_cb->cond.entry = entry;
 }
 
 void plugin_register_vcpu_mem_cb(GArray **arr,
@@ -396,6 +503,120 @@ void qemu_plugin_register_vcpu_resume_cb(qemu_plugin_id_t id,
     plugin_register_cb(id, QEMU_PLUGIN_EV_VCPU_RESUME, cb);
 }
 
+/*
+ * Sampling
+ *
+ * A sample is taken by queueing work on every running vCPU, which the
+ * vCPU processes once it leaves the execution loop, i.e. at a TB
+ * boundary and with its state in sync. No code is generated for it.
+ * At most one sample per vCPU is queued at a time.
+ */
+#define PLUGIN_SAMPLE_MIN_PERIOD_NS (10 * SCALE_US)
+
+static uint64_t sample_period_ns;
+
+static void plugin_vcpu_sample(CPUState *cpu, run_on_cpu_data data)
+{
+    CPUArchState *env = cpu->env_ptr;
+    struct qemu_plugin_cb *cb, *next;
+    target_ulong pc, cs_base;
+    uint32_t flags;
+    int mmu_idx = -1;
+
+    atomic_set(&cpu->plugin_sample_pending, false);
+    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+#ifndef CONFIG_USER_ONLY
+    mmu_idx = cpu_mmu_index(env, false);
+#endif
+
+    QLIST_FOREACH_SAFE_RCU(cb, &plugin.cb_lists[QEMU_PLUGIN_EV_VCPU_SAMPLE],
+                           entry, next) {
+        qemu_plugin_vcpu_sample_cb_t func = cb->f.vcpu_sample;
+
+        func(cb->ctx->id, cpu->cpu_index, pc, mmu_idx, cb->udata);
+    }
+}
+
+static void plugin_sample_all(void)
+{
+    CPUState *cpu;
+
+    if (!test_bit(QEMU_PLUGIN_EV_VCPU_SAMPLE, plugin.mask)) {
+        return;
+    }
+    CPU_FOREACH(cpu) {
+        /*
+         * Don't wake up idle vCPUs just to sample them, nor queue another
+         * sample for one that did not take the previous one yet, e.g. a
+         * thread blocked in a syscall.
+         */
+        if (!cpu->halted && !atomic_xchg(&cpu->plugin_sample_pending, true)) {
+            async_run_on_cpu(cpu, plugin_vcpu_sample, RUN_ON_CPU_NULL);
+        }
+    }
+}
+
+#ifdef CONFIG_USER_ONLY
+static void *plugin_sample_thread(void *arg)
+{
+    rcu_register_thread();
+    for (;;) {
+        g_usleep(atomic_read(&sample_period_ns) / SCALE_US);
+        cpu_list_lock();
+        plugin_sample_all();
+        cpu_list_unlock();
+    }
+    return NULL;
+}
+
+static void plugin_sample_start(void)
+{
+    QemuThread thread;
+
+    qemu_thread_create(&thread, "plugin-sample", plugin_sample_thread,
+                       NULL, QEMU_THREAD_DETACHED);
+}
+#else
+static QEMUTimer *sample_timer;
+
+static void plugin_sample_tick(void *opaque)
+{
+    plugin_sample_all();
+    timer_mod(sample_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                            atomic_read(&sample_period_ns));
+}
+
+static void plugin_sample_start(void)
+{
+    sample_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, plugin_sample_tick, NULL);
+    timer_mod(sample_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                            sample_period_ns);
+}
+#endif
+
+void qemu_plugin_register_vcpu_sample_cb(qemu_plugin_id_t id,
+                                         qemu_plugin_vcpu_sample_cb_t cb,
+                                         uint64_t period_ns, void *udata)
+{
+    bool start;
+
+    plugin_register_cb_udata(id, QEMU_PLUGIN_EV_VCPU_SAMPLE, cb, udata);
+    if (!cb) {
+        return;
+    }
+
+    period_ns = MAX(period_ns, PLUGIN_SAMPLE_MIN_PERIOD_NS);
+    qemu_rec_mutex_lock(&plugin.lock);
+    start = sample_period_ns == 0;
+    if (start || period_ns < sample_period_ns) {
+        atomic_set(&sample_period_ns, period_ns);
+    }
+    if (start) {
+        plugin_sample_start();
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+}
+
 void qemu_plugin_register_flush_cb(qemu_plugin_id_t id,
                                    qemu_plugin_simple_cb_t cb)
 {
@@ -416,19 +637,217 @@ void qemu_plugin_flush_cb(void)
     plugin_cb__simple(QEMU_PLUGIN_EV_FLUSH);
 }
 
-void exec_inline_op(struct qemu_plugin_dyn_cb *cb)
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size)
+{
+    struct qemu_plugin_scoreboard *score;
+
+    score = g_new0(struct qemu_plugin_scoreboard, 1);
+    score->element_size = element_size;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    score->data = g_malloc0(element_size * plugin.scoreboard_alloc_size);
+    QLIST_INSERT_HEAD(&plugin.scoreboards, score, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    return score;
+}
+
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
+{
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_REMOVE(score, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    g_free(score->data);
+    g_free(score);
+}
+
+void *plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                             unsigned int vcpu_index)
+{
+    g_assert(vcpu_index < plugin.scoreboard_alloc_size);
+    return atomic_rcu_read(&score->data) + vcpu_index * score->element_size;
+}
+
+/* Number of vCPU indexes handed out so far, i.e. scoreboard entries in use */
+unsigned int plugin_num_vcpus(void)
+{
+    return atomic_read(&plugin.num_vcpus);
+}
+
+void exec_inline_op(struct qemu_plugin_dyn_cb *cb, unsigned int cpu_index)
 {
     uint64_t *val = cb->userp;
 
+    if (cb->inline_insn.entry.score) {
+        val = plugin_scoreboard_find(cb->inline_insn.entry.score, cpu_index) +
+              cb->inline_insn.entry.offset;
+    }
+
     switch (cb->inline_insn.op) {
     case QEMU_PLUGIN_INLINE_ADD_U64:
         *val += cb->inline_insn.imm;
         break;
+    case QEMU_PLUGIN_INLINE_STORE_U64:
+        *val = cb->inline_insn.imm;
+        break;
     default:
         g_assert_not_reached();
     }
 }
 
+/*
+ * Memory tracing
+ *
+ * Each vCPU gets its own single producer, single consumer ring, which
+ * it allocates on its first traced access and pushes onto the trace's
+ * list of rings. The list is only ever prepended to, so the consumer
+ * can walk it without a lock. The PC of the instruction is stored in
+ * the vCPU's scoreboard element by an inline op when the instruction
+ * starts, so that the memory callback does not need per-instruction
+ * user data.
+ */
+struct plugin_mem_ring {
+    /* written by the vCPU only */
+    size_t head;
+    size_t dropped;
+    /* written by the consumer only */
+    size_t tail QEMU_ALIGNED(64);
+    unsigned int vcpu_index;
+    struct plugin_mem_ring *next;
+    qemu_plugin_mem_record records[];
+};
+
+typedef struct {
+    uint64_t pc;
+    struct plugin_mem_ring *ring;
+} PluginMemTraceVCPU;
+
+struct qemu_plugin_mem_trace {
+    struct qemu_plugin_scoreboard *score;
+    size_t n_records;
+    struct plugin_mem_ring *rings;
+};
+
+struct qemu_plugin_mem_trace *qemu_plugin_mem_trace_new(size_t n_records)
+{
+    struct qemu_plugin_mem_trace *trace = g_new0(struct qemu_plugin_mem_trace,
+                                                 1);
+
+    trace->score = plugin_scoreboard_new(sizeof(PluginMemTraceVCPU));
+    trace->n_records = pow2ceil(MAX(n_records, 1));
+    return trace;
+}
+
+void qemu_plugin_mem_trace_free(struct qemu_plugin_mem_trace *trace)
+{
+    struct plugin_mem_ring *ring, *next;
+
+    for (ring = trace->rings; ring; ring = next) {
+        next = ring->next;
+        g_free(ring);
+    }
+    plugin_scoreboard_free(trace->score);
+    g_free(trace);
+}
+
+static struct plugin_mem_ring *
+plugin_mem_ring_new(struct qemu_plugin_mem_trace *trace, PluginMemTraceVCPU *v,
+                    unsigned int vcpu_index)
+{
+    struct plugin_mem_ring *ring, *old;
+
+    ring = g_malloc0(sizeof(*ring) +
+                     trace->n_records * sizeof(qemu_plugin_mem_record));
+    ring->vcpu_index = vcpu_index;
+    v->ring = ring;
+
+    do {
+        old = atomic_read(&trace->rings);
+        ring->next = old;
+    } while (atomic_cmpxchg(&trace->rings, old, ring) != old);
+    return ring;
+}
+
+static void plugin_mem_trace_append(unsigned int vcpu_index,
+                                    qemu_plugin_meminfo_t info,
+                                    uint64_t vaddr, void *udata)
+{
+    struct qemu_plugin_mem_trace *trace = udata;
+    PluginMemTraceVCPU *v = plugin_scoreboard_find(trace->score, vcpu_index);
+    struct plugin_mem_ring *ring = v->ring;
+    qemu_plugin_mem_record *rec;
+    size_t head;
+
+    if (unlikely(!ring)) {
+        ring = plugin_mem_ring_new(trace, v, vcpu_index);
+    }
+    head = ring->head;
+    if (unlikely(head - atomic_load_acquire(&ring->tail) ==
+                 trace->n_records)) {
+        atomic_set(&ring->dropped, ring->dropped + 1);
+        return;
+    }
+    rec = &ring->records[head & (trace->n_records - 1)];
+    rec->vaddr = vaddr;
+    rec->pc = v->pc;
+    rec->info = info;
+    atomic_store_release(&ring->head, head + 1);
+}
+
+void qemu_plugin_register_vcpu_mem_trace(struct qemu_plugin_insn *insn,
+                                         enum qemu_plugin_mem_rw rw,
+                                         struct qemu_plugin_mem_trace *trace)
+{
+    qemu_plugin_u64 pc = {
+        .score = trace->score,
+        .offset = offsetof(PluginMemTraceVCPU, pc),
+    };
+
+    plugin_register_inline_op_per_vcpu(
+        &insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_INLINE], 0,
+        QEMU_PLUGIN_INLINE_STORE_U64, pc, insn->vaddr);
+    plugin_register_vcpu_mem_cb(&insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_REGULAR],
+                                plugin_mem_trace_append,
+                                QEMU_PLUGIN_CB_NO_REGS, rw, trace);
+}
+
+size_t qemu_plugin_mem_trace_drain(struct qemu_plugin_mem_trace *trace,
+                                   qemu_plugin_mem_trace_cb_t cb,
+                                   void *userdata)
+{
+    size_t mask = trace->n_records - 1;
+    struct plugin_mem_ring *ring;
+    size_t total = 0;
+
+    for (ring = atomic_rcu_read(&trace->rings); ring; ring = ring->next) {
+        size_t tail = ring->tail;
+        size_t head = atomic_load_acquire(&ring->head);
+
+        while (tail != head) {
+            size_t idx = tail & mask;
+            size_t n = MIN(head - tail, trace->n_records - idx);
+
+            cb(ring->vcpu_index, &ring->records[idx], n, userdata);
+            tail += n;
+            total += n;
+            atomic_store_release(&ring->tail, tail);
+        }
+    }
+    return total;
+}
+
+uint64_t qemu_plugin_mem_trace_dropped(struct qemu_plugin_mem_trace *trace)
+{
+    struct plugin_mem_ring *ring;
+    uint64_t dropped = 0;
+
+    for (ring = atomic_rcu_read(&trace->rings); ring; ring = ring->next) {
+        dropped += atomic_read(&ring->dropped);
+    }
+    return dropped;
+}
+
 void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr, uint32_t info)
 {
     GArray *arr = cpu->plugin_mem_cbs;
@@ -450,7 +869,7 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr, uint32_t info)
             cb->f.vcpu_mem(cpu->cpu_index, info, vaddr, cb->userp);
             break;
         case PLUGIN_CB_INLINE:
-            exec_inline_op(cb);
+            exec_inline_op(cb, cpu->cpu_index);
             break;
         default:
             g_assert_not_reached();
@@ -496,6 +915,8 @@ static void __attribute__((__constructor__)) plugin_init(void)
     plugin.id_ht = g_hash_table_new(g_int64_hash, g_int64_equal);
     plugin.cpu_ht = g_hash_table_new(g_int_hash, g_int_equal);
     QTAILQ_INIT(&plugin.ctxs);
+    QLIST_INIT(&plugin.scoreboards);
+    plugin.scoreboard_alloc_size = 16;
     qht_init(&plugin.dyn_cb_arr_ht, plugin_dyn_cb_arr_cmp, 16,
              QHT_MODE_AUTO_RESIZE);
     atexit(qemu_plugin_atexit_cb);
@@ -124,6 +124,10 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kernel-irqchip=on|off|split controls accelerated irqchip support (default=on)\n"
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-cache=file (keep translated code in file across runs)\n"
+    "                perfmap=on|off (write symbols for perf to /tmp/perf-<pid>.map)\n"
+    "                jitdump=on|off (write code for perf to /tmp/jit-<pid>.dump)\n"
+    "                poll-sleep=on|off (sleep in guest polling loops)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
 SRST
 ``-accel name[,prop=value[,...]]``
@@ -151,6 +155,32 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-cache=file``
+        Saves the translated code to file when QEMU exits and reuses
+        it in the next run, as long as the guest code is unchanged.
+        The file is only used by the same QEMU binary with the same
+        command line, and only when host address space randomization
+        is disabled (e.g. by running QEMU under ``setarch -R``).
+        Requires ``thread=single`` when there is more than one vCPU.
+
+    ``perfmap=on|off``
+        Write a perf map listing each translation block, named after
+        the guest symbol and address it starts at, so that ``perf
+        report`` can attribute time spent in translated code. The map
+        cannot describe code that is reused after a flush of the
+        translation block cache; use ``jitdump`` if that matters.
+
+    ``jitdump=on|off``
+        Write a jitdump file with a timestamped copy of each
+        translation block, for use with ``perf record -k 1`` and
+        ``perf inject --jit``.
+
+    ``poll-sleep=on|off``
+        Let a single vCPU sleep for up to 1ms, instead of spinning, in a
+        guest loop that only reads memory and waits for it to change.
+        Interrupts and writes to guest RAM by devices wake it up. Without
+        icount this changes timing, so it is disabled by default.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefor taking advantage of
@@ -3921,10 +3951,10 @@ SRST
 ERST
 
 DEF("icount", HAS_ARG, QEMU_OPTION_icount, \
-    "-icount [shift=N|auto][,align=on|off][,sleep=on|off,rr=record|replay,rrfile=<filename>,rrsnapshot=<snapshot>]\n" \
+    "-icount [shift=N|auto][,align=on|off][,sleep=on|off][,fast=on|off,rr=record|replay,rrfile=<filename>,rrsnapshot=<snapshot>]\n" \
     "                enable virtual instruction counter with 2^N clock ticks per\n" \
-    "                instruction, enable aligning the host and virtual clocks\n" \
-    "                or disable real time cpu sleeping\n", QEMU_ARCH_ALL)
+    "                instruction, enable aligning the host and virtual clocks,\n" \
+    "                disable real time cpu sleeping or run as fast as possible\n", QEMU_ARCH_ALL)
 SRST
 ``-icount [shift=N|auto][,rr=record|replay,rrfile=filename,rrsnapshot=snapshot]``
     Enable virtual instruction counter. The virtual cpu will execute one
@@ -3939,6 +3969,14 @@ SRST
     will not advance if no timer is enabled. This behavior give
     deterministic execution times from the guest point of view.
 
+    ``fast=on`` implies ``sleep=off`` and goes further: the vCPU thread
+    itself moves the virtual time to the next timer deadline and runs
+    the timers as soon as all the virtual cpus are idle, without help
+    from the main loop, and real time timers no longer cut the
+    instruction budget short. This runs the guest as fast as the host
+    allows while keeping execution deterministic. It requires a fixed
+    ``shift`` and cannot be combined with ``rr``.
+
     Note that while this option can give deterministic behavior, it does
     not provide cycle accurate emulation. Modern CPUs contain
     superscalar out of order cores with complex cache hierarchies. The
@@ -15,6 +15,8 @@
 #include "replay-internal.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
+#include "sysemu/cpus.h"
+#include "hw/core/cpu.h"
 
 /* Mutex to protect reading and writing events to the log.
    data_kind and has_unread_data are also protected
@@ -22,22 +24,15 @@
    It also protects replay events queue which stores events to be
    written or read to the log. */
 static QemuMutex lock;
-/* Condition and queue for fair ordering of mutex lock requests. */
+/* Condition and queue for fair ordering of mutex lock requests.
+   With multi-threaded TCG, the turns of the vCPUs and of the running
+   main loop are instead given in the order of the EVENT_SYNC events. */
 static QemuCond mutex_cond;
 static unsigned long mutex_head, mutex_tail;
 
 /* File for replay writing */
-static bool write_error;
 FILE *replay_file;
 
-static void replay_write_error(void)
-{
-    if (!write_error) {
-        error_report("replay write error");
-        write_error = true;
-    }
-}
-
 static void replay_read_error(void)
 {
     error_report("error reading the replay data");
@@ -47,15 +42,16 @@ static void replay_read_error(void)
 void replay_put_byte(uint8_t byte)
 {
     if (replay_file) {
-        if (putc(byte, replay_file) == EOF) {
-            replay_write_error();
-        }
+        replay_log_write(&byte, 1);
     }
 }
 
 void replay_put_event(uint8_t event)
 {
     assert(event < EVENT_COUNT);
+    if (replay_file) {
+        replay_log_event_start();
+    }
     replay_put_byte(event);
 }
 
@@ -82,9 +78,7 @@ void replay_put_array(const uint8_t *buf, size_t size)
 {
     if (replay_file) {
         replay_put_dword(size);
-        if (fwrite(buf, 1, size, replay_file) != size) {
-            replay_write_error();
-        }
+        replay_log_write(buf, size);
     }
 }
 
@@ -92,11 +86,10 @@ uint8_t replay_get_byte(void)
 {
     uint8_t byte = 0;
     if (replay_file) {
-        int r = getc(replay_file);
-        if (r == EOF) {
+        /* The end of a log cut short is reported by replay_check_error */
+        if (!replay_log_read(&byte, 1) && !replay_log_eof()) {
             replay_read_error();
         }
-        byte = r;
     }
     return byte;
 }
@@ -138,7 +131,7 @@ void replay_get_array(uint8_t *buf, size_t *size)
 {
     if (replay_file) {
         *size = replay_get_dword();
-        if (fread(buf, 1, *size, replay_file) != *size) {
+        if (!replay_log_read(buf, *size)) {
             replay_read_error();
         }
     }
@@ -149,7 +142,7 @@ void replay_get_array_alloc(uint8_t **buf, size_t *size)
     if (replay_file) {
         *size = replay_get_dword();
         *buf = g_malloc(*size);
-        if (fread(*buf, 1, *size, replay_file) != *size) {
+        if (!replay_log_read(*buf, *size)) {
             replay_read_error();
         }
     }
@@ -158,7 +151,7 @@ void replay_get_array_alloc(uint8_t **buf, size_t *size)
 void replay_check_error(void)
 {
     if (replay_file) {
-        if (feof(replay_file)) {
+        if (replay_log_eof()) {
             error_report("replay file is over");
             qemu_system_vmstop_request_prepare();
             qemu_system_vmstop_request(RUN_STATE_PAUSED);
@@ -177,6 +170,8 @@ void replay_fetch_data_kind(void)
             replay_state.data_kind = replay_get_byte();
             if (replay_state.data_kind == EVENT_INSTRUCTION) {
                 replay_state.instruction_count = replay_get_dword();
+            } else if (replay_state.data_kind == EVENT_SYNC) {
+                replay_state.sync_owner = replay_get_dword();
             }
             replay_check_error();
             replay_state.has_unread_data = 1;
@@ -211,32 +206,109 @@ bool replay_mutex_locked(void)
     return replay_locked;
 }
 
-/* Ordering constraints, replay_lock must be taken before BQL */
-void replay_mutex_lock(void)
+static uint32_t replay_next_owner(void)
 {
-    if (replay_mode != REPLAY_MODE_NONE) {
-        unsigned long id;
-        g_assert(!qemu_mutex_iothread_locked());
-        g_assert(!replay_mutex_locked());
+    return replay_state.data_kind == EVENT_SYNC
+           ? replay_state.sync_owner : REPLAY_OWNER_MAIN;
+}
+
+/*
+ * With multi-threaded TCG, the turns of the vCPU threads are logged, and
+ * so are those of the main loop while the VM runs.
+ */
+static void replay_mutex_lock_owner(uint32_t owner, CPUState *cpu)
+{
+    bool tracked = replay_mttcg && (cpu || runstate_is_running());
+    bool running = cpu && cpu->running;
+    unsigned long id;
+
+    g_assert(!qemu_mutex_iothread_locked());
+    g_assert(!replay_mutex_locked());
+
+    if (tracked && replay_mode == REPLAY_MODE_PLAY) {
+        /*
+         * Let the other vCPUs start and end exclusive sections while
+         * this one waits for its turn.
+         */
+        if (running) {
+            cpu_exec_end(cpu);
+        }
         qemu_mutex_lock(&lock);
-        id = mutex_tail++;
-        while (id != mutex_head) {
+        while (mutex_head != mutex_tail || replay_next_owner() != owner) {
+            if (cpu && cpu->stop) {
+                /* The turn may only come after the VM is resumed */
+                qemu_mutex_unlock(&lock);
+                qemu_cpu_replay_park(cpu);
+                qemu_mutex_lock(&lock);
+                continue;
+            }
             qemu_cond_wait(&mutex_cond, &lock);
         }
+        ++mutex_tail;
         replay_locked = true;
         qemu_mutex_unlock(&lock);
+        if (running) {
+            cpu_exec_start(cpu);
+        }
+        /* The turn is ours, drop its event */
+        replay_finish_event();
+        return;
+    }
+
+    qemu_mutex_lock(&lock);
+    id = mutex_tail++;
+    while (id != mutex_head) {
+        qemu_cond_wait(&mutex_cond, &lock);
+    }
+    replay_locked = true;
+    qemu_mutex_unlock(&lock);
+
+    if (tracked && replay_mode == REPLAY_MODE_RECORD) {
+        replay_put_event(EVENT_SYNC);
+        replay_put_dword(owner);
+    }
+}
+
+/* Ordering constraints, replay_lock must be taken before BQL */
+void replay_mutex_lock(void)
+{
+    if (replay_mode != REPLAY_MODE_NONE) {
+        replay_mutex_lock_owner(REPLAY_OWNER_MAIN, NULL);
     }
 }
 
+void replay_mutex_lock_vcpu(CPUState *cpu)
+{
+    g_assert(replay_mttcg);
+    replay_mutex_lock_owner(cpu->cpu_index, cpu);
+}
+
 void replay_mutex_unlock(void)
 {
     if (replay_mode != REPLAY_MODE_NONE) {
+        bool notify = false;
+
         g_assert(replay_mutex_locked());
+        if (replay_mttcg && replay_mode == REPLAY_MODE_PLAY) {
+            /*
+             * Clock values that were recorded but not read by the holder
+             * of the turn would hide the owner of the next one.
+             */
+            while (replay_state.data_kind >= EVENT_CLOCK
+                   && replay_state.data_kind <= EVENT_CLOCK_LAST) {
+                replay_read_next_clock(replay_state.data_kind - EVENT_CLOCK);
+            }
+            /* The main loop may be waiting in poll() */
+            notify = replay_next_owner() == REPLAY_OWNER_MAIN;
+        }
         qemu_mutex_lock(&lock);
         ++mutex_head;
         replay_locked = false;
         qemu_cond_broadcast(&mutex_cond);
         qemu_mutex_unlock(&lock);
+        if (notify) {
+            qemu_notify_event();
+        }
     }
 }
 
@@ -244,6 +316,11 @@ void replay_advance_current_icount(uint64_t current_icount)
 {
     int diff = (int)(current_icount - replay_state.current_icount);
 
+    /* The vCPU logs have the instruction counts */
+    if (replay_mttcg) {
+        return;
+    }
+
     /* Time can only go forward */
     assert(diff >= 0);
 
@@ -257,7 +334,7 @@ void replay_advance_current_icount(uint64_t current_icount)
 /*! Saves cached instructions. */
 void replay_save_instructions(void)
 {
-    if (replay_file && replay_mode == REPLAY_MODE_RECORD) {
+    if (replay_file && replay_mode == REPLAY_MODE_RECORD && !replay_mttcg) {
         g_assert(replay_mutex_locked());
         replay_advance_current_icount(replay_get_current_icount());
     }
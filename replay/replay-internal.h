@@ -12,6 +12,10 @@
  *
  */
 
+/* Current version of the replay mechanism.
+   Increase it when file format changes. */
+#define REPLAY_VERSION              0xe0200d
+
 /* Any changes to order/number of events will need to bump REPLAY_VERSION */
 enum ReplayEvents {
     /* for instruction event */
@@ -44,6 +48,8 @@ enum ReplayEvents {
     /* some of greater codes are reserved for checkpoints */
     EVENT_CHECKPOINT,
     EVENT_CHECKPOINT_LAST = EVENT_CHECKPOINT + CHECKPOINT_COUNT - 1,
+    /* for replay_lock acquisitions with multi-threaded TCG */
+    EVENT_SYNC,
     /* end of log event */
     EVENT_END,
     EVENT_COUNT
@@ -89,12 +95,38 @@ typedef struct ReplayState {
     uint64_t read_event_id;
     /*! Asynchronous event checkpoint id read from the log */
     int32_t read_event_checkpoint;
+    /*! Owner of the replay_lock turn read from the log */
+    uint32_t sync_owner;
 } ReplayState;
 extern ReplayState replay_state;
 
 /* File for replay writing */
 extern FILE *replay_file;
 
+/* Log blocks, see replay-log.c */
+
+/*! Sets the log up after opening it */
+void replay_log_init(void);
+/*! Writes the pending blocks and the index, and frees the buffers */
+void replay_log_finish(void);
+/*! Called before writing an event, may start a new block */
+void replay_log_event_start(void);
+/*! Appends data to the event stream */
+void replay_log_write(const uint8_t *buf, size_t size);
+/*! Reads data from the event stream, returns false at its end */
+bool replay_log_read(uint8_t *buf, size_t size);
+/*! Returns true when the reader went past the last block */
+bool replay_log_eof(void);
+/*! Returns the current offset in the event stream */
+uint64_t replay_log_tell(void);
+/*! Continues reading the event stream at the specified offset */
+void replay_log_seek(uint64_t offset);
+/*! Adds a snapshot to the index of the log when recording */
+void replay_log_snapshot(const char *name, uint64_t icount);
+/*! Returns the name of the last snapshot in the index taken
+    at or before @icount, or NULL */
+const char *replay_log_find_snapshot(uint64_t icount);
+
 void replay_put_byte(uint8_t byte);
 void replay_put_event(uint8_t event);
 void replay_put_word(uint16_t word);
@@ -115,6 +147,13 @@ void replay_get_array_alloc(uint8_t **buf, size_t *size);
 void replay_mutex_init(void);
 bool replay_mutex_locked(void);
 
+/* Owner of the turns that are not taken by a vCPU thread */
+#define REPLAY_OWNER_MAIN UINT32_MAX
+
+/*! Takes the replay_lock for an ordering point of the vCPU,
+    in the order of the log in replay mode. */
+void replay_mutex_lock_vcpu(CPUState *cpu);
+
 /*! Checks error status of the file. */
 void replay_check_error(void);
 
@@ -139,6 +178,13 @@ bool replay_next_event_is(int event);
     the value is not used. */
 void replay_read_next_clock(unsigned int kind);
 
+/* Multi-threaded TCG */
+
+/*! Returns the name of the log of the vCPU with the specified index */
+char *replay_get_vcpu_filename(int index);
+/*! Closes the logs of the vCPUs */
+void replay_finish_vcpus(void);
+
 /* Asynchronous events queue */
 
 /*! Initializes events' processing internals */
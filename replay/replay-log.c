@@ -0,0 +1,728 @@
+/*
+ * replay-log.c
+ *
+ * Block layout of the replay log
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ */
+
+/*
+ * The event stream is cut into blocks of about REPLAY_BLOCK_SIZE bytes,
+ * each one starting with an event.  When recording, full blocks are
+ * compressed and written by a separate thread, so that neither the vCPU
+ * nor the main loop wait for the disk.  Each block is stored as:
+ *
+ *   1-byte compression method
+ *   4-byte size of the events in the block
+ *   4-byte size of the stored data
+ *   stored data
+ *
+ * Every REPLAY_INDEX_INTERVAL blocks, and when the log is closed, the
+ * writer thread adds an index block, which replaying skips over:
+ *
+ *   1-byte REPLAY_BLOCK_INDEX
+ *   4-byte size of the index data, twice
+ *   8-byte file offset of the previous index block, 0 for the first one
+ *   4-byte number of blocks since the previous index block, and for each:
+ *     8-byte instruction count at the start of the block, all ones with
+ *            multi-threaded TCG, where the main log does not count them
+ *     8-byte offset of the block in the event stream
+ *     8-byte offset of the block in the file
+ *   4-byte number of snapshots since the previous index block, and for
+ *   each of them:
+ *     8-byte instruction count
+ *     8-byte offset in the event stream
+ *     array with the snapshot name
+ *
+ * The header holds the version and the file offset of the last index
+ * block, and is written as soon as recording starts.  A log that was cut
+ * short, e.g. because QEMU was killed while recording, can still be
+ * replayed up to its last complete block, and seeked in up to its last
+ * index block.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/error-report.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
+#include "qemu/units.h"
+#include "sysemu/replay.h"
+#include "replay-internal.h"
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
+
+/* Version id and offset of the last index block */
+#define HEADER_SIZE                 (sizeof(uint32_t) + sizeof(uint64_t))
+
+#define REPLAY_BLOCK_SIZE           (256 * KiB)
+#define REPLAY_BLOCK_HEADER_SIZE    (1 + 2 * sizeof(uint32_t))
+/* Blocks waiting for the writer thread before the producers wait too */
+#define REPLAY_BLOCK_QUEUE_MAX      16
+/* Blocks between two index blocks */
+#define REPLAY_INDEX_INTERVAL       64
+/* Instruction count of the blocks recorded with multi-threaded TCG */
+#define REPLAY_ICOUNT_UNKNOWN       UINT64_MAX
+
+enum ReplayBlockMethod {
+    REPLAY_BLOCK_RAW,
+    REPLAY_BLOCK_ZSTD,
+    REPLAY_BLOCK_INDEX,
+};
+
+typedef struct ReplayBlock {
+    uint8_t *data;
+    size_t size;
+    size_t alloc;
+    /* instruction count and event stream offset at data[0] */
+    uint64_t icount;
+    uint64_t offset;
+    QSIMPLEQ_ENTRY(ReplayBlock) next;
+} ReplayBlock;
+
+typedef struct ReplayBlockIndex {
+    uint64_t icount;
+    uint64_t offset;
+    uint64_t file_offset;
+} ReplayBlockIndex;
+
+typedef struct ReplaySnapshotIndex {
+    uint64_t icount;
+    uint64_t offset;
+    char *name;
+} ReplaySnapshotIndex;
+
+/* Index of the blocks, appended to by the writer thread when recording */
+static GArray *block_index;
+/* Index of the snapshots, under the writer_lock when recording */
+static GArray *snapshot_index;
+/* File offset of the last index block, 0 if none */
+static uint64_t index_offset;
+
+/* Recording: block being filled, under the replay_lock */
+static ReplayBlock *cur_block;
+/* Event stream offset of the next byte */
+static uint64_t log_offset;
+
+/* Recording: queue of the full blocks for the writer thread */
+static QemuThread writer_thread;
+static QemuMutex writer_lock;
+static QemuCond writer_cond;
+static QSIMPLEQ_HEAD(, ReplayBlock) writer_queue =
+    QSIMPLEQ_HEAD_INITIALIZER(writer_queue);
+static unsigned writer_queued;
+static bool writer_exit;
+static bool writer_error;
+/* Entries of block_index and snapshot_index already in an index block */
+static unsigned blocks_indexed, snapshots_indexed;
+
+/* Replaying: current block, starting at log_offset in the event stream */
+static uint8_t *read_buf;
+static size_t read_size, read_pos, read_alloc;
+static bool read_eof;
+
+#ifdef CONFIG_ZSTD
+static uint8_t *zbuf;
+static size_t zbuf_size;
+
+static void replay_log_zbuf_reserve(size_t size)
+{
+    if (zbuf_size < size) {
+        zbuf_size = size;
+        zbuf = g_realloc(zbuf, zbuf_size);
+    }
+}
+#endif
+
+static void replay_log_write_error(void)
+{
+    if (!writer_error) {
+        error_report("replay write error");
+        writer_error = true;
+    }
+}
+
+static void replay_log_put(const void *buf, size_t size)
+{
+    if (fwrite(buf, 1, size, replay_file) != size) {
+        replay_log_write_error();
+    }
+}
+
+static void replay_log_put_dword(uint32_t dword)
+{
+    uint8_t buf[4];
+
+    stl_be_p(buf, dword);
+    replay_log_put(buf, sizeof(buf));
+}
+
+static void replay_log_put_qword(uint64_t qword)
+{
+    uint8_t buf[8];
+
+    stq_be_p(buf, qword);
+    replay_log_put(buf, sizeof(buf));
+}
+
+static bool replay_log_get(void *buf, size_t size)
+{
+    return fread(buf, 1, size, replay_file) == size;
+}
+
+static void replay_log_write_header(void)
+{
+    replay_log_put_dword(REPLAY_VERSION);
+    replay_log_put_qword(index_offset);
+    if (fflush(replay_file)) {
+        replay_log_write_error();
+    }
+}
+
+/* Index blocks */
+
+static void replay_index_put_dword(GByteArray *buf, uint32_t dword)
+{
+    uint8_t b[4];
+
+    stl_be_p(b, dword);
+    g_byte_array_append(buf, b, sizeof(b));
+}
+
+static void replay_index_put_qword(GByteArray *buf, uint64_t qword)
+{
+    uint8_t b[8];
+
+    stq_be_p(b, qword);
+    g_byte_array_append(buf, b, sizeof(b));
+}
+
+/*
+ * Appends an index block with the blocks and snapshots recorded since
+ * the previous one, then points the header to it.  Called by the writer
+ * thread, or after it exited.
+ */
+static void replay_log_write_index(void)
+{
+    GByteArray *buf = g_byte_array_new();
+    uint8_t header[REPLAY_BLOCK_HEADER_SIZE];
+    long offset = ftell(replay_file);
+    unsigned i;
+
+    replay_index_put_qword(buf, index_offset);
+    replay_index_put_dword(buf, block_index->len - blocks_indexed);
+    for (i = blocks_indexed; i < block_index->len; i++) {
+        ReplayBlockIndex *e = &g_array_index(block_index, ReplayBlockIndex, i);
+
+        replay_index_put_qword(buf, e->icount);
+        replay_index_put_qword(buf, e->offset);
+        replay_index_put_qword(buf, e->file_offset);
+    }
+    blocks_indexed = block_index->len;
+
+    qemu_mutex_lock(&writer_lock);
+    replay_index_put_dword(buf, snapshot_index->len - snapshots_indexed);
+    for (i = snapshots_indexed; i < snapshot_index->len; i++) {
+        ReplaySnapshotIndex *e =
+            &g_array_index(snapshot_index, ReplaySnapshotIndex, i);
+
+        replay_index_put_qword(buf, e->icount);
+        replay_index_put_qword(buf, e->offset);
+        replay_index_put_dword(buf, strlen(e->name));
+        g_byte_array_append(buf, (uint8_t *)e->name, strlen(e->name));
+    }
+    snapshots_indexed = snapshot_index->len;
+    qemu_mutex_unlock(&writer_lock);
+
+    header[0] = REPLAY_BLOCK_INDEX;
+    stl_be_p(header + 1, buf->len);
+    stl_be_p(header + 5, buf->len);
+    replay_log_put(header, sizeof(header));
+    replay_log_put(buf->data, buf->len);
+    g_byte_array_free(buf, true);
+
+    /* The header must not point to an index block that is not there yet */
+    if (fflush(replay_file)) {
+        replay_log_write_error();
+    }
+    index_offset = offset;
+    fseek(replay_file, 0, SEEK_SET);
+    replay_log_write_header();
+    fseek(replay_file, 0, SEEK_END);
+}
+
+/* Writer thread */
+
+static void replay_log_write_block(ReplayBlock *block)
+{
+    ReplayBlockIndex entry = {
+        .icount = block->icount,
+        .offset = block->offset,
+        .file_offset = ftell(replay_file),
+    };
+    uint8_t header[REPLAY_BLOCK_HEADER_SIZE];
+    const uint8_t *data = block->data;
+    size_t size = block->size;
+
+    header[0] = REPLAY_BLOCK_RAW;
+#ifdef CONFIG_ZSTD
+    {
+        size_t ret;
+
+        replay_log_zbuf_reserve(ZSTD_compressBound(block->size));
+        ret = ZSTD_compress(zbuf, zbuf_size, block->data, block->size, 1);
+        if (!ZSTD_isError(ret) && ret < block->size) {
+            header[0] = REPLAY_BLOCK_ZSTD;
+            data = zbuf;
+            size = ret;
+        }
+    }
+#endif
+    stl_be_p(header + 1, block->size);
+    stl_be_p(header + 5, size);
+    replay_log_put(header, sizeof(header));
+    replay_log_put(data, size);
+
+    g_array_append_val(block_index, entry);
+    g_free(block->data);
+    g_free(block);
+
+    if (block_index->len - blocks_indexed >= REPLAY_INDEX_INTERVAL) {
+        replay_log_write_index();
+    }
+}
+
+static void *replay_log_writer(void *opaque)
+{
+    ReplayBlock *block;
+
+    qemu_mutex_lock(&writer_lock);
+    for (;;) {
+        while (QSIMPLEQ_EMPTY(&writer_queue) && !writer_exit) {
+            qemu_cond_wait(&writer_cond, &writer_lock);
+        }
+        block = QSIMPLEQ_FIRST(&writer_queue);
+        if (!block) {
+            break;
+        }
+        QSIMPLEQ_REMOVE_HEAD(&writer_queue, next);
+        qemu_mutex_unlock(&writer_lock);
+
+        replay_log_write_block(block);
+
+        qemu_mutex_lock(&writer_lock);
+        writer_queued--;
+        qemu_cond_broadcast(&writer_cond);
+    }
+    qemu_mutex_unlock(&writer_lock);
+    return NULL;
+}
+
+static void replay_log_submit(void)
+{
+    ReplayBlock *block = cur_block;
+
+    cur_block = NULL;
+    if (!block) {
+        return;
+    }
+    if (!block->size) {
+        g_free(block->data);
+        g_free(block);
+        return;
+    }
+
+    qemu_mutex_lock(&writer_lock);
+    while (writer_queued >= REPLAY_BLOCK_QUEUE_MAX) {
+        qemu_cond_wait(&writer_cond, &writer_lock);
+    }
+    QSIMPLEQ_INSERT_TAIL(&writer_queue, block, next);
+    writer_queued++;
+    qemu_cond_broadcast(&writer_cond);
+    qemu_mutex_unlock(&writer_lock);
+}
+
+/* Recording */
+
+void replay_log_event_start(void)
+{
+    if (cur_block && cur_block->size >= REPLAY_BLOCK_SIZE) {
+        replay_log_submit();
+    }
+    if (!cur_block) {
+        cur_block = g_new0(ReplayBlock, 1);
+        cur_block->alloc = REPLAY_BLOCK_SIZE + REPLAY_BLOCK_SIZE / 4;
+        cur_block->data = g_malloc(cur_block->alloc);
+        cur_block->icount = replay_mttcg ? REPLAY_ICOUNT_UNKNOWN
+                                         : replay_state.current_icount;
+        cur_block->offset = log_offset;
+    }
+}
+
+void replay_log_write(const uint8_t *buf, size_t size)
+{
+    ReplayBlock *block = cur_block;
+
+    /* Data written without an event starts a block as well */
+    if (!block) {
+        replay_log_event_start();
+        block = cur_block;
+    }
+    if (block->size + size > block->alloc) {
+        block->alloc = MAX(block->alloc * 2, block->size + size);
+        block->data = g_realloc(block->data, block->alloc);
+    }
+    memcpy(block->data + block->size, buf, size);
+    block->size += size;
+    log_offset += size;
+}
+
+void replay_log_snapshot(const char *name, uint64_t icount)
+{
+    ReplaySnapshotIndex entry = {
+        .icount = icount,
+        .offset = replay_state.file_offset,
+        .name = g_strdup(name),
+    };
+
+    if (replay_mode == REPLAY_MODE_RECORD) {
+        qemu_mutex_lock(&writer_lock);
+        g_array_append_val(snapshot_index, entry);
+        qemu_mutex_unlock(&writer_lock);
+    } else {
+        g_free(entry.name);
+    }
+}
+
+/* Replaying */
+
+static void replay_log_index_error(void)
+{
+    error_report("Replay: invalid index in the log");
+    exit(1);
+}
+
+/* Reads the data of the index block at @offset */
+static uint8_t *replay_log_get_index(uint64_t offset, uint32_t *size)
+{
+    uint8_t header[REPLAY_BLOCK_HEADER_SIZE];
+    uint8_t *data;
+
+    if (fseek(replay_file, offset, SEEK_SET)
+        || !replay_log_get(header, sizeof(header))
+        || header[0] != REPLAY_BLOCK_INDEX
+        || ldl_be_p(header + 1) != ldl_be_p(header + 5)
+        || ldl_be_p(header + 1) < sizeof(uint64_t)) {
+        replay_log_index_error();
+    }
+    *size = ldl_be_p(header + 1);
+    data = g_malloc(*size);
+    if (!replay_log_get(data, *size)) {
+        replay_log_index_error();
+    }
+    return data;
+}
+
+static const uint8_t *replay_index_get(const uint8_t **p, const uint8_t *end,
+                                       size_t size)
+{
+    const uint8_t *ret = *p;
+
+    if (end - *p < size) {
+        replay_log_index_error();
+    }
+    *p += size;
+    return ret;
+}
+
+static void replay_log_parse_index(const uint8_t *p, const uint8_t *end)
+{
+    uint32_t n;
+    int i;
+
+    /* skip the offset of the previous index block */
+    replay_index_get(&p, end, 8);
+    n = ldl_be_p(replay_index_get(&p, end, 4));
+    for (i = 0; i < n; i++) {
+        ReplayBlockIndex e;
+
+        e.icount = ldq_be_p(replay_index_get(&p, end, 8));
+        e.offset = ldq_be_p(replay_index_get(&p, end, 8));
+        e.file_offset = ldq_be_p(replay_index_get(&p, end, 8));
+        g_array_append_val(block_index, e);
+    }
+    n = ldl_be_p(replay_index_get(&p, end, 4));
+    for (i = 0; i < n; i++) {
+        ReplaySnapshotIndex e;
+        uint32_t len;
+
+        e.icount = ldq_be_p(replay_index_get(&p, end, 8));
+        e.offset = ldq_be_p(replay_index_get(&p, end, 8));
+        len = ldl_be_p(replay_index_get(&p, end, 4));
+        e.name = g_strndup((const char *)replay_index_get(&p, end, len), len);
+        g_array_append_val(snapshot_index, e);
+    }
+}
+
+/* Follows the index blocks from the last one, and reads them in order */
+static void replay_log_read_index(void)
+{
+    GArray *offsets = g_array_new(false, false, sizeof(uint64_t));
+    uint64_t offset = index_offset;
+    uint8_t *data;
+    uint32_t size;
+    int i;
+
+    while (offset) {
+        if (offsets->len && offset >= g_array_index(offsets, uint64_t,
+                                                    offsets->len - 1)) {
+            replay_log_index_error();
+        }
+        g_array_append_val(offsets, offset);
+        data = replay_log_get_index(offset, &size);
+        offset = ldq_be_p(data);
+        g_free(data);
+    }
+
+    for (i = offsets->len - 1; i >= 0; i--) {
+        data = replay_log_get_index(g_array_index(offsets, uint64_t, i),
+                                    &size);
+        replay_log_parse_index(data, data + size);
+        g_free(data);
+    }
+    g_array_free(offsets, true);
+}
+
+static void replay_log_reserve(size_t size)
+{
+    if (read_alloc < size) {
+        read_alloc = size;
+        read_buf = g_realloc(read_buf, read_alloc);
+    }
+}
+
+/* Loads the block that follows the current one, returns false at the end */
+static bool replay_log_read_block(void)
+{
+    uint8_t header[REPLAY_BLOCK_HEADER_SIZE];
+    uint32_t size, stored;
+
+    log_offset += read_size;
+    read_size = read_pos = 0;
+
+    /*
+     * A block cut short is where the recording was interrupted, and
+     * counts as the end of the log.
+     */
+    for (;;) {
+        if (!replay_log_get(header, sizeof(header))) {
+            read_eof = true;
+            return false;
+        }
+        if (header[0] != REPLAY_BLOCK_INDEX) {
+            break;
+        }
+        if (fseek(replay_file, ldl_be_p(header + 5), SEEK_CUR)) {
+            read_eof = true;
+            return false;
+        }
+    }
+    size = ldl_be_p(header + 1);
+    stored = ldl_be_p(header + 5);
+    replay_log_reserve(size);
+
+    switch (header[0]) {
+    case REPLAY_BLOCK_RAW:
+        if (stored != size) {
+            return false;
+        }
+        if (!replay_log_get(read_buf, size)) {
+            read_eof = true;
+            return false;
+        }
+        break;
+    case REPLAY_BLOCK_ZSTD:
+#ifdef CONFIG_ZSTD
+        replay_log_zbuf_reserve(stored);
+        if (!replay_log_get(zbuf, stored)) {
+            read_eof = true;
+            return false;
+        }
+        if (ZSTD_decompress(read_buf, size, zbuf, stored) != size) {
+            return false;
+        }
+        break;
+#else
+        error_report("Replay: the log is compressed with zstd, "
+                     "which this build does not support");
+        exit(1);
+#endif
+    default:
+        return false;
+    }
+
+    read_size = size;
+    return true;
+}
+
+bool replay_log_read(uint8_t *buf, size_t size)
+{
+    while (size) {
+        size_t len;
+
+        if (read_pos == read_size && !replay_log_read_block()) {
+            return false;
+        }
+        len = MIN(size, read_size - read_pos);
+        memcpy(buf, read_buf + read_pos, len);
+        read_pos += len;
+        buf += len;
+        size -= len;
+    }
+    return true;
+}
+
+bool replay_log_eof(void)
+{
+    return read_eof;
+}
+
+uint64_t replay_log_tell(void)
+{
+    return log_offset + (replay_mode == REPLAY_MODE_PLAY ? read_pos : 0);
+}
+
+void replay_log_seek(uint64_t offset)
+{
+    uint64_t file_offset = HEADER_SIZE;
+    uint64_t start = 0;
+    int lo = 0, hi = block_index->len;
+
+    g_assert(replay_mode == REPLAY_MODE_PLAY);
+
+    /* Last block that starts at or before the offset */
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        ReplayBlockIndex *e =
+            &g_array_index(block_index, ReplayBlockIndex, mid);
+
+        if (e->offset <= offset) {
+            start = e->offset;
+            file_offset = e->file_offset;
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    /* Without an index, go forward from the current block if possible */
+    if (!block_index->len && offset >= log_offset) {
+        start = log_offset;
+        file_offset = ftell(replay_file);
+    } else {
+        if (fseek(replay_file, file_offset, SEEK_SET)) {
+            error_report("Replay: cannot seek in the log");
+            exit(1);
+        }
+        read_size = read_pos = 0;
+    }
+    log_offset = start;
+    read_eof = false;
+
+    while (offset > log_offset + read_size) {
+        if (!replay_log_read_block()) {
+            error_report("Replay: cannot seek in the log");
+            exit(1);
+        }
+    }
+    read_pos = offset - log_offset;
+}
+
+const char *replay_log_find_snapshot(uint64_t icount)
+{
+    const char *name = NULL;
+    uint64_t best = 0;
+    int i;
+
+    for (i = 0; i < snapshot_index->len; i++) {
+        ReplaySnapshotIndex *e =
+            &g_array_index(snapshot_index, ReplaySnapshotIndex, i);
+
+        if (e->icount <= icount && (!name || e->icount >= best)) {
+            name = e->name;
+            best = e->icount;
+        }
+    }
+    return name;
+}
+
+/* Setup */
+
+void replay_log_init(void)
+{
+    block_index = g_array_new(false, false, sizeof(ReplayBlockIndex));
+    snapshot_index = g_array_new(false, false, sizeof(ReplaySnapshotIndex));
+    log_offset = 0;
+
+    index_offset = 0;
+    blocks_indexed = snapshots_indexed = 0;
+
+    if (replay_mode == REPLAY_MODE_RECORD) {
+        /* Until the first index block, the log can only be replayed */
+        replay_log_write_header();
+        qemu_mutex_init(&writer_lock);
+        qemu_cond_init(&writer_cond);
+        writer_exit = false;
+        qemu_thread_create(&writer_thread, "replay-log", replay_log_writer,
+                           NULL, QEMU_THREAD_JOINABLE);
+    } else if (replay_mode == REPLAY_MODE_PLAY) {
+        uint8_t header[HEADER_SIZE];
+
+        if (!replay_log_get(header, sizeof(header))
+            || ldl_be_p(header) != REPLAY_VERSION) {
+            error_report("Replay: invalid input log file version");
+            exit(1);
+        }
+        index_offset = ldq_be_p(header + 4);
+        if (index_offset) {
+            replay_log_read_index();
+        }
+        /* go to the first block */
+        fseek(replay_file, HEADER_SIZE, SEEK_SET);
+        read_size = read_pos = 0;
+    }
+}
+
+void replay_log_finish(void)
+{
+    int i;
+
+    if (replay_mode == REPLAY_MODE_RECORD) {
+        replay_log_submit();
+
+        qemu_mutex_lock(&writer_lock);
+        writer_exit = true;
+        qemu_cond_broadcast(&writer_cond);
+        qemu_mutex_unlock(&writer_lock);
+        qemu_thread_join(&writer_thread);
+
+        if (blocks_indexed < block_index->len
+            || snapshots_indexed < snapshot_index->len) {
+            replay_log_write_index();
+        }
+    }
+
+    for (i = 0; i < snapshot_index->len; i++) {
+        g_free(g_array_index(snapshot_index, ReplaySnapshotIndex, i).name);
+    }
+    g_array_free(snapshot_index, true);
+    g_array_free(block_index, true);
+    g_free(read_buf);
+    read_buf = NULL;
+    read_size = read_pos = read_alloc = 0;
+    index_offset = 0;
+    read_eof = false;
+}
@@ -18,11 +18,12 @@
 #include "qemu/error-report.h"
 #include "migration/vmstate.h"
 #include "migration/snapshot.h"
+#include "sysemu/runstate.h"
 
 static int replay_pre_save(void *opaque)
 {
     ReplayState *state = opaque;
-    state->file_offset = ftell(replay_file);
+    state->file_offset = replay_log_tell();
 
     return 0;
 }
@@ -31,7 +32,7 @@ static int replay_post_load(void *opaque, int version_id)
 {
     ReplayState *state = opaque;
     if (replay_mode == REPLAY_MODE_PLAY) {
-        fseek(replay_file, state->file_offset, SEEK_SET);
+        replay_log_seek(state->file_offset);
         /* If this was a vmstate, saved in recording mode,
            we need to initialize replay data fields. */
         replay_fetch_data_kind();
@@ -97,3 +98,40 @@ bool replay_can_snapshot(void)
     return replay_mode == REPLAY_MODE_NONE
         || !replay_has_events();
 }
+
+void replay_snapshot_saved(const char *name)
+{
+    if (replay_mode == REPLAY_MODE_RECORD && !replay_mttcg) {
+        replay_log_snapshot(name, replay_get_current_icount());
+    }
+}
+
+void replay_seek(int64_t icount, Error **errp)
+{
+    const char *name;
+    bool saved_vm_running;
+
+    if (replay_mode != REPLAY_MODE_PLAY) {
+        error_setg(errp, "replay_seek is only available in replay mode");
+        return;
+    }
+    if (replay_mttcg) {
+        /* The logs of the vCPUs are not in the snapshots */
+        error_setg(errp, "replay_seek is not supported with multi-threaded "
+                   "TCG");
+        return;
+    }
+
+    name = replay_log_find_snapshot(icount);
+    if (!name) {
+        error_setg(errp, "no snapshot in the replay log before "
+                   "instruction %" PRId64, icount);
+        return;
+    }
+
+    saved_vm_running = runstate_is_running();
+    vm_stop(RUN_STATE_RESTORE_VM);
+    if (load_snapshot(name, errp) == 0 && saved_vm_running) {
+        vm_start();
+    }
+}
@@ -0,0 +1,233 @@
+/*
+ * replay-vcpu.c
+ *
+ * Ordering points of the vCPU threads with multi-threaded TCG
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/error-report.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
+#include "sysemu/replay.h"
+#include "sysemu/runstate.h"
+#include "hw/core/cpu.h"
+#include "replay-internal.h"
+
+typedef enum ReplayVCPUTurn {
+    REPLAY_TURN_NONE,
+    /* until replay_vcpu_sync_end */
+    REPLAY_TURN_SCOPED,
+    /* until the vCPU releases the BQL */
+    REPLAY_TURN_BQL,
+} ReplayVCPUTurn;
+
+/*
+ * Each vCPU logs its ordering points to a file of its own, as the kind
+ * of the point followed by the number of instructions that the vCPU
+ * executed before it.  Only the vCPU thread accesses it.
+ */
+typedef struct ReplayVCPU {
+    FILE *file;
+    ReplayVCPUTurn turn;
+    /* Next ordering point in replay mode, REPLAY_SYNC_COUNT at the end */
+    ReplaySyncKind next_kind;
+    int64_t next_icount;
+} ReplayVCPU;
+
+#define REPLAY_VCPU_ENTRY_SIZE (1 + sizeof(uint64_t))
+
+static void replay_vcpu_read_next(CPUState *cpu, ReplayVCPU *vc)
+{
+    uint8_t buf[REPLAY_VCPU_ENTRY_SIZE];
+    size_t len = fread(buf, 1, sizeof(buf), vc->file);
+
+    if (len == 0 && feof(vc->file)) {
+        error_report("replay file of CPU %d is over", cpu->cpu_index);
+        vc->next_kind = REPLAY_SYNC_COUNT;
+        vc->next_icount = cpu->icount_total;
+        qemu_system_vmstop_request_prepare();
+        qemu_system_vmstop_request(RUN_STATE_PAUSED);
+        return;
+    }
+    if (len != sizeof(buf) || buf[0] >= REPLAY_SYNC_COUNT) {
+        error_report("error reading the replay data of CPU %d",
+                     cpu->cpu_index);
+        exit(1);
+    }
+    vc->next_kind = buf[0];
+    vc->next_icount = ldq_be_p(buf + 1);
+}
+
+static void replay_vcpu_write(CPUState *cpu, ReplayVCPU *vc,
+                              ReplaySyncKind kind, int64_t icount)
+{
+    uint8_t buf[REPLAY_VCPU_ENTRY_SIZE];
+
+    buf[0] = kind;
+    stq_be_p(buf + 1, icount);
+    if (fwrite(buf, 1, sizeof(buf), vc->file) != sizeof(buf)) {
+        error_report("replay write error for CPU %d", cpu->cpu_index);
+        exit(1);
+    }
+}
+
+static ReplayVCPU *replay_vcpu_get(CPUState *cpu)
+{
+    ReplayVCPU *vc = cpu->replay_vcpu;
+    char *fname;
+
+    if (vc) {
+        return vc;
+    }
+
+    fname = replay_get_vcpu_filename(cpu->cpu_index);
+    vc = g_new0(ReplayVCPU, 1);
+    vc->file = fopen(fname,
+                     replay_mode == REPLAY_MODE_RECORD ? "wb" : "rb");
+    if (!vc->file) {
+        error_report("Replay: open %s: %s", fname, strerror(errno));
+        exit(1);
+    }
+    g_free(fname);
+
+    if (replay_mode == REPLAY_MODE_PLAY) {
+        replay_vcpu_read_next(cpu, vc);
+    }
+    atomic_set(&cpu->replay_vcpu, vc);
+    return vc;
+}
+
+/*
+ * Takes the turn of the vCPU at its current instruction count.  In replay
+ * mode this only happens if the log has the same ordering point next;
+ * a deterministic point that is not in the log means that the execution
+ * diverged.
+ */
+static bool replay_vcpu_take_turn(CPUState *cpu, ReplaySyncKind kind,
+                                  ReplayVCPUTurn turn)
+{
+    ReplayVCPU *vc = replay_vcpu_get(cpu);
+    int64_t icount;
+
+    cpu_update_icount(cpu);
+    icount = cpu->icount_total;
+
+    if (replay_mode == REPLAY_MODE_PLAY) {
+        if (vc->next_kind == REPLAY_SYNC_COUNT) {
+            return false;
+        }
+        if (vc->next_kind != kind || vc->next_icount != icount) {
+            if (kind == REPLAY_SYNC_LOCK || vc->next_icount < icount) {
+                error_report("Replay: CPU %d diverged from the log "
+                             "at instruction %" PRId64,
+                             cpu->cpu_index, icount);
+                exit(1);
+            }
+            return false;
+        }
+    }
+
+    replay_mutex_lock_vcpu(cpu);
+    vc->turn = turn;
+    /* Publish the instructions executed up to this point */
+    cpu_update_icount(cpu);
+
+    if (replay_mode == REPLAY_MODE_RECORD) {
+        replay_vcpu_write(cpu, vc, kind, icount);
+    } else {
+        replay_vcpu_read_next(cpu, vc);
+    }
+    return true;
+}
+
+bool replay_vcpu_in_sync(CPUState *cpu)
+{
+    return cpu->replay_vcpu && cpu->replay_vcpu->turn != REPLAY_TURN_NONE;
+}
+
+static bool replay_vcpu_can_sync(CPUState *cpu)
+{
+    /*
+     * Exclusive sections already run alone; and with the BQL held
+     * without a turn, taking one would invert the lock order.
+     */
+    return replay_mttcg && !cpu_in_exclusive_context(cpu)
+        && !qemu_mutex_iothread_locked() && !replay_vcpu_in_sync(cpu);
+}
+
+bool replay_vcpu_sync_begin(CPUState *cpu, ReplaySyncKind kind)
+{
+    if (!replay_vcpu_can_sync(cpu)) {
+        return false;
+    }
+    return replay_vcpu_take_turn(cpu, kind, REPLAY_TURN_SCOPED);
+}
+
+void replay_vcpu_sync_end(CPUState *cpu)
+{
+    ReplayVCPU *vc = cpu->replay_vcpu;
+
+    if (vc && vc->turn != REPLAY_TURN_NONE) {
+        vc->turn = REPLAY_TURN_NONE;
+        replay_mutex_unlock();
+    }
+}
+
+bool replay_vcpu_sync_poll(CPUState *cpu, ReplaySyncKind kind, bool pending)
+{
+    if (!replay_vcpu_can_sync(cpu)) {
+        return pending;
+    }
+    if (replay_mode == REPLAY_MODE_RECORD && !pending) {
+        return false;
+    }
+    return replay_vcpu_take_turn(cpu, kind, REPLAY_TURN_BQL);
+}
+
+void replay_vcpu_sync_iothread_unlocked(CPUState *cpu)
+{
+    ReplayVCPU *vc = cpu->replay_vcpu;
+
+    if (vc && vc->turn == REPLAY_TURN_BQL) {
+        vc->turn = REPLAY_TURN_NONE;
+        replay_mutex_unlock();
+    }
+}
+
+bool replay_vcpu_sync_pending(CPUState *cpu, ReplaySyncKind kind)
+{
+    ReplayVCPU *vc;
+
+    if (!replay_mttcg || replay_mode != REPLAY_MODE_PLAY) {
+        return false;
+    }
+    vc = replay_vcpu_get(cpu);
+    return vc->next_kind == kind && vc->next_icount == cpu->icount_total;
+}
+
+int64_t replay_vcpu_get_instructions(CPUState *cpu)
+{
+    ReplayVCPU *vc = replay_vcpu_get(cpu);
+
+    return MAX(vc->next_icount - cpu->icount_total, 0);
+}
+
+void replay_finish_vcpus(void)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        ReplayVCPU *vc = cpu->replay_vcpu;
+
+        if (vc) {
+            atomic_set(&cpu->replay_vcpu, NULL);
+            fclose(vc->file);
+            g_free(vc);
+        }
+    }
+}
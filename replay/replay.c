@@ -18,16 +18,12 @@
 #include "qemu/main-loop.h"
 #include "qemu/option.h"
 #include "sysemu/cpus.h"
+#include "hw/core/cpu.h"
 #include "qemu/error-report.h"
 
-/* Current version of the replay mechanism.
-   Increase it when file format changes. */
-#define REPLAY_VERSION              0xe0200a
-/* Size of replay log header */
-#define HEADER_SIZE                 (sizeof(uint32_t) + sizeof(uint64_t))
-
 ReplayMode replay_mode = REPLAY_MODE_NONE;
 char *replay_snapshot;
+bool replay_mttcg;
 
 /* Name of replay file  */
 static char *replay_filename;
@@ -105,6 +101,10 @@ void replay_account_executed_instructions(void)
 
 bool replay_exception(void)
 {
+    /* The vCPU logs only determine when it handles them */
+    if (replay_mttcg) {
+        return true;
+    }
 
     if (replay_mode == REPLAY_MODE_RECORD) {
         g_assert(replay_mutex_locked());
@@ -126,7 +126,7 @@ bool replay_exception(void)
 bool replay_has_exception(void)
 {
     bool res = false;
-    if (replay_mode == REPLAY_MODE_PLAY) {
+    if (replay_mode == REPLAY_MODE_PLAY && !replay_mttcg) {
         g_assert(replay_mutex_locked());
         replay_account_executed_instructions();
         res = replay_next_event_is(EVENT_EXCEPTION);
@@ -137,6 +137,11 @@ bool replay_has_exception(void)
 
 bool replay_interrupt(void)
 {
+    /* The vCPU logs only determine when it handles them */
+    if (replay_mttcg) {
+        return true;
+    }
+
     if (replay_mode == REPLAY_MODE_RECORD) {
         g_assert(replay_mutex_locked());
         replay_save_instructions();
@@ -156,8 +161,8 @@ bool replay_interrupt(void)
 
 bool replay_has_interrupt(void)
 {
-    bool res = false;
-    if (replay_mode == REPLAY_MODE_PLAY) {
+    bool res = replay_mttcg;
+    if (replay_mode == REPLAY_MODE_PLAY && !replay_mttcg) {
         g_assert(replay_mutex_locked());
         replay_account_executed_instructions();
         res = replay_next_event_is(EVENT_INTERRUPT);
@@ -278,16 +283,8 @@ static void replay_enable(const char *fname, int mode)
     replay_state.has_unread_data = 0;
 
     /* skip file header for RECORD and check it for PLAY */
-    if (replay_mode == REPLAY_MODE_RECORD) {
-        fseek(replay_file, HEADER_SIZE, SEEK_SET);
-    } else if (replay_mode == REPLAY_MODE_PLAY) {
-        unsigned int version = replay_get_dword();
-        if (version != REPLAY_VERSION) {
-            fprintf(stderr, "Replay: invalid input log file version\n");
-            exit(1);
-        }
-        /* go to the beginning */
-        fseek(replay_file, HEADER_SIZE, SEEK_SET);
+    replay_log_init();
+    if (replay_mode == REPLAY_MODE_PLAY) {
         replay_fetch_data_kind();
     }
 
@@ -350,6 +347,12 @@ void replay_start(void)
         exit(1);
     }
 
+    /*
+     * Each vCPU thread keeps its own instruction count in a log of its own,
+     * instead of EVENT_INSTRUCTION in the main one.
+     */
+    replay_mttcg = qemu_tcg_mttcg_enabled();
+
     /* Timer for snapshotting will be set up here. */
 
     replay_enable_events();
@@ -363,6 +366,11 @@ void replay_finish(void)
 
     replay_save_instructions();
 
+    if (replay_mttcg) {
+        replay_mttcg = false;
+        replay_finish_vcpus();
+    }
+
     /* finalize the file */
     if (replay_file) {
         if (replay_mode == REPLAY_MODE_RECORD) {
@@ -373,12 +381,10 @@ void replay_finish(void)
             replay_shutdown_request(SHUTDOWN_CAUSE_HOST_SIGNAL);
             /* write end event */
             replay_put_event(EVENT_END);
-
-            /* write header */
-            fseek(replay_file, 0, SEEK_SET);
-            replay_put_dword(REPLAY_VERSION);
         }
 
+        /* flush the blocks and write the index and the header */
+        replay_log_finish();
         fclose(replay_file);
         replay_file = NULL;
     }
@@ -395,6 +401,11 @@ void replay_finish(void)
     replay_finish_events();
 }
 
+char *replay_get_vcpu_filename(int index)
+{
+    return g_strdup_printf("%s.cpu%d", replay_filename, index);
+}
+
 void replay_add_blocker(Error *reason)
 {
     replay_blockers = g_slist_prepend(replay_blockers, reason);
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+
+#  Compare the guest speed, in millions of guest instructions per
+#  second, without icount, with icount and with icount in fast-forward
+#  mode.
+#
+#  Syntax:
+#  icount-mips.py [-h] -p PLUGIN [-s SHIFT] [-r RUNS] -- \
+#                 <qemu executable> [<qemu executable options>]
+#
+#  [-h] - Print the script arguments help message.
+#  -p PLUGIN - Path to the libinsn.so plugin from tests/plugin.
+#  [-s SHIFT] - icount shift to use (default 0).
+#  [-r RUNS] - Number of runs per mode, the best one is kept (default 3).
+#
+#  The guest must power off by itself when it is done, for example a
+#  kernel that halts at the end of a benchmark, with -no-reboot.
+#
+#  Example of usage:
+#  icount-mips.py -p build/tests/plugin/libinsn.so -- \
+#      qemu-system-arm -M mps2-an385 -kernel bench.elf -nographic \
+#      -semihosting -no-reboot
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+
+def run_qemu(command, plugin, icount):
+    """
+    Run QEMU once and count the guest instructions it executed
+
+    Parameters:
+    command (list): QEMU command line
+    plugin (str): path to the libinsn.so plugin
+    icount (str): -icount option, or None
+
+    Returns:
+    (int, float): number of instructions, elapsed seconds
+    """
+    with tempfile.TemporaryDirectory() as tmpdir:
+        log = os.path.join(tmpdir, "insn.log")
+        cmd = command + ["-plugin", plugin + ",arg=inline",
+                         "-d", "plugin", "-D", log]
+        if icount:
+            cmd += ["-icount", icount]
+
+        start = time.perf_counter()
+        run = subprocess.run(cmd, stdout=subprocess.DEVNULL)
+        elapsed = time.perf_counter() - start
+        if run.returncode:
+            sys.exit("Error: QEMU exited with status {}: {}".format(
+                run.returncode, " ".join(cmd)))
+
+        with open(log, "r") as f:
+            match = re.search(r"insns: (\d+)", f.read())
+        if not match:
+            sys.exit("Error: no instruction count in the plugin output")
+        return int(match.group(1)), elapsed
+
+
+def main():
+    # Parse the command line arguments
+    parser = argparse.ArgumentParser(
+        usage='icount-mips.py [-h] -p PLUGIN [-s SHIFT] [-r RUNS] -- '
+        '<qemu executable> [<qemu executable options>]')
+
+    parser.add_argument('-p', dest='plugin', type=str, required=True,
+                        help='path to the libinsn.so plugin')
+    parser.add_argument('-s', dest='shift', type=int, default=0,
+                        help='icount shift (default 0)')
+    parser.add_argument('-r', dest='runs', type=int, default=3,
+                        help='runs per mode, the best one is kept '
+                        '(default 3)')
+    parser.add_argument('command', type=str, nargs='+', help=argparse.SUPPRESS)
+
+    args = parser.parse_args()
+
+    modes = [
+        ("icount off", None),
+        ("icount sleep=on", "shift={}".format(args.shift)),
+        ("icount sleep=off", "shift={},sleep=off".format(args.shift)),
+        ("icount fast=on", "shift={},fast=on".format(args.shift)),
+    ]
+
+    print("{:<20}{:>16}{:>12}{:>10}".format("mode", "instructions",
+                                           "seconds", "MIPS"))
+    for name, icount in modes:
+        best = None
+        for _ in range(args.runs):
+            insns, elapsed = run_qemu(args.command, args.plugin, icount)
+            if best is None or elapsed < best[1]:
+                best = (insns, elapsed)
+        insns, elapsed = best
+        print("{:<20}{:>16}{:>12.3f}{:>10.1f}".format(
+            name, insns, elapsed, insns / elapsed / 1e6))
+
+
+if __name__ == "__main__":
+    main()
@@ -134,6 +134,11 @@ static bool all_cpu_threads_idle(void)
 /* Protected by TimersState seqlock */
 
 static bool icount_sleep = true;
+/* Warp QEMU_CLOCK_VIRTUAL from the vCPU thread, see icount_fast_forward */
+static bool icount_fast;
+
+static void do_nothing(CPUState *cpu, run_on_cpu_data unused);
+
 /* Arbitrarily pick 1MIPS as the minimum allowable speed.  */
 #define MAX_ICOUNT_SHIFT 10
 
@@ -192,6 +197,21 @@ static void cpu_update_icount_locked(CPUState *cpu)
     int64_t executed = cpu_get_icount_executed(cpu);
     cpu->icount_budget -= executed;
 
+    /*
+     * With several vCPU threads, their instructions only count for the
+     * virtual clock at their ordering points, so that it does not depend
+     * on how their execution interleaves.
+     */
+    if (replay_mttcg) {
+        cpu->icount_total += executed;
+        cpu->icount_pending += executed;
+        if (!replay_vcpu_in_sync(cpu)) {
+            return;
+        }
+        executed = cpu->icount_pending;
+        cpu->icount_pending = 0;
+    }
+
     atomic_set_i64(&timers_state.qemu_icount,
                    timers_state.qemu_icount + executed);
 }
@@ -233,8 +253,19 @@ static int64_t cpu_get_icount_locked(void)
         cpu_icount_to_ns(icount);
 }
 
+/*
+ * A read from a running vCPU is an ordering point for record/replay with
+ * MTTCG, because the value depends on what the other vCPUs executed.
+ */
+static bool cpu_icount_sync_begin(void)
+{
+    return unlikely(replay_mttcg) && current_cpu && current_cpu->running &&
+           replay_vcpu_sync_begin(current_cpu, REPLAY_SYNC_LOCK);
+}
+
 int64_t cpu_get_icount_raw(void)
 {
+    bool sync = cpu_icount_sync_begin();
     int64_t icount;
     unsigned start;
 
@@ -243,12 +274,16 @@ int64_t cpu_get_icount_raw(void)
         icount = cpu_get_icount_raw_locked();
     } while (seqlock_read_retry(&timers_state.vm_clock_seqlock, start));
 
+    if (sync) {
+        replay_vcpu_sync_end(current_cpu);
+    }
     return icount;
 }
 
 /* Return the virtual CPU time, based on the instruction counter.  */
 int64_t cpu_get_icount(void)
 {
+    bool sync = cpu_icount_sync_begin();
     int64_t icount;
     unsigned start;
 
@@ -257,6 +292,9 @@ int64_t cpu_get_icount(void)
         icount = cpu_get_icount_locked();
     } while (seqlock_read_retry(&timers_state.vm_clock_seqlock, start));
 
+    if (sync) {
+        replay_vcpu_sync_end(current_cpu);
+    }
     return icount;
 }
 
@@ -520,6 +558,20 @@ void qemu_start_warp_timer(void)
         return;
     }
 
+    if (icount_fast) {
+        /*
+         * The vCPU thread warps the clock itself, but it waits while
+         * timers are due in an AioContext; once they ran, wake it up
+         * so that it warps to the next deadline.
+         */
+        if (runstate_is_running() && first_cpu && all_cpu_threads_idle() &&
+            qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL,
+                                       ~QEMU_TIMER_ATTR_EXTERNAL) > 0) {
+            async_run_on_cpu(first_cpu, do_nothing, RUN_ON_CPU_NULL);
+        }
+        return;
+    }
+
     /* Nothing to do if the VM is stopped: QEMU_CLOCK_VIRTUAL timers
      * do not fire, so computing the deadline does not make sense.
      */
@@ -745,15 +797,35 @@ void configure_icount(QemuOpts *opts, Error **errp)
     const char *option = qemu_opt_get(opts, "shift");
     bool sleep = qemu_opt_get_bool(opts, "sleep", true);
     bool align = qemu_opt_get_bool(opts, "align", false);
+    bool fast = qemu_opt_get_bool(opts, "fast", false);
     long time_shift = -1;
 
     if (!option) {
         if (qemu_opt_get(opts, "align") != NULL) {
             error_setg(errp, "Please specify shift option when using align");
         }
+        if (fast) {
+            error_setg(errp, "Please specify shift option when using fast");
+        }
         return;
     }
 
+    if (fast) {
+        if (qemu_opt_get(opts, "sleep") != NULL && sleep) {
+            error_setg(errp, "fast=on and sleep=on are incompatible");
+            return;
+        }
+        if (qemu_opt_get(opts, "rr") != NULL) {
+            error_setg(errp, "fast=on and record/replay are incompatible");
+            return;
+        }
+        if (strcmp(option, "auto") == 0) {
+            error_setg(errp, "shift=auto and fast=on are incompatible");
+            return;
+        }
+        sleep = false;
+    }
+
     if (align && !sleep) {
         error_setg(errp, "align=on and sleep=off are incompatible");
         return;
@@ -774,6 +846,7 @@ void configure_icount(QemuOpts *opts, Error **errp)
     }
 
     icount_sleep = sleep;
+    icount_fast = fast;
     if (icount_sleep) {
         timers_state.icount_warp_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL_RT,
                                          icount_timer_cb, NULL);
@@ -1070,12 +1143,19 @@ static QemuCond qemu_cpu_cond;
 /* system init */
 static QemuCond qemu_pause_cond;
 
+/* A vCPU sleeping in a polling loop of the guest */
+static QemuMutex poll_sleep_lock;
+static QemuCond poll_sleep_cond;
+static int poll_sleep_waiters;
+
 void qemu_init_cpu_loop(void)
 {
     qemu_init_sigbus();
     qemu_cond_init(&qemu_cpu_cond);
     qemu_cond_init(&qemu_pause_cond);
     qemu_mutex_init(&qemu_global_mutex);
+    qemu_mutex_init(&poll_sleep_lock);
+    qemu_cond_init(&poll_sleep_cond);
 
     qemu_thread_get_self(&io_thread);
 }
@@ -1258,10 +1338,16 @@ static int64_t tcg_get_icount_limit(void)
          */
         deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL,
                                               QEMU_TIMER_ATTR_ALL);
-        /* Check realtime timers, because they help with input processing */
-        deadline = qemu_soonest_timeout(deadline,
-                qemu_clock_deadline_ns_all(QEMU_CLOCK_REALTIME,
-                                           QEMU_TIMER_ATTR_ALL));
+        /*
+         * Check realtime timers, because they help with input processing.
+         * Fast-forward mode does without them, so that the budget only
+         * depends on virtual time.
+         */
+        if (!icount_fast) {
+            deadline = qemu_soonest_timeout(deadline,
+                    qemu_clock_deadline_ns_all(QEMU_CLOCK_REALTIME,
+                                               QEMU_TIMER_ATTR_ALL));
+        }
 
         /* Maintain prior (possibly buggy) behaviour where if no deadline
          * was set (as there is no QEMU_CLOCK_VIRTUAL timer) or it is more than
@@ -1298,6 +1384,50 @@ static void handle_icount_deadline(void)
     }
 }
 
+/*
+ * In fast-forward mode, the vCPU thread itself warps QEMU_CLOCK_VIRTUAL
+ * to the next deadline once all vCPUs are idle, and runs the timers that
+ * are due.  This avoids a round trip through the main loop for every
+ * idle period, and keeps the host clock out of the picture.
+ *
+ * Returns true if the clock was warped, and false if there is no timer
+ * to wait for or if the next one is already due.
+ */
+static bool icount_fast_forward(void)
+{
+    int64_t deadline;
+
+    assert(qemu_in_vcpu_thread());
+    if (!runstate_is_running()) {
+        return false;
+    }
+
+    deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL,
+                                          ~QEMU_TIMER_ATTR_EXTERNAL);
+    if (deadline < 0) {
+        return false;
+    }
+
+    if (deadline == 0) {
+        /*
+         * Expired timers of the main loop run here, but those of other
+         * AioContexts only run in their own thread: wait for them, see
+         * qemu_start_warp_timer.
+         */
+        notify_aio_contexts();
+        return false;
+    }
+
+    seqlock_write_lock(&timers_state.vm_clock_seqlock,
+                       &timers_state.vm_clock_lock);
+    atomic_set_i64(&timers_state.qemu_icount_bias,
+                   timers_state.qemu_icount_bias + deadline);
+    seqlock_write_unlock(&timers_state.vm_clock_seqlock,
+                         &timers_state.vm_clock_lock);
+    notify_aio_contexts();
+    return true;
+}
+
 static void prepare_icount_for_run(CPUState *cpu)
 {
     if (use_icount) {
@@ -1487,6 +1617,14 @@ static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
         }
 
         if (use_icount && all_cpu_threads_idle()) {
+            /*
+             * Go round the loop again rather than spinning here, so
+             * that the main loop gets a chance to take the BQL.
+             */
+            if (icount_fast && icount_fast_forward()) {
+                continue;
+            }
+
             /*
              * When all cpus are sleeping (e.g in WFI), to avoid a deadlock
              * in the main_loop, wake it up in order to start the warp timer.
@@ -1699,6 +1837,191 @@ static void *qemu_tcg_cpu_thread_fn(void *arg)
     return NULL;
 }
 
+/* Multi-threaded TCG with record/replay
+ *
+ * When recording, each vCPU thread logs the ordering points where it
+ * takes the replay_lock, see replay/replay-vcpu.c.  When replaying, the
+ * budget of each execution ends at the next ordering point in the log,
+ * and the vCPU only takes the BQL out of turn when it needs to stop.
+ */
+
+static void qemu_mutex_lock_iothread_untracked(void);
+
+/*
+ * Set while the vCPU thread runs its queued work: the work items drop and
+ * retake the BQL at times that depend on the other vCPUs (e.g. a tb_flush
+ * when one of them fills the translation buffer), so these acquisitions
+ * are not ordering points.
+ */
+static __thread bool iothread_replay_untracked;
+
+static void tcg_replay_prepare_icount(CPUState *cpu, int64_t budget)
+{
+    int insns_left;
+
+    g_assert(cpu_neg(cpu)->icount_decr.u16.low == 0);
+    g_assert(cpu->icount_extra == 0);
+
+    cpu->icount_budget = budget;
+    insns_left = MIN(0xffff, cpu->icount_budget);
+    cpu_neg(cpu)->icount_decr.u16.low = insns_left;
+    cpu->icount_extra = cpu->icount_budget - insns_left;
+}
+
+static void tcg_replay_process_icount(CPUState *cpu)
+{
+    cpu_update_icount(cpu);
+
+    cpu_neg(cpu)->icount_decr.u16.low = 0;
+    cpu->icount_extra = 0;
+    cpu->icount_budget = 0;
+}
+
+static int tcg_replay_cpu_exec(CPUState *cpu)
+{
+    int r;
+
+    if (replay_mode == REPLAY_MODE_PLAY) {
+        tcg_replay_prepare_icount(cpu, replay_vcpu_get_instructions(cpu));
+    } else {
+        tcg_replay_prepare_icount(cpu, tcg_get_icount_limit());
+    }
+    r = tcg_cpu_exec(cpu);
+    tcg_replay_process_icount(cpu);
+    return r;
+}
+
+static void qemu_tcg_replay_stop(CPUState *cpu, int r)
+{
+    if (r == EXCP_DEBUG) {
+        cpu_handle_guest_debug(cpu);
+    }
+    while (cpu->stop || cpu_is_stopped(cpu)) {
+        if (cpu->stop) {
+            qemu_cpu_stop(cpu, false);
+        }
+        qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
+    }
+}
+
+void qemu_cpu_replay_park(CPUState *cpu)
+{
+    qemu_mutex_lock_iothread_untracked();
+    qemu_tcg_replay_stop(cpu, 0);
+    qemu_mutex_unlock_iothread();
+}
+
+static void qemu_tcg_replay_wait_io_event(CPUState *cpu)
+{
+    bool slept = false;
+
+    while (cpu_thread_is_idle(cpu) &&
+           !replay_vcpu_sync_pending(cpu, REPLAY_SYNC_IDLE)) {
+        if (!slept) {
+            slept = true;
+            qemu_plugin_vcpu_idle_cb(cpu);
+            /* Let the other threads take their turns meanwhile */
+            replay_vcpu_sync_end(cpu);
+            /* Wake up the main loop to start the warp timer, if needed */
+            if (all_cpu_threads_idle()) {
+                qemu_notify_event();
+            }
+        }
+        qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
+    }
+    if (slept) {
+        qemu_plugin_vcpu_resume_cb(cpu);
+    }
+
+    /* The wakeup is an ordering point */
+    if (slept || replay_vcpu_sync_pending(cpu, REPLAY_SYNC_IDLE)) {
+        replay_vcpu_sync_end(cpu);
+        qemu_mutex_unlock_iothread();
+        if (replay_vcpu_poll(cpu, REPLAY_SYNC_IDLE, true)) {
+            qemu_mutex_lock_iothread();
+        } else {
+            qemu_mutex_lock_iothread_untracked();
+        }
+    }
+    iothread_replay_untracked = true;
+    qemu_wait_io_event_common(cpu);
+    iothread_replay_untracked = false;
+}
+
+static void *qemu_tcg_replay_cpu_thread_fn(void *arg)
+{
+    CPUState *cpu = arg;
+
+    assert(tcg_enabled());
+    g_assert(use_icount && replay_mode != REPLAY_MODE_NONE);
+
+    rcu_register_thread();
+    tcg_register_thread();
+
+    qemu_mutex_lock_iothread();
+    qemu_thread_get_self(cpu->thread);
+
+    cpu->thread_id = qemu_get_thread_id();
+    cpu->created = true;
+    cpu->can_do_io = 1;
+    current_cpu = cpu;
+    qemu_cond_signal(&qemu_cpu_cond);
+    qemu_guest_random_seed_thread_part2(cpu->random_seed);
+
+    /* process any pending work */
+    cpu->exit_request = 1;
+
+    do {
+        if (cpu_can_run(cpu)) {
+            int r;
+            qemu_mutex_unlock_iothread();
+            r = tcg_replay_cpu_exec(cpu);
+            if (!replay_vcpu_poll(cpu, REPLAY_SYNC_EXIT, true)) {
+                /*
+                 * Replaying, and short of the next ordering point: only
+                 * stop here if requested or for queued work, and otherwise
+                 * carry on.
+                 */
+                qemu_mutex_lock_iothread_untracked();
+                qemu_tcg_replay_stop(cpu, r);
+                if (r != EXCP_HALTED && cpu_work_list_empty(cpu)) {
+                    continue;
+                }
+            } else {
+                qemu_mutex_lock_iothread();
+                switch (r) {
+                case EXCP_DEBUG:
+                    cpu_handle_guest_debug(cpu);
+                    break;
+                case EXCP_HALTED:
+                    g_assert(cpu->halted);
+                    break;
+                case EXCP_ATOMIC:
+                    qemu_mutex_unlock_iothread();
+                    tcg_replay_prepare_icount(cpu, 1);
+                    cpu_exec_step_atomic(cpu);
+                    tcg_replay_process_icount(cpu);
+                    qemu_mutex_lock_iothread();
+                default:
+                    /* Ignore everything else? */
+                    break;
+                }
+                handle_icount_deadline();
+            }
+        }
+
+        atomic_mb_set(&cpu->exit_request, 0);
+        qemu_tcg_replay_wait_io_event(cpu);
+    } while (!cpu->unplug || cpu_can_run(cpu));
+
+    qemu_tcg_destroy_vcpu(cpu);
+    cpu->created = false;
+    qemu_cond_signal(&qemu_cpu_cond);
+    qemu_mutex_unlock_iothread();
+    rcu_unregister_thread();
+    return NULL;
+}
+
 static void qemu_cpu_kick_thread(CPUState *cpu)
 {
 #ifndef _WIN32
@@ -1735,6 +2058,7 @@ void qemu_cpu_kick(CPUState *cpu)
         } else {
             qemu_cpu_kick_rr_cpus();
         }
+        qemu_cpu_poll_wake();
     } else {
         if (hax_enabled()) {
             /*
@@ -1747,6 +2071,29 @@ void qemu_cpu_kick(CPUState *cpu)
     }
 }
 
+void qemu_cpu_poll_sleep(CPUState *cpu, int ms)
+{
+    qemu_mutex_lock(&poll_sleep_lock);
+    atomic_inc(&poll_sleep_waiters);
+    /* Pairs with the barrier in qemu_cpu_poll_wake */
+    smp_mb();
+    if (!atomic_read(&cpu->exit_request)) {
+        qemu_cond_timedwait(&poll_sleep_cond, &poll_sleep_lock, ms);
+    }
+    atomic_dec(&poll_sleep_waiters);
+    qemu_mutex_unlock(&poll_sleep_lock);
+}
+
+void qemu_cpu_poll_wake(void)
+{
+    smp_mb();
+    if (unlikely(atomic_read(&poll_sleep_waiters))) {
+        qemu_mutex_lock(&poll_sleep_lock);
+        qemu_cond_broadcast(&poll_sleep_cond);
+        qemu_mutex_unlock(&poll_sleep_lock);
+    }
+}
+
 void qemu_cpu_kick_self(void)
 {
     assert(current_cpu);
@@ -1779,6 +2126,11 @@ void qemu_mutex_lock_iothread_impl(const char *file, int line)
     QemuMutexLockFunc bql_lock = atomic_read(&qemu_bql_mutex_lock_func);
 
     g_assert(!qemu_mutex_iothread_locked());
+    /* With record/replay and MTTCG, the vCPU takes its turn first */
+    if (unlikely(replay_mttcg) && qemu_in_vcpu_thread() &&
+        !iothread_replay_untracked) {
+        replay_vcpu_sync_poll(current_cpu, REPLAY_SYNC_LOCK, true);
+    }
     bql_lock(&qemu_global_mutex, file, line);
     iothread_locked = true;
 }
@@ -1788,6 +2140,20 @@ void qemu_mutex_unlock_iothread(void)
     g_assert(qemu_mutex_iothread_locked());
     iothread_locked = false;
     qemu_mutex_unlock(&qemu_global_mutex);
+    if (unlikely(replay_mttcg) && qemu_in_vcpu_thread()) {
+        replay_vcpu_sync_iothread_unlocked(current_cpu);
+    }
+}
+
+/*
+ * For a vCPU thread that is not at an ordering point of the replay log,
+ * or that waits for its turn.
+ */
+static void qemu_mutex_lock_iothread_untracked(void)
+{
+    g_assert(!qemu_mutex_iothread_locked());
+    qemu_mutex_lock(&qemu_global_mutex);
+    iothread_locked = true;
 }
 
 void qemu_cond_wait_iothread(QemuCond *cond)
@@ -1917,7 +2283,9 @@ static void qemu_tcg_init_vcpu(CPUState *cpu)
             snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "CPU %d/TCG",
                  cpu->cpu_index);
 
-            qemu_thread_create(cpu->thread, thread_name, qemu_tcg_cpu_thread_fn,
+            qemu_thread_create(cpu->thread, thread_name,
+                               use_icount ? qemu_tcg_replay_cpu_thread_fn
+                                          : qemu_tcg_cpu_thread_fn,
                                cpu, QEMU_THREAD_JOINABLE);
 
         } else {
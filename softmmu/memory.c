@@ -699,8 +699,32 @@ static MemoryRegion *memory_region_get_flatview_root(MemoryRegion *mr)
     return NULL;
 }
 
-/* Render a memory topology into a list of disjoint absolute ranges. */
-static FlatView *generate_memory_topology(MemoryRegion *mr)
+/* Check whether two views would produce the same dispatch and listener
+ * callbacks.
+ */
+static bool flatview_equal(FlatView *a, FlatView *b)
+{
+    unsigned i;
+
+    if (a->nr != b->nr) {
+        return false;
+    }
+    for (i = 0; i < a->nr; i++) {
+        if (!flatrange_equal(&a->ranges[i], &b->ranges[i])
+            || a->ranges[i].dirty_log_mask != b->ranges[i].dirty_log_mask) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Render a memory topology into a list of disjoint absolute ranges.
+ *
+ * If @old_view was rendered from the same root and nothing in it changed,
+ * it is reused together with its dispatch tree, which is by far the most
+ * expensive part to build.
+ */
+static FlatView *generate_memory_topology(MemoryRegion *mr, FlatView *old_view)
 {
     int i;
     FlatView *view;
@@ -714,6 +738,15 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
     }
     flatview_simplify(view);
 
+    if (old_view && flatview_equal(old_view, view)) {
+        /* Never published, so there are no RCU readers to wait for */
+        flatview_destroy(view);
+        flatview_ref(old_view);
+        trace_flatview_reuse(old_view, mr);
+        g_hash_table_replace(flat_views, mr, old_view);
+        return old_view;
+    }
+
     view->dispatch = address_space_dispatch_new(view);
     for (i = 0; i < view->nr; i++) {
         MemoryRegionSection mrs =
@@ -967,7 +1000,7 @@ static void flatviews_init(void)
     flat_views = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
                                        (GDestroyNotify) flatview_unref);
     if (!empty_view) {
-        empty_view = generate_memory_topology(NULL);
+        empty_view = generate_memory_topology(NULL, NULL);
         /* We keep it alive forever in the global variable.  */
         flatview_ref(empty_view);
     } else {
@@ -978,15 +1011,13 @@ static void flatviews_init(void)
 
 static void flatviews_reset(void)
 {
+    GHashTable *old_views = flat_views;
     AddressSpace *as;
 
-    if (flat_views) {
-        g_hash_table_unref(flat_views);
-        flat_views = NULL;
-    }
+    flat_views = NULL;
     flatviews_init();
 
-    /* Render unique FVs */
+    /* Render unique FVs, keeping those that did not change */
     QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
         MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
 
@@ -994,7 +1025,13 @@ static void flatviews_reset(void)
             continue;
         }
 
-        generate_memory_topology(physmr);
+        generate_memory_topology(physmr, old_views ?
+                                 g_hash_table_lookup(old_views, physmr) :
+                                 NULL);
+    }
+
+    if (old_views) {
+        g_hash_table_unref(old_views);
     }
 }
 
@@ -1007,6 +1044,14 @@ static void address_space_set_flatview(AddressSpace *as)
     assert(new_view);
 
     if (old_view == new_view) {
+        /*
+         * The view was reused because nothing in it changed.  Listeners
+         * still expect the region_nop calls they got when every commit
+         * rebuilt all the views.
+         */
+        if (!QTAILQ_EMPTY(&as->listeners)) {
+            address_space_update_topology_pass(as, old_view, new_view, true);
+        }
         return;
     }
 
@@ -1049,7 +1094,7 @@ static void address_space_update_topology(AddressSpace *as)
 
     flatviews_init();
     if (!g_hash_table_lookup(flat_views, physmr)) {
-        generate_memory_topology(physmr);
+        generate_memory_topology(physmr, NULL);
     }
     address_space_set_flatview(as);
 }
@@ -1346,6 +1391,72 @@ static const MemoryRegionOps ram_device_mem_ops = {
     },
 };
 
+static unsigned memory_region_direct_index(MemOp op)
+{
+    return (op & MO_SIZE) | (op & MO_BSWAP ? 4 : 0);
+}
+
+/*
+ * Compute which combinations of access size and endianness need no
+ * validation callback, no splitting or widening by
+ * access_with_adjusted_size() and no byte swapping for @ops, so that
+ * they can be dispatched with a single call of the read or write
+ * callback.  Only alignment remains to be checked for each access.
+ */
+static uint8_t memory_region_direct_ops(const MemoryRegionOps *ops,
+                                        bool is_write)
+{
+    unsigned impl_min = ops->impl.min_access_size ?: 1;
+    unsigned impl_max = ops->impl.max_access_size ?: 4;
+    uint8_t direct = 0;
+    unsigned i;
+
+    if (ops->valid.accepts) {
+        return 0;
+    }
+    if (is_write ? !ops->write && !ops->write_with_attrs
+                 : !ops->read && !ops->read_with_attrs) {
+        return 0;
+    }
+
+    for (i = 0; i < 8; i++) {
+        MemOp op = (i & MO_SIZE) | (i & 4 ? MO_BSWAP : 0);
+        unsigned size = memop_size(op);
+
+        if (ops->valid.max_access_size &&
+            (size > ops->valid.max_access_size ||
+             size < ops->valid.min_access_size)) {
+            continue;
+        }
+        if (size < impl_min || size > impl_max) {
+            continue;
+        }
+        if (size > 1 && (op & MO_BSWAP) != devend_memop(ops->endianness)) {
+            continue;
+        }
+        direct |= 1 << memory_region_direct_index(op);
+    }
+    return direct;
+}
+
+static void memory_region_set_ops(MemoryRegion *mr,
+                                  const MemoryRegionOps *ops)
+{
+    mr->ops = ops;
+    mr->direct_read = memory_region_direct_ops(ops, false);
+    mr->direct_write = memory_region_direct_ops(ops, true);
+}
+
+static bool memory_region_access_direct(MemoryRegion *mr, hwaddr addr,
+                                        MemOp op, uint8_t direct)
+{
+    unsigned size = memop_size(op);
+
+    return (direct & (1 << memory_region_direct_index(op))) &&
+           (mr->ops->valid.unaligned || !(addr & (size - 1))) &&
+           !mr->subpage;
+}
+
 bool memory_region_access_valid(MemoryRegion *mr,
                                 hwaddr addr,
                                 unsigned size,
@@ -1405,6 +1516,20 @@ MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
     unsigned size = memop_size(op);
     MemTxResult r;
 
+    if (memory_region_access_direct(mr, addr, op, mr->direct_read) &&
+        !trace_event_get_state_backends(TRACE_MEMORY_REGION_OPS_READ)) {
+        uint64_t tmp = 0;
+
+        if (mr->ops->read) {
+            tmp = mr->ops->read(mr->opaque, addr, size);
+            r = MEMTX_OK;
+        } else {
+            r = mr->ops->read_with_attrs(mr->opaque, addr, &tmp, size, attrs);
+        }
+        *pval = tmp & MAKE_64BIT_MASK(0, size * 8);
+        return r;
+    }
+
     if (!memory_region_access_valid(mr, addr, size, false, attrs)) {
         *pval = unassigned_mem_read(mr, addr, size);
         return MEMTX_DECODE_ERROR;
@@ -1449,6 +1574,17 @@ MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
 {
     unsigned size = memop_size(op);
 
+    if (memory_region_access_direct(mr, addr, op, mr->direct_write) &&
+        !mr->ioeventfd_nb &&
+        !trace_event_get_state_backends(TRACE_MEMORY_REGION_OPS_WRITE)) {
+        data &= MAKE_64BIT_MASK(0, size * 8);
+        if (mr->ops->write) {
+            mr->ops->write(mr->opaque, addr, data, size);
+            return MEMTX_OK;
+        }
+        return mr->ops->write_with_attrs(mr->opaque, addr, data, size, attrs);
+    }
+
     if (!memory_region_access_valid(mr, addr, size, true, attrs)) {
         unassigned_mem_write(mr, addr, data, size);
         return MEMTX_DECODE_ERROR;
@@ -1485,7 +1621,7 @@ void memory_region_init_io(MemoryRegion *mr,
                            uint64_t size)
 {
     memory_region_init(mr, owner, name, size);
-    mr->ops = ops ? ops : &unassigned_mem_ops;
+    memory_region_set_ops(mr, ops ? ops : &unassigned_mem_ops);
     mr->opaque = opaque;
     mr->terminates = true;
 }
@@ -1622,7 +1758,7 @@ void memory_region_init_ram_device_ptr(MemoryRegion *mr,
     mr->ram = true;
     mr->terminates = true;
     mr->ram_device = true;
-    mr->ops = &ram_device_mem_ops;
+    memory_region_set_ops(mr, &ram_device_mem_ops);
     mr->opaque = mr;
     mr->destructor = memory_region_destructor_ram;
     mr->dirty_log_mask = tcg_enabled() ? (1 << DIRTY_MEMORY_CODE) : 0;
@@ -1664,7 +1800,7 @@ void memory_region_init_rom_device_nomigrate(MemoryRegion *mr,
     Error *err = NULL;
     assert(ops);
     memory_region_init(mr, owner, name, size);
-    mr->ops = ops;
+    memory_region_set_ops(mr, ops);
     mr->opaque = opaque;
     mr->terminates = true;
     mr->rom_device = true;
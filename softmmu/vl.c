@@ -463,6 +463,9 @@ static QemuOptsList qemu_icount_opts = {
         }, {
             .name = "sleep",
             .type = QEMU_OPT_BOOL,
+        }, {
+            .name = "fast",
+            .type = QEMU_OPT_BOOL,
         }, {
             .name = "rr",
             .type = QEMU_OPT_STRING,
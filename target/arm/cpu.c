@@ -367,6 +367,7 @@ static void arm_cpu_reset(DeviceState *dev)
                        sizeof(*env->pmsav7.dracr) * cpu->pmsav7_dregion);
             }
         }
+        arm_mpu_cache_invalidate(cpu);
         env->pmsav7.rnr[M_REG_NS] = 0;
         env->pmsav7.rnr[M_REG_S] = 0;
         env->pmsav8.mair0[M_REG_NS] = 0;
@@ -1279,6 +1280,7 @@ static void arm_cpu_finalizefn(Object *obj)
 {
     ARMCPU *cpu = ARM_CPU(obj);
     ARMELChangeHook *hook, *next;
+    int i;
 
     g_hash_table_destroy(cpu->cp_regs);
 
@@ -1290,6 +1292,10 @@ static void arm_cpu_finalizefn(Object *obj)
         QLIST_REMOVE(hook, node);
         g_free(hook);
     }
+    for (i = 0; i < M_REG_NUM_BANKS; i++) {
+        g_free(cpu->mpu_cache[i].start);
+        g_free(cpu->mpu_cache[i].region);
+    }
 #ifndef CONFIG_USER_ONLY
     if (cpu->pmu_timer) {
         timer_del(cpu->pmu_timer);
@@ -745,6 +745,27 @@ typedef enum ARMPSCIState {
 
 typedef struct ARMISARegisters ARMISARegisters;
 
+/**
+ * ARMMPUCache:
+ * @valid: false if the MPU region registers have changed since the
+ *   table was last built
+ * @num: number of entries in @start and @region
+ * @start: sorted start addresses; entry i covers [start[i], start[i + 1])
+ * @region: MPU region number hit by each interval, or one of the
+ *   negative MPU_CACHE_* values defined in helper.c
+ *
+ * Precomputed PMSAv7/PMSAv8 region decisions, so that an MPU lookup is
+ * a binary search rather than a walk over every region. Adjacent
+ * intervals with the same decision are merged, which lets us report a
+ * full-page TLB entry whenever the whole page resolves to one region.
+ */
+typedef struct ARMMPUCache {
+    bool valid;
+    uint32_t num;
+    uint32_t *start;
+    int *region;
+} ARMMPUCache;
+
 /**
  * ARMCPU:
  * @env: #CPUARMState
@@ -837,6 +858,8 @@ struct ARMCPU {
     bool has_mpu;
     /* PMSAv7 MPU number of supported regions */
     uint32_t pmsav7_dregion;
+    /* MPU region lookup tables, indexed by M_REG_NS/M_REG_S */
+    ARMMPUCache mpu_cache[M_REG_NUM_BANKS];
     /* v8M SAU number of supported regions */
     uint32_t sau_sregion;
 
@@ -987,6 +1010,16 @@ struct ARMCPU {
 
 unsigned int gt_cntfrq_period_ns(ARMCPU *cpu);
 
+/*
+ * Mark the MPU region lookup tables as stale. Must be called whenever
+ * any PMSAv7 DRBAR/DRSR or PMSAv8 RBAR/RLAR register changes.
+ */
+static inline void arm_mpu_cache_invalidate(ARMCPU *cpu)
+{
+    cpu->mpu_cache[M_REG_NS].valid = false;
+    cpu->mpu_cache[M_REG_S].valid = false;
+}
+
 void arm_cpu_post_init(Object *obj);
 
 uint64_t arm_cpu_mp_affinity(int idx, uint8_t clustersz);
@@ -3792,6 +3792,7 @@ static void pmsav7_write(CPUARMState *env, const ARMCPRegInfo *ri,
     u32p += env->pmsav7.rnr[M_REG_NS];
     tlb_flush(CPU(cpu)); /* Mappings may have changed - purge! */
     *u32p = value;
+    arm_mpu_cache_invalidate(cpu);
 }
 
 static void pmsav7_rgnr_write(CPUARMState *env, const ARMCPRegInfo *ri,
@@ -11312,42 +11313,59 @@ static inline bool m_is_system_region(CPUARMState *env, uint32_t address)
     return arm_feature(env, ARM_FEATURE_M) && extract32(address, 29, 3) == 0x7;
 }
 
-static bool get_phys_addr_pmsav7(CPUARMState *env, uint32_t address,
-                                 MMUAccessType access_type, ARMMMUIdx mmu_idx,
-                                 hwaddr *phys_ptr, int *prot,
-                                 target_ulong *page_size,
-                                 ARMMMUFaultInfo *fi)
+/*
+ * Values stored in ARMMPUCache::region other than a region number.
+ */
+#define MPU_CACHE_NO_REGION -1
+#define MPU_CACHE_MULTI_HIT -2
+
+static int mpu_cache_cmp_addr(const void *a, const void *b)
 {
-    ARMCPU *cpu = env_archcpu(env);
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void arm_mpu_cache_rebuild(ARMCPU *cpu, int bank)
+{
+    /*
+     * Split the 32-bit address space at every region (and, for PMSAv7,
+     * every subregion) boundary, work out which region each resulting
+     * interval hits, and merge neighbouring intervals with the same
+     * answer. This is done only when the region registers have changed,
+     * so it can afford to be simple rather than fast.
+     */
+    CPUARMState *env = &cpu->env;
+    ARMMPUCache *c = &cpu->mpu_cache[bank];
+    uint32_t nr = cpu->pmsav7_dregion;
+    bool is_v8 = arm_feature(env, ARM_FEATURE_V8);
+    g_autofree uint32_t *base = g_new0(uint32_t, nr);
+    g_autofree uint32_t *limit = g_new0(uint32_t, nr);
+    g_autofree uint8_t *srd = g_new0(uint8_t, nr);
+    g_autofree uint8_t *subshift = g_new0(uint8_t, nr);
+    g_autofree bool *enabled = g_new0(bool, nr);
+    g_autofree uint32_t *bounds = g_new(uint32_t, nr * 9 + 1);
+    uint32_t nbounds = 0, num = 0, i;
     int n;
-    bool is_user = regime_is_user(env, mmu_idx);
 
-    *phys_ptr = address;
-    *page_size = TARGET_PAGE_SIZE;
-    *prot = 0;
+    c->start = g_renew(uint32_t, c->start, nr * 9 + 1);
+    c->region = g_renew(int, c->region, nr * 9 + 1);
 
-    if (regime_translation_disabled(env, mmu_idx) ||
-        m_is_ppb_region(env, address)) {
-        /* MPU disabled or M profile PPB access: use default memory map.
-         * The other case which uses the default memory map in the
-         * v7M ARM ARM pseudocode is exception vector reads from the vector
-         * table. In QEMU those accesses are done in arm_v7m_load_vector(),
-         * which always does a direct read using address_space_ldl(), rather
-         * than going via this function, so we don't need to check that here.
-         */
-        get_phys_addr_pmsav7_default(env, mmu_idx, address, prot);
-    } else { /* MPU enabled */
-        for (n = (int)cpu->pmsav7_dregion - 1; n >= 0; n--) {
-            /* region search */
-            uint32_t base = env->pmsav7.drbar[n];
+    bounds[nbounds++] = 0;
+    for (n = 0; n < nr; n++) {
+        if (is_v8) {
+            base[n] = env->pmsav8.rbar[bank][n] & ~0x1f;
+            limit[n] = env->pmsav8.rlar[bank][n] | 0x1f;
+            enabled[n] = (env->pmsav8.rlar[bank][n] & 0x1) &&
+                limit[n] >= base[n];
+        } else {
             uint32_t rsize = extract32(env->pmsav7.drsr[n], 1, 5);
             uint32_t rmask;
-            bool srdis = false;
 
             if (!(env->pmsav7.drsr[n] & 0x1)) {
                 continue;
             }
-
             if (!rsize) {
                 qemu_log_mask(LOG_GUEST_ERROR,
                               "DRSR[%d]: Rsize field cannot be 0\n", n);
@@ -11355,71 +11373,146 @@ static bool get_phys_addr_pmsav7(CPUARMState *env, uint32_t address,
             }
             rsize++;
             rmask = (1ull << rsize) - 1;
-
-            if (base & rmask) {
+            if (env->pmsav7.drbar[n] & rmask) {
                 qemu_log_mask(LOG_GUEST_ERROR,
                               "DRBAR[%d]: 0x%" PRIx32 " misaligned "
                               "to DRSR region size, mask = 0x%" PRIx32 "\n",
-                              n, base, rmask);
+                              n, env->pmsav7.drbar[n], rmask);
                 continue;
             }
+            base[n] = env->pmsav7.drbar[n];
+            limit[n] = base[n] + rmask;
+            if (rsize >= 8) { /* no subregions for regions < 256 bytes */
+                srd[n] = extract32(env->pmsav7.drsr[n], 8, 8);
+                subshift[n] = rsize - 3;
+            }
+            enabled[n] = true;
+        }
 
-            if (address < base || address > base + rmask) {
-                /*
-                 * Address not in this region. We must check whether the
-                 * region covers addresses in the same page as our address.
-                 * In that case we must not report a size that covers the
-                 * whole page for a subsequent hit against a different MPU
-                 * region or the background region, because it would result in
-                 * incorrect TLB hits for subsequent accesses to addresses that
-                 * are in this MPU region.
-                 */
-                if (ranges_overlap(base, rmask,
-                                   address & TARGET_PAGE_MASK,
-                                   TARGET_PAGE_SIZE)) {
-                    *page_size = 1;
-                }
-                continue;
+        if (!enabled[n]) {
+            continue;
+        }
+        bounds[nbounds++] = base[n];
+        if (srd[n]) {
+            for (i = 1; i < 8; i++) {
+                bounds[nbounds++] = base[n] + (i << subshift[n]);
             }
+        }
+        if (limit[n] != UINT32_MAX) {
+            bounds[nbounds++] = limit[n] + 1;
+        }
+    }
 
-            /* Region matched */
+    qsort(bounds, nbounds, sizeof(*bounds), mpu_cache_cmp_addr);
 
-            if (rsize >= 8) { /* no subregions for regions < 256 bytes */
-                int i, snd;
-                uint32_t srdis_mask;
-
-                rsize -= 3; /* sub region size (power of 2) */
-                snd = ((address - base) >> rsize) & 0x7;
-                srdis = extract32(env->pmsav7.drsr[n], snd + 8, 1);
-
-                srdis_mask = srdis ? 0x3 : 0x0;
-                for (i = 2; i <= 8 && rsize < TARGET_PAGE_BITS; i *= 2) {
-                    /* This will check in groups of 2, 4 and then 8, whether
-                     * the subregion bits are consistent. rsize is incremented
-                     * back up to give the region size, considering consistent
-                     * adjacent subregions as one region. Stop testing if rsize
-                     * is already big enough for an entire QEMU page.
-                     */
-                    int snd_rounded = snd & ~(i - 1);
-                    uint32_t srdis_multi = extract32(env->pmsav7.drsr[n],
-                                                     snd_rounded + 8, i);
-                    if (srdis_mask ^ srdis_multi) {
-                        break;
-                    }
-                    srdis_mask = (srdis_mask << i) | srdis_mask;
-                    rsize++;
-                }
+    for (i = 0; i < nbounds; i++) {
+        uint32_t addr = bounds[i];
+        int decision = MPU_CACHE_NO_REGION;
+
+        if (i > 0 && addr == bounds[i - 1]) {
+            continue;
+        }
+        for (n = (int)nr - 1; n >= 0; n--) {
+            if (!enabled[n] || addr < base[n] || addr > limit[n]) {
+                continue;
             }
-            if (srdis) {
+            if (extract32(srd[n], ((addr - base[n]) >> subshift[n]) & 0x7,
+                          1)) {
+                /* subregion disabled: fall through to lower regions */
                 continue;
             }
-            if (rsize < TARGET_PAGE_BITS) {
-                *page_size = 1 << rsize;
+            if (!is_v8) {
+                /* PMSAv7: highest-numbered matching region wins */
+                decision = n;
+                break;
             }
-            break;
+            if (decision != MPU_CACHE_NO_REGION) {
+                /* PMSAv8: a hit in more than one region is a fault */
+                decision = MPU_CACHE_MULTI_HIT;
+                break;
+            }
+            decision = n;
+        }
+        if (num && c->region[num - 1] == decision) {
+            continue;
+        }
+        c->start[num] = addr;
+        c->region[num] = decision;
+        num++;
+    }
+
+    c->num = num;
+    c->valid = true;
+}
+
+static int arm_mpu_cache_lookup(ARMCPU *cpu, int bank, uint32_t address,
+                                bool *is_subpage)
+{
+    /*
+     * Return the MPU region hit by @address (or a negative MPU_CACHE_*
+     * value). *is_subpage is set if the answer is not the same for
+     * the whole TARGET_PAGE containing @address, in which case the
+     * caller must not install a page-sized TLB entry.
+     */
+    ARMMPUCache *c = &cpu->mpu_cache[bank];
+    uint32_t addr_page_base = address & TARGET_PAGE_MASK;
+    uint32_t addr_page_limit = addr_page_base + (TARGET_PAGE_SIZE - 1);
+    uint32_t lo = 0, hi;
+
+    if (!c->valid) {
+        arm_mpu_cache_rebuild(cpu, bank);
+    }
+
+    /* start[0] is always 0, so the answer lies in [lo, hi) */
+    hi = c->num;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (c->start[mid] <= address) {
+            lo = mid;
+        } else {
+            hi = mid;
         }
+    }
+
+    *is_subpage = c->start[lo] > addr_page_base ||
+        (lo + 1 < c->num && c->start[lo + 1] <= addr_page_limit);
+    return c->region[lo];
+}
 
-        if (n == -1) { /* no hits */
+static bool get_phys_addr_pmsav7(CPUARMState *env, uint32_t address,
+                                 MMUAccessType access_type, ARMMMUIdx mmu_idx,
+                                 hwaddr *phys_ptr, int *prot,
+                                 target_ulong *page_size,
+                                 ARMMMUFaultInfo *fi)
+{
+    ARMCPU *cpu = env_archcpu(env);
+    int n;
+    bool is_user = regime_is_user(env, mmu_idx);
+
+    *phys_ptr = address;
+    *page_size = TARGET_PAGE_SIZE;
+    *prot = 0;
+
+    if (regime_translation_disabled(env, mmu_idx) ||
+        m_is_ppb_region(env, address)) {
+        /* MPU disabled or M profile PPB access: use default memory map.
+         * The other case which uses the default memory map in the
+         * v7M ARM ARM pseudocode is exception vector reads from the vector
+         * table. In QEMU those accesses are done in arm_v7m_load_vector(),
+         * which always does a direct read using address_space_ldl(), rather
+         * than going via this function, so we don't need to check that here.
+         */
+        get_phys_addr_pmsav7_default(env, mmu_idx, address, prot);
+    } else { /* MPU enabled */
+        bool is_subpage;
+
+        n = arm_mpu_cache_lookup(cpu, M_REG_NS, address, &is_subpage);
+        if (is_subpage) {
+            *page_size = 1;
+        }
+
+        if (n == MPU_CACHE_NO_REGION) { /* no hits */
             if (!pmsav7_use_background_region(cpu, mmu_idx, is_user)) {
                 /* background fault */
                 fi->type = ARMFault_Background;
@@ -11638,11 +11731,8 @@ bool pmsav8_mpu_lookup(CPUARMState *env, uint32_t address,
     ARMCPU *cpu = env_archcpu(env);
     bool is_user = regime_is_user(env, mmu_idx);
     uint32_t secure = regime_is_secure(env, mmu_idx);
-    int n;
     int matchregion = -1;
     bool hit = false;
-    uint32_t addr_page_base = address & TARGET_PAGE_MASK;
-    uint32_t addr_page_limit = addr_page_base + (TARGET_PAGE_SIZE - 1);
 
     *is_subpage = false;
     *phys_ptr = address;
@@ -11666,53 +11756,16 @@ bool pmsav8_mpu_lookup(CPUARMState *env, uint32_t address,
             hit = true;
         }
 
-        for (n = (int)cpu->pmsav7_dregion - 1; n >= 0; n--) {
-            /* region search */
-            /* Note that the base address is bits [31:5] from the register
-             * with bits [4:0] all zeroes, but the limit address is bits
-             * [31:5] from the register with bits [4:0] all ones.
+        matchregion = arm_mpu_cache_lookup(cpu, secure, address, is_subpage);
+        if (matchregion == MPU_CACHE_MULTI_HIT) {
+            /* Multiple regions match -- always a failure (unlike
+             * PMSAv7 where highest-numbered-region wins)
              */
-            uint32_t base = env->pmsav8.rbar[secure][n] & ~0x1f;
-            uint32_t limit = env->pmsav8.rlar[secure][n] | 0x1f;
-
-            if (!(env->pmsav8.rlar[secure][n] & 0x1)) {
-                /* Region disabled */
-                continue;
-            }
-
-            if (address < base || address > limit) {
-                /*
-                 * Address not in this region. We must check whether the
-                 * region covers addresses in the same page as our address.
-                 * In that case we must not report a size that covers the
-                 * whole page for a subsequent hit against a different MPU
-                 * region or the background region, because it would result in
-                 * incorrect TLB hits for subsequent accesses to addresses that
-                 * are in this MPU region.
-                 */
-                if (limit >= base &&
-                    ranges_overlap(base, limit - base + 1,
-                                   addr_page_base,
-                                   TARGET_PAGE_SIZE)) {
-                    *is_subpage = true;
-                }
-                continue;
-            }
-
-            if (base > addr_page_base || limit < addr_page_limit) {
-                *is_subpage = true;
-            }
-
-            if (matchregion != -1) {
-                /* Multiple regions match -- always a failure (unlike
-                 * PMSAv7 where highest-numbered-region wins)
-                 */
-                fi->type = ARMFault_Permission;
-                fi->level = 1;
-                return true;
-            }
-
-            matchregion = n;
+            fi->type = ARMFault_Permission;
+            fi->level = 1;
+            return true;
+        }
+        if (matchregion != MPU_CACHE_NO_REGION) {
             hit = true;
         }
     }
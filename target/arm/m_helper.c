@@ -332,6 +332,100 @@ pend_fault:
     return false;
 }
 
+/*
+ * Stack frames are written and read as a block where possible. If the
+ * whole frame lies within one page for which the MPU/SAU answer is the
+ * same throughout, a single translation is valid for every word of it
+ * and we can do one address_space_write()/read() (which is a host memcpy
+ * for RAM) instead of a separate MMU lookup per word. If that is not
+ * possible, or the access fails, we fall back to doing the words one at
+ * a time, so any fault is reported exactly as it would have been.
+ */
+#define V7M_MAX_FRAME_WORDS 16
+
+static bool v7m_stack_frame_probe(ARMCPU *cpu, uint32_t addr, int nwords,
+                                  MMUAccessType access_type, ARMMMUIdx mmu_idx,
+                                  hwaddr *physaddr, MemTxAttrs *attrs)
+{
+    CPUARMState *env = &cpu->env;
+    target_ulong page_size;
+    int prot;
+    ARMMMUFaultInfo fi = {};
+    ARMCacheAttrs cacheattrs = {};
+    uint32_t last = addr + nwords * 4 - 1;
+
+    if (last < addr ||
+        (addr & TARGET_PAGE_MASK) != (last & TARGET_PAGE_MASK)) {
+        return false;
+    }
+    if (get_phys_addr(env, addr, access_type, mmu_idx, physaddr,
+                      attrs, &prot, &page_size, &fi, &cacheattrs)) {
+        return false;
+    }
+    return page_size >= TARGET_PAGE_SIZE;
+}
+
+static bool v7m_stack_write_frame(ARMCPU *cpu, uint32_t addr,
+                                  const uint32_t *values, int nwords,
+                                  ARMMMUIdx mmu_idx, StackingMode mode)
+{
+    MemTxAttrs attrs = {};
+    hwaddr physaddr;
+    int i;
+
+    assert(nwords <= V7M_MAX_FRAME_WORDS);
+
+    if (v7m_stack_frame_probe(cpu, addr, nwords, MMU_DATA_STORE, mmu_idx,
+                              &physaddr, &attrs)) {
+        uint8_t buf[V7M_MAX_FRAME_WORDS * 4];
+
+        for (i = 0; i < nwords; i++) {
+            stl_le_p(buf + i * 4, values[i]);
+        }
+        if (address_space_write(arm_addressspace(CPU(cpu), attrs), physaddr,
+                                attrs, buf, nwords * 4) == MEMTX_OK) {
+            return true;
+        }
+    }
+
+    for (i = 0; i < nwords; i++) {
+        if (!v7m_stack_write(cpu, addr + i * 4, values[i], mmu_idx, mode)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool v7m_stack_read_frame(ARMCPU *cpu, uint32_t *const *dest,
+                                 uint32_t addr, int nwords, ARMMMUIdx mmu_idx)
+{
+    MemTxAttrs attrs = {};
+    hwaddr physaddr;
+    int i;
+
+    assert(nwords <= V7M_MAX_FRAME_WORDS);
+
+    if (v7m_stack_frame_probe(cpu, addr, nwords, MMU_DATA_LOAD, mmu_idx,
+                              &physaddr, &attrs)) {
+        uint8_t buf[V7M_MAX_FRAME_WORDS * 4];
+
+        if (address_space_read(arm_addressspace(CPU(cpu), attrs), physaddr,
+                               attrs, buf, nwords * 4) == MEMTX_OK) {
+            for (i = 0; i < nwords; i++) {
+                *dest[i] = ldl_le_p(buf + i * 4);
+            }
+            return true;
+        }
+    }
+
+    for (i = 0; i < nwords; i++) {
+        if (!v7m_stack_read(cpu, dest[i], addr + i * 4, mmu_idx)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void HELPER(v7m_preserve_fp_state)(CPUARMState *env)
 {
     /*
@@ -809,14 +903,8 @@ static bool v7m_push_callee_stack(ARMCPU *cpu, uint32_t lr, bool dotailchain,
     sig = v7m_integrity_sig(env, lr);
     stacked_ok =
         v7m_stack_write(cpu, frameptr, sig, mmu_idx, smode) &&
-        v7m_stack_write(cpu, frameptr + 0x8, env->regs[4], mmu_idx, smode) &&
-        v7m_stack_write(cpu, frameptr + 0xc, env->regs[5], mmu_idx, smode) &&
-        v7m_stack_write(cpu, frameptr + 0x10, env->regs[6], mmu_idx, smode) &&
-        v7m_stack_write(cpu, frameptr + 0x14, env->regs[7], mmu_idx, smode) &&
-        v7m_stack_write(cpu, frameptr + 0x18, env->regs[8], mmu_idx, smode) &&
-        v7m_stack_write(cpu, frameptr + 0x1c, env->regs[9], mmu_idx, smode) &&
-        v7m_stack_write(cpu, frameptr + 0x20, env->regs[10], mmu_idx, smode) &&
-        v7m_stack_write(cpu, frameptr + 0x24, env->regs[11], mmu_idx, smode);
+        v7m_stack_write_frame(cpu, frameptr + 0x8, &env->regs[4], 8,
+                              mmu_idx, smode);
 
     /* Update SP regardless of whether any of the stack accesses failed. */
     *frame_sp_p = frameptr;
@@ -1224,21 +1312,16 @@ static bool v7m_push_stack(ARMCPU *cpu)
      * (which may be taken in preference to the one we started with
      * if it has higher priority).
      */
-    stacked_ok = stacked_ok &&
-        v7m_stack_write(cpu, frameptr, env->regs[0], mmu_idx, STACK_NORMAL) &&
-        v7m_stack_write(cpu, frameptr + 4, env->regs[1],
-                        mmu_idx, STACK_NORMAL) &&
-        v7m_stack_write(cpu, frameptr + 8, env->regs[2],
-                        mmu_idx, STACK_NORMAL) &&
-        v7m_stack_write(cpu, frameptr + 12, env->regs[3],
-                        mmu_idx, STACK_NORMAL) &&
-        v7m_stack_write(cpu, frameptr + 16, env->regs[12],
-                        mmu_idx, STACK_NORMAL) &&
-        v7m_stack_write(cpu, frameptr + 20, env->regs[14],
-                        mmu_idx, STACK_NORMAL) &&
-        v7m_stack_write(cpu, frameptr + 24, env->regs[15],
-                        mmu_idx, STACK_NORMAL) &&
-        v7m_stack_write(cpu, frameptr + 28, xpsr, mmu_idx, STACK_NORMAL);
+    if (stacked_ok) {
+        uint32_t frame[8] = {
+            env->regs[0], env->regs[1], env->regs[2], env->regs[3],
+            env->regs[12], env->regs[14], env->regs[15], xpsr,
+        };
+
+        stacked_ok = v7m_stack_write_frame(cpu, frameptr, frame,
+                                           ARRAY_SIZE(frame),
+                                           mmu_idx, STACK_NORMAL);
+    }
 
     if (env->v7m.control[M_REG_S] & R_V7M_CONTROL_FPCA_MASK) {
         /* FPU is active, try to save its registers */
@@ -1278,20 +1361,23 @@ static bool v7m_push_stack(ARMCPU *cpu)
                     stacked_ok = false;
                 }
 
-                for (i = 0; i < ((framesize == 0xa8) ? 32 : 16); i += 2) {
-                    uint64_t dn = *aa32_vfp_dreg(env, i / 2);
+                for (i = 0; i < ((framesize == 0xa8) ? 32 : 16); i += 16) {
+                    uint32_t sregs[16];
                     uint32_t faddr = frameptr + 0x20 + 4 * i;
-                    uint32_t slo = extract64(dn, 0, 32);
-                    uint32_t shi = extract64(dn, 32, 32);
+                    int j;
 
                     if (i >= 16) {
                         faddr += 8; /* skip the slot for the FPSCR */
                     }
+                    for (j = 0; j < 16; j += 2) {
+                        uint64_t dn = *aa32_vfp_dreg(env, (i + j) / 2);
+
+                        sregs[j] = extract64(dn, 0, 32);
+                        sregs[j + 1] = extract64(dn, 32, 32);
+                    }
                     stacked_ok = stacked_ok &&
-                        v7m_stack_write(cpu, faddr, slo,
-                                        mmu_idx, STACK_NORMAL) &&
-                        v7m_stack_write(cpu, faddr + 4, shi,
-                                        mmu_idx, STACK_NORMAL);
+                        v7m_stack_write_frame(cpu, faddr, sregs, 16,
+                                              mmu_idx, STACK_NORMAL);
                 }
                 stacked_ok = stacked_ok &&
                     v7m_stack_write(cpu, frameptr + 0x60,
@@ -1603,29 +1689,32 @@ static void do_v7m_exception_exit(ARMCPU *cpu)
                 return;
             }
 
-            pop_ok = pop_ok &&
-                v7m_stack_read(cpu, &env->regs[4], frameptr + 0x8, mmu_idx) &&
-                v7m_stack_read(cpu, &env->regs[5], frameptr + 0xc, mmu_idx) &&
-                v7m_stack_read(cpu, &env->regs[6], frameptr + 0x10, mmu_idx) &&
-                v7m_stack_read(cpu, &env->regs[7], frameptr + 0x14, mmu_idx) &&
-                v7m_stack_read(cpu, &env->regs[8], frameptr + 0x18, mmu_idx) &&
-                v7m_stack_read(cpu, &env->regs[9], frameptr + 0x1c, mmu_idx) &&
-                v7m_stack_read(cpu, &env->regs[10], frameptr + 0x20, mmu_idx) &&
-                v7m_stack_read(cpu, &env->regs[11], frameptr + 0x24, mmu_idx);
+            if (pop_ok) {
+                uint32_t *const callee_frame[8] = {
+                    &env->regs[4], &env->regs[5], &env->regs[6],
+                    &env->regs[7], &env->regs[8], &env->regs[9],
+                    &env->regs[10], &env->regs[11],
+                };
+
+                pop_ok = v7m_stack_read_frame(cpu, callee_frame,
+                                              frameptr + 0x8,
+                                              ARRAY_SIZE(callee_frame),
+                                              mmu_idx);
+            }
 
             frameptr += 0x28;
         }
 
         /* Pop registers */
-        pop_ok = pop_ok &&
-            v7m_stack_read(cpu, &env->regs[0], frameptr, mmu_idx) &&
-            v7m_stack_read(cpu, &env->regs[1], frameptr + 0x4, mmu_idx) &&
-            v7m_stack_read(cpu, &env->regs[2], frameptr + 0x8, mmu_idx) &&
-            v7m_stack_read(cpu, &env->regs[3], frameptr + 0xc, mmu_idx) &&
-            v7m_stack_read(cpu, &env->regs[12], frameptr + 0x10, mmu_idx) &&
-            v7m_stack_read(cpu, &env->regs[14], frameptr + 0x14, mmu_idx) &&
-            v7m_stack_read(cpu, &env->regs[15], frameptr + 0x18, mmu_idx) &&
-            v7m_stack_read(cpu, &xpsr, frameptr + 0x1c, mmu_idx);
+        if (pop_ok) {
+            uint32_t *const frame[8] = {
+                &env->regs[0], &env->regs[1], &env->regs[2], &env->regs[3],
+                &env->regs[12], &env->regs[14], &env->regs[15], &xpsr,
+            };
+
+            pop_ok = v7m_stack_read_frame(cpu, frame, frameptr,
+                                          ARRAY_SIZE(frame), mmu_idx);
+        }
 
         if (!pop_ok) {
             /*
@@ -1731,25 +1820,31 @@ static void do_v7m_exception_exit(ARMCPU *cpu)
                     return;
                 }
 
-                for (i = 0; i < (restore_s16_s31 ? 32 : 16); i += 2) {
-                    uint32_t slo, shi;
-                    uint64_t dn;
+                for (i = 0; i < (restore_s16_s31 ? 32 : 16); i += 16) {
+                    uint32_t sregs[16];
+                    uint32_t *sregp[16];
                     uint32_t faddr = frameptr + 0x20 + 4 * i;
+                    int j;
 
                     if (i >= 16) {
                         faddr += 8; /* Skip the slot for the FPSCR */
                     }
 
+                    for (j = 0; j < 16; j++) {
+                        sregp[j] = &sregs[j];
+                    }
                     pop_ok = pop_ok &&
-                        v7m_stack_read(cpu, &slo, faddr, mmu_idx) &&
-                        v7m_stack_read(cpu, &shi, faddr + 4, mmu_idx);
+                        v7m_stack_read_frame(cpu, sregp, faddr, 16, mmu_idx);
 
                     if (!pop_ok) {
                         break;
                     }
 
-                    dn = (uint64_t)shi << 32 | slo;
-                    *aa32_vfp_dreg(env, i / 2) = dn;
+                    for (j = 0; j < 16; j += 2) {
+                        uint64_t dn = (uint64_t)sregs[j + 1] << 32 | sregs[j];
+
+                        *aa32_vfp_dreg(env, (i + j) / 2) = dn;
+                    }
                 }
                 pop_ok = pop_ok &&
                     v7m_stack_read(cpu, &fpscr, frameptr + 0x60, mmu_idx);
@@ -764,6 +764,7 @@ static int cpu_post_load(void *opaque, int version_id)
     if (!kvm_enabled()) {
         pmu_op_finish(&cpu->env);
     }
+    arm_mpu_cache_invalidate(cpu);
     arm_rebuild_hflags(&cpu->env);
 
     return 0;
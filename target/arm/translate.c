@@ -2479,6 +2479,7 @@ static void gen_goto_ptr(void)
  */
 static void gen_goto_tb(DisasContext *s, int n, target_ulong dest)
 {
+    translator_note_branch(&s->base, dest);
     if (use_goto_tb(s, dest)) {
         tcg_gen_goto_tb(n);
         gen_set_pc_im(s, dest);
@@ -7856,6 +7857,9 @@ static bool trans_B(DisasContext *s, arg_i *a)
 
 static bool trans_B_cond_thumb(DisasContext *s, arg_ci *a)
 {
+    uint32_t dest = read_pc(s) + a->imm;
+    bool loop;
+
     /* This has cond from encoding, required to be outside IT block.  */
     if (a->cond >= 0xe) {
         return false;
@@ -7864,8 +7868,36 @@ static bool trans_B_cond_thumb(DisasContext *s, arg_ci *a)
         unallocated_encoding(s);
         return true;
     }
-    arm_skip_unless(s, a->cond);
-    gen_jmp(s, read_pc(s) + a->imm);
+
+    /*
+     * A loop closing on the start of the TB. The IT state must match
+     * the one at the start of the TB for the body to be repeated.
+     */
+    loop = dest == s->base.pc_first && !is_singlestepping(s) &&
+           !FIELD_EX32(s->base.tb->flags, TBFLAG_AM32, CONDEXEC);
+    if (loop && translator_loop_unroll(&s->base, dest)) {
+        /* Leave if the branch is not taken, else go on with the next copy */
+        if (!s->loop_exit) {
+            s->loop_exit = gen_new_label();
+            s->loop_exit_pc = s->base.pc_next;
+        }
+        arm_gen_test_cc(a->cond ^ 1, s->loop_exit);
+        s->base.pc_next = dest;
+        return true;
+    }
+
+    if (loop && s->loop_exit) {
+        /* The last copy of an unrolled loop */
+        arm_gen_test_cc(a->cond ^ 1, s->loop_exit);
+        s->loop_closed = true;
+    } else {
+        arm_skip_unless(s, a->cond);
+    }
+    if (loop) {
+        translator_loop_poll(&s->base, dest);
+        translator_loop_count(&s->base, dest);
+    }
+    gen_jmp(s, dest);
     return true;
 }
 
@@ -8943,6 +8975,22 @@ static void arm_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
             gen_goto_tb(dc, 1, dc->base.pc_next);
         }
     }
+
+    if (dc->loop_exit) {
+        /*
+         * Not taken loop branch in an unrolled loop. Unless the TB ended
+         * with the last copy of the loop, goto_tb 1 may be used already.
+         */
+        gen_set_label(dc->loop_exit);
+        if (dc->loop_closed) {
+            gen_goto_tb(dc, 1, dc->loop_exit_pc);
+        } else {
+            gen_set_pc_im(dc, dc->loop_exit_pc);
+            gen_goto_ptr();
+        }
+        /* Have tb->size cover the whole loop body */
+        dc->base.pc_next = MAX(dc->base.pc_next, dc->loop_exit_pc);
+    }
 }
 
 static void arm_tr_disas_log(const DisasContextBase *dcbase, CPUState *cpu)
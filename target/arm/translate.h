@@ -18,6 +18,13 @@ typedef struct DisasContext {
     int condjmp;
     /* The label that will be jumped to when the instruction is skipped.  */
     TCGLabel *condlabel;
+    /*
+     * Side exit shared by the copies of an unrolled loop, and whether
+     * the last copy branches back to the start of the TB.
+     */
+    TCGLabel *loop_exit;
+    target_ulong loop_exit_pc;
+    bool loop_closed;
     /* Thumb-2 conditional execution bits.  */
     int condexec_mask;
     int condexec_cond;
@@ -63,6 +63,7 @@
 
 #include "elf.h"
 #include "exec/log.h"
+#include "accel/tcg/perf.h"
 #include "sysemu/sysemu.h"
 
 /* Forward declarations for functions declared in tcg-target.c.inc and
@@ -1091,6 +1092,7 @@ void tcg_prologue_init(TCGContext *s)
     s->code_gen_buffer_size = total_size;
 
     tcg_register_jit(s->code_gen_buffer, total_size);
+    perf_report_prologue(buf0, prologue_size);
 
 #ifdef DEBUG_DISAS
     if (qemu_loglevel_mask(CPU_LOG_TB_OUT_ASM)) {
@@ -1140,6 +1142,8 @@ void tcg_func_start(TCGContext *s)
     s->nb_ops = 0;
     s->nb_labels = 0;
     s->current_frame_offset = s->frame_start;
+    s->host_ptr_const = false;
+    s->nb_branch_dest = 0;
 
 #ifdef CONFIG_DEBUG_TCG
     s->goto_tb_issue_mask = 0;
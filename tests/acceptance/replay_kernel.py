@@ -13,9 +13,10 @@ import logging
 import time
 
 from avocado import skipIf
-from avocado_qemu import wait_for_console_pattern
+from avocado_qemu import wait_for_console_pattern, BUILD_DIR
 from avocado.utils import archive
 from avocado.utils import process
+from avocado.utils.path import find_command
 from boot_linux_console import LinuxKernelTest
 
 class ReplayKernel(LinuxKernelTest):
@@ -73,6 +74,65 @@ class ReplayKernel(LinuxKernelTest):
         logger = logging.getLogger('replay')
         logger.info('replay overhead {:.2%}'.format(t2 / t1 - 1))
 
+    def hmp_retry(self, vm, command_line):
+        # Snapshots are refused while replay events are pending
+        for _ in range(100):
+            res = vm.command('human-monitor-command',
+                             command_line=command_line)
+            if 'Try once more later' not in res:
+                return res
+            time.sleep(0.1)
+        self.fail('%s: %s' % (command_line, res))
+
+    def run_rr_seek(self, kernel_path, kernel_command_line, early_pattern,
+                    console_pattern, shift, args):
+        """
+        Records with a snapshot at the start and one during the boot,
+        then replays and seeks to the second one through the index of the
+        replay log, and checks that the replay still gets to the end.
+        """
+        logger = logging.getLogger('replay')
+        qemu_img = os.path.join(BUILD_DIR, 'qemu-img')
+        if not os.path.exists(qemu_img):
+            qemu_img = find_command('qemu-img', False)
+        if qemu_img is False:
+            self.cancel('Could not find "qemu-img", which is required to '
+                        'create the image holding the snapshots')
+        image_path = os.path.join(self.workdir, 'disk.qcow2')
+        process.run('%s create -f qcow2 %s 128M' % (qemu_img, image_path))
+        replay_path = os.path.join(self.workdir, 'replay.bin')
+
+        for mode in ('record', 'replay'):
+            vm = self.get_vm()
+            vm.set_console()
+            vm.add_args('-icount', 'shift=%s,rr=%s,rrfile=%s,rrsnapshot=init' %
+                        (shift, mode, replay_path),
+                        '-kernel', kernel_path,
+                        '-append', kernel_command_line,
+                        '-net', 'none',
+                        '-no-reboot',
+                        '-drive', 'file=%s,if=none,id=img-direct' % image_path,
+                        '-drive', 'driver=blkreplay,if=none,'
+                                  'image=img-direct,id=img-blkreplay',
+                        '-device', 'ide-hd,drive=img-blkreplay',
+                        *args)
+            vm.launch()
+            if mode == 'record':
+                self.wait_for_console_pattern(early_pattern, vm)
+                res = self.hmp_retry(vm, 'savevm boot')
+                self.assertEqual(res, '')
+                self.wait_for_console_pattern(console_pattern, vm)
+                vm.shutdown()
+                logger.info('finished the recording with log size %s bytes'
+                            % os.path.getsize(replay_path))
+            else:
+                # Skip to 'boot', the last snapshot in the log
+                res = self.hmp_retry(vm, 'replay_seek %d' % (1 << 62))
+                self.assertEqual(res, '')
+                self.wait_for_console_pattern(console_pattern, vm)
+                vm.wait()
+                logger.info('successfully finished the replay after seeking')
+
     @skipIf(os.getenv('GITLAB_CI'), 'Running on GitLab')
     def test_x86_64_pc(self):
         """
@@ -90,6 +150,25 @@ class ReplayKernel(LinuxKernelTest):
 
         self.run_rr(kernel_path, kernel_command_line, console_pattern, shift=5)
 
+    @skipIf(os.getenv('GITLAB_CI'), 'Running on GitLab')
+    def test_x86_64_pc_seek(self):
+        """
+        :avocado: tags=arch:x86_64
+        :avocado: tags=machine:pc
+        """
+        kernel_url = ('https://archives.fedoraproject.org/pub/archive/fedora'
+                      '/linux/releases/29/Everything/x86_64/os/images/pxeboot'
+                      '/vmlinuz')
+        kernel_hash = '23bebd2680757891cf7adedb033532163a792495'
+        kernel_path = self.fetch_asset(kernel_url, asset_hash=kernel_hash)
+
+        kernel_command_line = self.KERNEL_COMMON_COMMAND_LINE + 'console=ttyS0'
+        early_pattern = 'Kernel command line'
+        console_pattern = 'VFS: Cannot open root device'
+
+        self.run_rr_seek(kernel_path, kernel_command_line, early_pattern,
+                         console_pattern, 5, ())
+
     def test_aarch64_virt(self):
         """
         :avocado: tags=arch:aarch64
@@ -109,6 +188,26 @@ class ReplayKernel(LinuxKernelTest):
         self.run_rr(kernel_path, kernel_command_line, console_pattern,
                     args=('-cpu', 'cortex-a53'))
 
+    def test_aarch64_virt_mttcg(self):
+        """
+        :avocado: tags=arch:aarch64
+        :avocado: tags=machine:virt
+        :avocado: tags=cpu:cortex-a53
+        """
+        kernel_url = ('https://archives.fedoraproject.org/pub/archive/fedora'
+                      '/linux/releases/29/Everything/aarch64/os/images/pxeboot'
+                      '/vmlinuz')
+        kernel_hash = '8c73e469fc6ea06a58dc83a628fc695b693b8493'
+        kernel_path = self.fetch_asset(kernel_url, asset_hash=kernel_hash)
+
+        kernel_command_line = (self.KERNEL_COMMON_COMMAND_LINE +
+                               'console=ttyAMA0')
+        console_pattern = 'VFS: Cannot open root device'
+
+        self.run_rr(kernel_path, kernel_command_line, console_pattern,
+                    args=('-cpu', 'cortex-a53', '-smp', '2',
+                          '-accel', 'tcg,thread=multi'))
+
     def test_arm_virt(self):
         """
         :avocado: tags=arch:arm
@@ -0,0 +1,112 @@
+/*
+ * Interval map lookup speed benchmark
+ *
+ * The memory dispatch code uses an interval map to find the section
+ * covering a guest physical page, on every TLB fill and every access
+ * that goes through address_space_translate(). The maps built here
+ * mimic the physical memory maps of a few machine types.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/interval-map.h"
+
+#define PAGE_BITS 12
+#define N_KEYS 4096
+#define N_LOOKUPS (64 * 1000 * 1000)
+
+typedef struct MapOpts {
+    const char *name;
+    /* number of small MMIO regions, and their largest size in pages */
+    unsigned n_mmio;
+    unsigned max_mmio_pages;
+    /* how many of them share a page with another one */
+    unsigned n_subpage;
+    uint64_t ram_size;
+} MapOpts;
+
+/* Returns the number of intervals, including gaps */
+static unsigned build_map(IntervalMap *map, const MapOpts *opts)
+{
+    uint64_t page = (256 * MiB) >> PAGE_BITS;
+    uint16_t section = 1;
+    unsigned i;
+
+    interval_map_init(map, 0);
+    /* boot ROM and flash */
+    interval_map_append(map, 0, (64 * MiB) >> PAGE_BITS, section++);
+    interval_map_append(map, (64 * MiB) >> PAGE_BITS, (64 * MiB) >> PAGE_BITS,
+                        section++);
+    /* device MMIO window, with the odd gap between devices */
+    for (i = 0; i < opts->n_mmio; i++) {
+        uint64_t pages = i < opts->n_subpage ? 1 :
+                         g_test_rand_int_range(1, opts->max_mmio_pages + 1);
+
+        interval_map_append(map, page, pages, section++);
+        page += pages + (g_test_rand_bit() ? g_test_rand_int_range(1, 16) : 0);
+    }
+    /* RAM */
+    interval_map_append(map, (2 * GiB) >> PAGE_BITS,
+                        opts->ram_size >> PAGE_BITS, section++);
+    interval_map_trim(map);
+    return map->nb;
+}
+
+static void test_lookup_speed(const void *opaque)
+{
+    const MapOpts *opts = opaque;
+    uint64_t *keys = g_new(uint64_t, N_KEYS);
+    IntervalMap map;
+    unsigned nb, i;
+    uint64_t sum = 0;
+
+    nb = build_map(&map, opts);
+
+    /* lookups are spread over the intervals, not over the address space */
+    for (i = 0; i < N_KEYS; i++) {
+        unsigned idx = g_test_rand_int_range(0, nb - 1);
+        uint64_t len = map.starts[idx + 1] - map.starts[idx];
+
+        keys[i] = map.starts[idx] +
+                  g_test_rand_int_range(0, MIN(len, G_MAXINT32));
+    }
+
+    g_test_timer_start();
+    for (i = 0; i < N_LOOKUPS; i++) {
+        sum += interval_map_lookup(&map, keys[i % N_KEYS]);
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("%s: %u intervals, %.2f Mlookups/sec (%" PRIu64 ")",
+                   opts->name, nb, N_LOOKUPS / g_test_timer_last() / 1e6,
+                   sum);
+
+    interval_map_destroy(&map);
+    g_free(keys);
+}
+
+int main(int argc, char **argv)
+{
+    static const MapOpts maps[] = {
+        { .name = "pc", .n_mmio = 24, .max_mmio_pages = 256,
+          .n_subpage = 4, .ram_size = 4 * GiB },
+        { .name = "virt", .n_mmio = 64, .max_mmio_pages = 16,
+          .n_subpage = 32, .ram_size = 8 * GiB },
+        { .name = "soc", .n_mmio = 400, .max_mmio_pages = 4,
+          .n_subpage = 150, .ram_size = 1 * GiB },
+    };
+    char name[64];
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(maps); i++) {
+        snprintf(name, sizeof(name), "/interval-map/benchmark/lookup/%s",
+                 maps[i].name);
+        g_test_add_data_func(name, &maps[i], test_lookup_speed);
+    }
+
+    return g_test_run();
+}
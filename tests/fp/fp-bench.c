@@ -21,6 +21,9 @@
 
 #define MAX_OPERANDS 3
 
+/* widest vector benchmarked with -l, in elements */
+#define MAX_LANES 8
+
 #define SEED_A 0xdeadfacedeadface
 #define SEED_B 0xbadc0feebadc0fee
 #define SEED_C 0xbeefdeadbeefdead
@@ -119,6 +122,7 @@ static enum op operation;
 static enum tester tester;
 static uint64_t n_completed_ops;
 static unsigned int duration = DEFAULT_DURATION_SECS;
+static int lanes = 1;
 static int64_t ns_elapsed;
 /* disable optimizations with volatile */
 static volatile union fp res;
@@ -353,6 +357,84 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
     }
 }
 
+/*
+ * Same as bench(), but going through the float{32,64}_*_vec functions
+ * @lanes elements at a time, as a vector helper would.
+ */
+static void bench_vec(enum precision prec, enum op op)
+{
+    int64_t tf = get_clock() + duration * 1000000000LL;
+    int n_iter = OPS_PER_ITER / lanes;
+
+    while (get_clock() < tf) {
+        float32 a32[MAX_LANES], b32[MAX_LANES], d32[MAX_LANES];
+        float64 a64[MAX_LANES], b64[MAX_LANES], d64[MAX_LANES];
+        int64_t t0;
+        int i;
+
+        for (i = 0; i < lanes; i++) {
+            union fp ops[2];
+
+            update_random_ops(2, prec);
+            fill_random(ops, 2, prec, false);
+            if (prec == PREC_FLOAT32) {
+                a32[i] = ops[0].f32;
+                b32[i] = ops[1].f32;
+            } else {
+                a64[i] = ops[0].f64;
+                b64[i] = ops[1].f64;
+            }
+        }
+
+        t0 = get_clock();
+        for (i = 0; i < n_iter; i++) {
+            switch (prec) {
+            case PREC_FLOAT32:
+                switch (op) {
+                case OP_ADD:
+                    float32_add_vec(d32, a32, b32, lanes, &soft_status);
+                    break;
+                case OP_SUB:
+                    float32_sub_vec(d32, a32, b32, lanes, &soft_status);
+                    break;
+                case OP_MUL:
+                    float32_mul_vec(d32, a32, b32, lanes, &soft_status);
+                    break;
+                case OP_DIV:
+                    float32_div_vec(d32, a32, b32, lanes, &soft_status);
+                    break;
+                default:
+                    g_assert_not_reached();
+                }
+                break;
+            case PREC_FLOAT64:
+                switch (op) {
+                case OP_ADD:
+                    float64_add_vec(d64, a64, b64, lanes, &soft_status);
+                    break;
+                case OP_SUB:
+                    float64_sub_vec(d64, a64, b64, lanes, &soft_status);
+                    break;
+                case OP_MUL:
+                    float64_mul_vec(d64, a64, b64, lanes, &soft_status);
+                    break;
+                case OP_DIV:
+                    float64_div_vec(d64, a64, b64, lanes, &soft_status);
+                    break;
+                default:
+                    g_assert_not_reached();
+                }
+                break;
+            default:
+                g_assert_not_reached();
+            }
+        }
+        ns_elapsed += get_clock() - t0;
+        n_completed_ops += n_iter * lanes;
+        res.u64 = prec == PREC_FLOAT32 ? d32[0] : d64[0];
+    }
+}
+
 #define GEN_BENCH(name, type, prec, op, n_ops)          \
     static void __attribute__((flatten)) name(void)     \
     {                                                   \
@@ -415,6 +497,10 @@ static void run_bench(void)
 {
     bench_func_t f;
 
+    if (lanes > 1) {
+        bench_vec(precision, operation);
+        return;
+    }
     f = bench_funcs[operation][precision];
     g_assert(f);
     f();
@@ -443,6 +529,8 @@ static void usage_complete(int argc, char *argv[])
     fprintf(stderr, " -d = duration, in seconds. Default: %d\n",
             DEFAULT_DURATION_SECS);
     fprintf(stderr, " -h = show this help message.\n");
+    fprintf(stderr, " -l = vector length, in elements (1, 2, 4, 8; soft "
+            "tester and add, sub, mul, div only). Default: 1\n");
     fprintf(stderr, " -o = floating point operation (%s). Default: %s\n",
             op_list, op_names[0]);
     fprintf(stderr, " -p = floating point precision (single, double). "
@@ -541,7 +629,7 @@ static void parse_args(int argc, char *argv[])
     int rounding = ROUND_EVEN;
 
     for (;;) {
-        c = getopt(argc, argv, "d:ho:p:r:t:zZ");
+        c = getopt(argc, argv, "d:hl:o:p:r:t:zZ");
         if (c < 0) {
             break;
         }
@@ -552,6 +640,13 @@ static void parse_args(int argc, char *argv[])
         case 'h':
             usage_complete(argc, argv);
             exit(EXIT_SUCCESS);
+        case 'l':
+            lanes = atoi(optarg);
+            if (lanes != 1 && lanes != 2 && lanes != 4 && lanes != 8) {
+                fprintf(stderr, "Unsupported vector length '%s'\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
         case 'o':
             val = find_name(op_names, optarg);
             if (val < 0) {
@@ -594,6 +689,12 @@ static void parse_args(int argc, char *argv[])
         }
     }
 
+    if (lanes > 1 && (tester != TESTER_SOFT || operation > OP_DIV)) {
+        fprintf(stderr, "fatal: -l requires the soft tester and one of "
+                "add, sub, mul, div\n");
+        exit(EXIT_FAILURE);
+    }
+
     /* set precision and rounding mode based on the tester */
     switch (tester) {
     case TESTER_HOST:
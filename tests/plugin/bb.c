@@ -23,10 +23,15 @@ typedef struct {
     uint64_t insn_count;
 } CPUCount;
 
-/* Used by the inline & linux-user counts */
+/* Used by the linux-user counts */
 static bool do_inline;
 static CPUCount inline_count;
 
+/* Used by the inline counts, one per vCPU so no atomics are needed */
+static struct qemu_plugin_scoreboard *inline_score;
+static qemu_plugin_u64 inline_bb_count;
+static qemu_plugin_u64 inline_insn_count;
+
 /* Dump running CPU total on idle? */
 static bool idle_report;
 static GPtrArray *counts;
@@ -46,7 +51,12 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
 {
     g_autoptr(GString) report = g_string_new("");
 
-    if (do_inline || !max_cpus) {
+    if (do_inline) {
+        g_string_printf(report, "bb's: %" PRIu64", insns: %" PRIu64 "\n",
+                        qemu_plugin_u64_sum(inline_bb_count),
+                        qemu_plugin_u64_sum(inline_insn_count));
+        qemu_plugin_scoreboard_free(inline_score);
+    } else if (!max_cpus) {
         g_string_printf(report, "bb's: %" PRIu64", insns: %" PRIu64 "\n",
                         inline_count.bb_count, inline_count.insn_count);
     } else {
@@ -84,11 +94,10 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
     unsigned long n_insns = qemu_plugin_tb_n_insns(tb);
 
     if (do_inline) {
-        qemu_plugin_register_vcpu_tb_exec_inline(tb, QEMU_PLUGIN_INLINE_ADD_U64,
-                                                 &inline_count.bb_count, 1);
-        qemu_plugin_register_vcpu_tb_exec_inline(tb, QEMU_PLUGIN_INLINE_ADD_U64,
-                                                 &inline_count.insn_count,
-                                                 n_insns);
+        qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+            tb, QEMU_PLUGIN_INLINE_ADD_U64, inline_bb_count, 1);
+        qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+            tb, QEMU_PLUGIN_INLINE_ADD_U64, inline_insn_count, n_insns);
     } else {
         qemu_plugin_register_vcpu_tb_exec_cb(tb, vcpu_tb_exec,
                                              QEMU_PLUGIN_CB_NO_REGS,
@@ -114,7 +123,13 @@ QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
         }
     }
 
-    if (info->system_emulation && !do_inline) {
+    if (do_inline) {
+        inline_score = qemu_plugin_scoreboard_new(sizeof(CPUCount));
+        inline_bb_count = qemu_plugin_scoreboard_u64_in_struct(
+            inline_score, CPUCount, bb_count);
+        inline_insn_count = qemu_plugin_scoreboard_u64_in_struct(
+            inline_score, CPUCount, insn_count);
+    } else if (info->system_emulation) {
         max_cpus = info->system.max_vcpus;
         counts = g_ptr_array_new();
         for (i = 0; i < max_cpus; i++) {
@@ -0,0 +1,155 @@
+/*
+ * Check per-vCPU inline operations and conditional callbacks against
+ * regular callbacks.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+/* A TB conditional callback fires every TB_PERIOD executions */
+#define TB_PERIOD 16
+/* Stored before each insn, and tested by its conditional callback */
+#define INSN_MARK 0x5a5a5a5a12345678ULL
+
+typedef struct {
+    uint64_t tb_inline;
+    uint64_t tb_cb;
+    uint64_t tb_period;
+    uint64_t tb_cond_cb;
+    uint64_t insn_inline;
+    uint64_t insn_mark;
+    uint64_t insn_cond_cb;
+    uint64_t mem_inline;
+    uint64_t mem_cb;
+} CPUCount;
+
+static struct qemu_plugin_scoreboard *score;
+static qemu_plugin_u64 tb_inline;
+static qemu_plugin_u64 tb_cb;
+static qemu_plugin_u64 tb_period;
+static qemu_plugin_u64 tb_cond_cb;
+static qemu_plugin_u64 insn_inline;
+static qemu_plugin_u64 insn_mark;
+static qemu_plugin_u64 insn_cond_cb;
+static qemu_plugin_u64 mem_inline;
+static qemu_plugin_u64 mem_cb;
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autoptr(GString) out = g_string_new("");
+    uint64_t tbs = qemu_plugin_u64_sum(tb_inline);
+    uint64_t insns = qemu_plugin_u64_sum(insn_inline);
+    uint64_t mems = qemu_plugin_u64_sum(mem_inline);
+
+    g_string_printf(out, "tbs: %" PRIu64 ", insns: %" PRIu64
+                    ", mem accesses: %" PRIu64 "\n", tbs, insns, mems);
+    qemu_plugin_outs(out->str);
+
+    g_assert_cmpuint(tbs, ==, qemu_plugin_u64_sum(tb_cb));
+    g_assert_cmpuint(tbs, ==, qemu_plugin_u64_sum(tb_cond_cb) * TB_PERIOD +
+                     qemu_plugin_u64_sum(tb_period));
+    g_assert_cmpuint(insns, ==, qemu_plugin_u64_sum(insn_cond_cb));
+    g_assert_cmpuint(mems, ==, qemu_plugin_u64_sum(mem_cb));
+
+    qemu_plugin_scoreboard_free(score);
+}
+
+static void vcpu_tb_exec(unsigned int cpu_index, void *udata)
+{
+    qemu_plugin_u64_add(tb_cb, cpu_index, 1);
+}
+
+static void vcpu_tb_cond(unsigned int cpu_index, void *udata)
+{
+    g_assert_cmpuint(qemu_plugin_u64_get(tb_period, cpu_index), ==,
+                     TB_PERIOD);
+    qemu_plugin_u64_set(tb_period, cpu_index, 0);
+    qemu_plugin_u64_add(tb_cond_cb, cpu_index, 1);
+}
+
+static void vcpu_insn_cond(unsigned int cpu_index, void *udata)
+{
+    /* the next insn only gets here if its store works again */
+    qemu_plugin_u64_set(insn_mark, cpu_index, 0);
+    qemu_plugin_u64_add(insn_cond_cb, cpu_index, 1);
+}
+
+static void vcpu_mem(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
+                     uint64_t vaddr, void *udata)
+{
+    qemu_plugin_u64_add(mem_cb, cpu_index, 1);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    size_t n = qemu_plugin_tb_n_insns(tb);
+    size_t i;
+
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, tb_inline, 1);
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, tb_period, 1);
+    qemu_plugin_register_vcpu_tb_exec_cb(tb, vcpu_tb_exec,
+                                         QEMU_PLUGIN_CB_NO_REGS, NULL);
+    qemu_plugin_register_vcpu_tb_exec_cond_cb(tb, vcpu_tb_cond,
+                                              QEMU_PLUGIN_CB_NO_REGS,
+                                              QEMU_PLUGIN_COND_GE, tb_period,
+                                              TB_PERIOD, NULL);
+
+    for (i = 0; i < n; i++) {
+        struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
+
+        qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+            insn, QEMU_PLUGIN_INLINE_ADD_U64, insn_inline, 1);
+        qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+            insn, QEMU_PLUGIN_INLINE_STORE_U64, insn_mark, INSN_MARK);
+        qemu_plugin_register_vcpu_insn_exec_cond_cb(
+            insn, vcpu_insn_cond, QEMU_PLUGIN_CB_NO_REGS,
+            QEMU_PLUGIN_COND_EQ, insn_mark, INSN_MARK, NULL);
+
+        qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+            insn, QEMU_PLUGIN_MEM_RW, QEMU_PLUGIN_INLINE_ADD_U64,
+            mem_inline, 1);
+        qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem,
+                                         QEMU_PLUGIN_CB_NO_REGS,
+                                         QEMU_PLUGIN_MEM_RW, NULL);
+    }
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+                                           const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    score = qemu_plugin_scoreboard_new(sizeof(CPUCount));
+    tb_inline = qemu_plugin_scoreboard_u64_in_struct(score, CPUCount,
+                                                     tb_inline);
+    tb_cb = qemu_plugin_scoreboard_u64_in_struct(score, CPUCount, tb_cb);
+    tb_period = qemu_plugin_scoreboard_u64_in_struct(score, CPUCount,
+                                                     tb_period);
+    tb_cond_cb = qemu_plugin_scoreboard_u64_in_struct(score, CPUCount,
+                                                      tb_cond_cb);
+    insn_inline = qemu_plugin_scoreboard_u64_in_struct(score, CPUCount,
+                                                       insn_inline);
+    insn_mark = qemu_plugin_scoreboard_u64_in_struct(score, CPUCount,
+                                                     insn_mark);
+    insn_cond_cb = qemu_plugin_scoreboard_u64_in_struct(score, CPUCount,
+                                                        insn_cond_cb);
+    mem_inline = qemu_plugin_scoreboard_u64_in_struct(score, CPUCount,
+                                                      mem_inline);
+    mem_cb = qemu_plugin_scoreboard_u64_in_struct(score, CPUCount, mem_cb);
+
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
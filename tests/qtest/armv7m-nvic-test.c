@@ -0,0 +1,134 @@
+/*
+ * QTest testcase for the ARMv7M NVIC
+ *
+ * This code is licensed under the GPL version 2 or later.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "libqos/libqtest.h"
+
+/* The netduino2 (STM32F205) NVIC has 96 external interrupts */
+#define NUM_IRQ 96
+
+#define NVIC_BASE 0xe000e000
+#define NVIC_ISER (NVIC_BASE + 0x100)
+#define NVIC_ICER (NVIC_BASE + 0x180)
+#define NVIC_ISPR (NVIC_BASE + 0x200)
+#define NVIC_ICPR (NVIC_BASE + 0x280)
+#define NVIC_IPR (NVIC_BASE + 0x400)
+#define NVIC_ICSR (NVIC_BASE + 0xd04)
+#define NVIC_STIR (NVIC_BASE + 0xf00)
+
+#define ICSR_VECTPENDING(v) extract32(v, 12, 9)
+
+static int vectpending(QTestState *qts)
+{
+    return ICSR_VECTPENDING(qtest_readl(qts, NVIC_ICSR));
+}
+
+static void set_enable(QTestState *qts, int irq, bool enable)
+{
+    qtest_writel(qts, (enable ? NVIC_ISER : NVIC_ICER) + (irq / 32) * 4,
+                 1u << (irq % 32));
+}
+
+static void set_pending(QTestState *qts, int irq, bool pending)
+{
+    qtest_writel(qts, (pending ? NVIC_ISPR : NVIC_ICPR) + (irq / 32) * 4,
+                 1u << (irq % 32));
+}
+
+static void test_vectpending(void)
+{
+    QTestState *qts = qtest_init("-machine netduino2");
+    int irq;
+
+    g_assert_cmpint(vectpending(qts), ==, 0);
+
+    /* Pending but not enabled interrupts are not reported */
+    set_pending(qts, 40, true);
+    set_pending(qts, 70, true);
+    g_assert_cmpint(vectpending(qts), ==, 0);
+
+    /* With equal priority the lowest exception number wins */
+    set_enable(qts, 70, true);
+    g_assert_cmpint(vectpending(qts), ==, 70 + 16);
+    set_enable(qts, 40, true);
+    g_assert_cmpint(vectpending(qts), ==, 40 + 16);
+
+    /* A higher priority (lower value) wins over the exception number */
+    qtest_writeb(qts, NVIC_IPR + 40, 0x20);
+    qtest_writeb(qts, NVIC_IPR + 70, 0x10);
+    g_assert_cmpint(vectpending(qts), ==, 70 + 16);
+
+    set_pending(qts, 70, false);
+    g_assert_cmpint(vectpending(qts), ==, 40 + 16);
+    set_enable(qts, 40, false);
+    g_assert_cmpint(vectpending(qts), ==, 0);
+    set_enable(qts, 40, true);
+    g_assert_cmpint(vectpending(qts), ==, 40 + 16);
+    set_pending(qts, 40, false);
+    g_assert_cmpint(vectpending(qts), ==, 0);
+
+    /* Software triggered interrupts go through the same path */
+    qtest_writeb(qts, NVIC_IPR + 40, 0);
+    qtest_writeb(qts, NVIC_IPR + 70, 0);
+    for (irq = NUM_IRQ - 1; irq >= 0; irq--) {
+        set_enable(qts, irq, true);
+        qtest_writel(qts, NVIC_STIR, irq);
+        g_assert_cmpint(vectpending(qts), ==, irq + 16);
+    }
+    for (irq = 0; irq < NUM_IRQ - 1; irq++) {
+        set_pending(qts, irq, false);
+        g_assert_cmpint(vectpending(qts), ==, irq + 1 + 16);
+    }
+    set_pending(qts, NUM_IRQ - 1, false);
+    g_assert_cmpint(vectpending(qts), ==, 0);
+
+    qtest_quit(qts);
+}
+
+static void perf_irq_flood(void)
+{
+    QTestState *qts = qtest_init("-machine netduino2");
+    unsigned long count = 0;
+    double duration;
+    int irq;
+
+    for (irq = 0; irq < NUM_IRQ; irq++) {
+        set_enable(qts, irq, true);
+        qtest_writeb(qts, NVIC_IPR + irq, (irq % 16) << 4);
+    }
+
+    g_test_timer_start();
+    do {
+        for (irq = 0; irq < NUM_IRQ; irq++) {
+            qtest_writel(qts, NVIC_STIR, irq);
+        }
+        for (irq = 0; irq < NUM_IRQ; irq++) {
+            set_pending(qts, irq, false);
+        }
+        count += NUM_IRQ;
+        duration = g_test_timer_elapsed();
+    } while (duration < 5.0);
+
+    g_test_message("%lu IRQs pended and cleared in %.2f s: %.0f IRQs/s",
+                   count, duration, count / duration);
+    g_assert_cmpint(vectpending(qts), ==, 0);
+
+    qtest_quit(qts);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/armv7m-nvic/vectpending", test_vectpending);
+    if (g_test_perf()) {
+        qtest_add_func("/armv7m-nvic/perf/irq-flood", perf_irq_flood);
+    }
+
+    return g_test_run();
+}
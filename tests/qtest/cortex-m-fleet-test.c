@@ -0,0 +1,107 @@
+/*
+ * QTest testcase for the cortex-m-fleet machine
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqos/libqtest.h"
+
+#define NUM_NODES 3
+
+/* Prints 'T' on the board's UART, loaded once for all the boards */
+static const uint8_t kernel_fleet[] = {
+    0x00, 0x10, 0x00, 0x20,                 /* Stack top address */
+    0x09, 0x00, 0x00, 0x00,                 /* Reset handler address */
+    0x03, 0x4a,                             /* ldr  r2, [pc, #12] UART */
+    0x01, 0x21,                             /* movs r1, #1 */
+    0x91, 0x60,                             /* str  r1, [r2, #8] Set TX_EN */
+    0x54, 0x21,                             /* movs r1, 'T' */
+    0x11, 0x60,                             /* str  r1, [r2] Write DATA */
+    0xfe, 0xe7,                             /* b    . */
+    0x00, 0xbf,                             /* nop */
+    0x00, 0xbf,                             /* nop */
+    0x00, 0x40, 0x00, 0x40,                 /* 0x40004000 = UART */
+};
+
+/* Wait for each board to print @expect */
+static void wait_for_output(QTestState *qts, char **paths, const char *expect)
+{
+    time_t start = time(NULL);
+    int i;
+
+    for (i = 0; i < NUM_NODES; i++) {
+        while (1) {
+            g_autofree char *out = NULL;
+
+            g_assert(g_file_get_contents(paths[i], &out, NULL, NULL));
+            if (!strcmp(out, expect)) {
+                break;
+            }
+            g_assert(qtest_probe_child(qts));
+            /* Wait at most 360 seconds.  */
+            g_assert_cmpint(time(NULL) - start, <, 360);
+            g_usleep(10000);
+        }
+    }
+}
+
+static void test_boot(void)
+{
+    char codetmp[] = "/tmp/qtest-cortex-m-fleet-cXXXXXX";
+    g_autofree char *dir = NULL;
+    char *paths[NUM_NODES];
+    GString *args;
+    QTestState *qts;
+    ssize_t wlen;
+    int fd, i;
+
+    dir = g_dir_make_tmp("qtest-cortex-m-fleet-XXXXXX", NULL);
+    g_assert(dir);
+
+    fd = mkstemp(codetmp);
+    g_assert(fd != -1);
+    wlen = write(fd, kernel_fleet, sizeof(kernel_fleet));
+    g_assert(wlen == sizeof(kernel_fleet));
+    close(fd);
+
+    args = g_string_new(NULL);
+    g_string_append_printf(args, "-M cortex-m-fleet -smp %d -kernel %s "
+                           "-accel tcg", NUM_NODES, codetmp);
+    for (i = 0; i < NUM_NODES; i++) {
+        paths[i] = g_strdup_printf("%s/node%d.log", dir, i);
+        g_string_append_printf(args, " -chardev file,id=serial%d,path=%s"
+                               " -serial chardev:serial%d", i, paths[i], i);
+    }
+
+    qts = qtest_init(args->str);
+    unlink(codetmp);
+
+    wait_for_output(qts, paths, "T");
+
+    /*
+     * By now the image is only in the flash, which each board reads
+     * through its own address space.
+     */
+    qtest_qmp_assert_success(qts, "{ 'execute': 'system_reset' }");
+    wait_for_output(qts, paths, "TT");
+
+    qtest_quit(qts);
+
+    for (i = 0; i < NUM_NODES; i++) {
+        unlink(paths[i]);
+        g_free(paths[i]);
+    }
+    rmdir(dir);
+    g_string_free(args, true);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/cortex-m-fleet/boot", test_boot);
+
+    return g_test_run();
+}
@@ -278,6 +278,39 @@ static void test_i440fx_pam(gconstpointer opaque)
     qtest_end();
 }
 
+/*
+ * Each PAM write switches a set of aliases on and off, so this measures
+ * the cost of a memory region transaction commit, as seen by guests that
+ * bank-switch a window over and over.  Only one address space (the system
+ * memory view) changes; the others should be left alone.
+ */
+static void perf_i440fx_pam_toggle(gconstpointer opaque)
+{
+    const TestData *s = opaque;
+    const int n_toggles = 100000;
+    QPCIBus *bus;
+    QPCIDevice *dev;
+    int i;
+
+    bus = test_start_get_bus(s);
+    dev = qpci_device_find(bus, QPCI_DEVFN(0, 0));
+    g_assert(dev != NULL);
+
+    g_test_timer_start();
+    for (i = 0; i < n_toggles; i++) {
+        /* PAM1 low nibble: 0xc0000..0xc3fff */
+        qpci_config_writeb(dev, 0x5a, i & 1 ? PAM_RE | PAM_WE : 0);
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("%d PAM toggles: %.0f toggles/sec", n_toggles,
+                   n_toggles / g_test_timer_last());
+
+    g_free(dev);
+    qpci_free_pc(bus);
+    qtest_end();
+}
+
 #define BLOB_SIZE ((size_t)65536)
 #define ISA_BIOS_MAXSZ ((size_t)(128 * 1024))
 
@@ -406,6 +439,10 @@ int main(int argc, char **argv)
 
     qtest_add_data_func("i440fx/defaults", &data, test_i440fx_defaults);
     qtest_add_data_func("i440fx/pam", &data, test_i440fx_pam);
+    if (g_test_perf()) {
+        qtest_add_data_func("i440fx/perf/pam-toggle", &data,
+                            perf_i440fx_pam_toggle);
+    }
     add_firmware_test("i440fx/firmware/bios", request_bios);
     add_firmware_test("i440fx/firmware/pflash", request_pflash);
 
@@ -0,0 +1,108 @@
+/*
+ * QTest testcase for in-memory snapshots
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqos/libqtest.h"
+#include "qapi/qmp/qdict.h"
+
+#define RAM_ADDR    0x100000
+#define ZERO_ADDR   0x200000
+#define REGION_SIZE 0x10000
+
+static void check_ram(QTestState *qts, uint64_t addr, uint8_t pattern)
+{
+    g_autofree uint8_t *buf = g_malloc(REGION_SIZE);
+    int i;
+
+    qtest_memread(qts, addr, buf, REGION_SIZE);
+    for (i = 0; i < REGION_SIZE; i++) {
+        g_assert_cmphex(buf[i], ==, pattern);
+    }
+}
+
+/* The commands stop the VM, so skip the STOP and RESUME events */
+static QDict *snapshot_cmd(QTestState *qts, const char *cmd)
+{
+    QDict *response;
+
+    qtest_qmp_send(qts, "{ 'execute': %s }", cmd);
+    for (;;) {
+        response = qtest_qmp_receive(qts);
+        if (!qdict_haskey(response, "event")) {
+            return response;
+        }
+        qobject_unref(response);
+    }
+}
+
+static void snapshot_cmd_success(QTestState *qts, const char *cmd)
+{
+    QDict *response = snapshot_cmd(qts, cmd);
+
+    g_assert(qdict_haskey(response, "return"));
+    qobject_unref(response);
+}
+
+static void test_no_snapshot(void)
+{
+    QTestState *qts;
+    QDict *response;
+
+    qts = qtest_init("-m 32");
+
+    response = snapshot_cmd(qts, "x-snapshot-load-mem");
+    g_assert(qdict_haskey(response, "error"));
+    qobject_unref(response);
+
+    qtest_quit(qts);
+}
+
+static void test_save_load(void)
+{
+    QTestState *qts;
+    char *resp;
+    int i;
+
+    qts = qtest_init("-m 32");
+
+    qtest_memset(qts, RAM_ADDR, 0x5a, REGION_SIZE);
+    qtest_memset(qts, ZERO_ADDR, 0, REGION_SIZE);
+    snapshot_cmd_success(qts, "x-snapshot-save-mem");
+
+    /* The snapshot is kept, so it can be loaded more than once */
+    for (i = 0; i < 3; i++) {
+        qtest_memset(qts, RAM_ADDR, 0xa5, REGION_SIZE / 2);
+        qtest_memset(qts, ZERO_ADDR, 0xff, REGION_SIZE);
+        snapshot_cmd_success(qts, "x-snapshot-load-mem");
+        check_ram(qts, RAM_ADDR, 0x5a);
+        check_ram(qts, ZERO_ADDR, 0);
+    }
+
+    /* A new snapshot replaces the previous one */
+    qtest_memset(qts, RAM_ADDR, 0x3c, REGION_SIZE);
+    resp = qtest_hmp(qts, "savevm-mem");
+    g_assert_cmpstr(resp, ==, "");
+    g_free(resp);
+
+    qtest_memset(qts, RAM_ADDR, 0, REGION_SIZE);
+    resp = qtest_hmp(qts, "loadvm-mem");
+    g_assert_cmpstr(resp, ==, "");
+    g_free(resp);
+    check_ram(qts, RAM_ADDR, 0x3c);
+
+    qtest_quit(qts);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/snapshot-mem/no-snapshot", test_no_snapshot);
+    qtest_add_func("/snapshot-mem/save-load", test_save_load);
+
+    return g_test_run();
+}
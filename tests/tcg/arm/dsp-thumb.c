@@ -0,0 +1,135 @@
+/*
+ * Thumb-2 DSP arithmetic exerciser
+ *
+ * Runs a compiler-style loop mixing flag setting arithmetic with the
+ * saturating and parallel add/subtract instructions, checking results,
+ * the Q flag and the GE bits against a plain C model. The loop keeps
+ * NZCV live across the DSP instructions, so its run time is sensitive
+ * to how much guest state has to be spilled around each helper call.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ITERATIONS (1 << 20)
+
+#define CPSR_Q  (1u << 27)
+#define CPSR_GE (0xfu << 16)
+
+static uint32_t get_apsr(void)
+{
+    uint32_t r;
+    asm volatile("mrs %0, APSR" : "=r"(r));
+    return r;
+}
+
+static void clear_apsr(void)
+{
+    asm volatile("msr APSR_nzcvqg, %0" : : "r"(0) : "cc");
+}
+
+static int32_t sat32(int64_t v, int *q)
+{
+    if (v > INT32_MAX) {
+        *q = 1;
+        return INT32_MAX;
+    } else if (v < INT32_MIN) {
+        *q = 1;
+        return INT32_MIN;
+    }
+    return v;
+}
+
+static int32_t ssat_model(int32_t v, int bits, int *q)
+{
+    int32_t max = (1 << (bits - 1)) - 1, min = -(1 << (bits - 1));
+
+    if (v > max) {
+        *q = 1;
+        return max;
+    } else if (v < min) {
+        *q = 1;
+        return min;
+    }
+    return v;
+}
+
+static uint32_t uadd8_model(uint32_t a, uint32_t b, uint32_t *ge)
+{
+    uint32_t res = 0;
+    int i;
+
+    *ge = 0;
+    for (i = 0; i < 4; i++) {
+        uint32_t sum = ((a >> (i * 8)) & 0xff) + ((b >> (i * 8)) & 0xff);
+        res |= (sum & 0xff) << (i * 8);
+        if (sum > 0xff) {
+            *ge |= 1u << i;
+        }
+    }
+    return res;
+}
+
+static uint32_t lcg_next(uint32_t *state)
+{
+    *state = *state * 1103515245 + 12345;
+    return *state;
+}
+
+int main(int argc, char **argv)
+{
+    struct timespec start, end;
+    uint32_t state = 1, acc = 0;
+    double elapsed;
+    int i, err = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < ITERATIONS; i++) {
+        uint32_t a = lcg_next(&state), b = lcg_next(&state);
+        uint32_t qadd, ssat, uadd8, apsr, ge;
+        int q = 0;
+
+        clear_apsr();
+        asm volatile("qadd %0, %4, %5\n\t"
+                     "ssat %1, #16, %4\n\t"
+                     "uadd8 %2, %4, %5\n\t"
+                     "mrs %3, APSR"
+                     : "=&r"(qadd), "=&r"(ssat), "=&r"(uadd8), "=&r"(apsr)
+                     : "r"(a), "r"(b)
+                     : "cc");
+
+        if (qadd != (uint32_t)sat32((int64_t)(int32_t)a + (int32_t)b, &q) ||
+            ssat != (uint32_t)ssat_model(a, 16, &q) ||
+            uadd8 != uadd8_model(a, b, &ge) ||
+            !!(apsr & CPSR_Q) != q ||
+            ((apsr & CPSR_GE) >> 16) != ge) {
+            printf("FAIL: a=%#x b=%#x: qadd %#x ssat %#x uadd8 %#x "
+                   "apsr %#x\n", a, b, qadd, ssat, uadd8, apsr);
+            err = 1;
+            break;
+        }
+        acc += qadd ^ ssat ^ uadd8;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    /* The sticky Q flag must survive later flag setting arithmetic */
+    clear_apsr();
+    acc = 0x7fffffff;
+    asm volatile("qadd %0, %0, %0\n\t"
+                 "adds %0, %0, #1"
+                 : "+r"(acc) : : "cc");
+    if (!(get_apsr() & CPSR_Q)) {
+        printf("FAIL: Q flag lost after ADDS\n");
+        err = 1;
+    }
+
+    elapsed = (end.tv_sec - start.tv_sec) +
+              (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%d DSP iterations in %.3f s\n", ITERATIONS, elapsed);
+
+    return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
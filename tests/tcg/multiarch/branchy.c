@@ -0,0 +1,90 @@
+/*
+ * Indirect branch exerciser
+ *
+ * Calls a few hundred small functions through a function pointer
+ * table in pseudo-random order. Every call ends in an indirect jump
+ * to a different translation block, which makes the run time of this
+ * test dominated by the TB jump cache and the TB hash table rather
+ * than by generated code.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ITERATIONS (1 << 22)
+
+typedef uint32_t (*branch_fn)(uint32_t);
+
+#define FN(n)                                                   \
+    static uint32_t __attribute__((noinline)) fn_##n(uint32_t x) \
+    {                                                           \
+        return x + n;                                           \
+    }
+#define FN8(n) FN(n##0) FN(n##1) FN(n##2) FN(n##3) \
+               FN(n##4) FN(n##5) FN(n##6) FN(n##7)
+#define FN64(n) FN8(n##0) FN8(n##1) FN8(n##2) FN8(n##3) \
+                FN8(n##4) FN8(n##5) FN8(n##6) FN8(n##7)
+
+FN64(1) FN64(2) FN64(3) FN64(4)
+
+#define P(n) fn_##n,
+#define P8(n) P(n##0) P(n##1) P(n##2) P(n##3) \
+              P(n##4) P(n##5) P(n##6) P(n##7)
+#define P64(n) P8(n##0) P8(n##1) P8(n##2) P8(n##3) \
+               P8(n##4) P8(n##5) P8(n##6) P8(n##7)
+
+static const branch_fn fns[] = {
+    P64(1) P64(2) P64(3) P64(4)
+};
+
+#define NUM_FNS (sizeof(fns) / sizeof(fns[0]))
+
+/* fn_N adds N, so the expected result can be computed without calls */
+static const uint32_t fn_values[] = {
+#define V(n) n,
+#define V8(n) V(n##0) V(n##1) V(n##2) V(n##3) \
+              V(n##4) V(n##5) V(n##6) V(n##7)
+#define V64(n) V8(n##0) V8(n##1) V8(n##2) V8(n##3) \
+               V8(n##4) V8(n##5) V8(n##6) V8(n##7)
+    V64(1) V64(2) V64(3) V64(4)
+};
+
+static uint32_t lcg_next(uint32_t *state)
+{
+    *state = *state * 1103515245 + 12345;
+    return *state >> 16;
+}
+
+int main(int argc, char **argv)
+{
+    struct timespec start, end;
+    uint32_t state = 1, acc = 0, expected = 0;
+    double elapsed;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < ITERATIONS; i++) {
+        acc = fns[lcg_next(&state) % NUM_FNS](acc);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    state = 1;
+    for (i = 0; i < ITERATIONS; i++) {
+        expected += fn_values[lcg_next(&state) % NUM_FNS];
+    }
+
+    elapsed = (end.tv_sec - start.tv_sec) +
+              (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%d indirect calls over %zu targets in %.3f s\n",
+           ITERATIONS, NUM_FNS, elapsed);
+
+    if (acc != expected) {
+        printf("FAIL: got %#x, expected %#x\n", acc, expected);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+/*
+ * Sorted interval map tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/interval-map.h"
+
+#define DFLT 0
+
+static void test_empty(void)
+{
+    IntervalMap map;
+
+    interval_map_init(&map, DFLT);
+    g_assert_cmpint(interval_map_lookup(&map, 0), ==, DFLT);
+    g_assert_cmpint(interval_map_lookup(&map, UINT64_MAX), ==, DFLT);
+    interval_map_destroy(&map);
+}
+
+static void test_gaps(void)
+{
+    IntervalMap map;
+
+    interval_map_init(&map, DFLT);
+    interval_map_append(&map, 0, 0x10, 1);
+    interval_map_append(&map, 0x10, 1, 2);
+    interval_map_append(&map, 0x20, 0x100, 3);
+    interval_map_trim(&map);
+
+    g_assert_cmpint(interval_map_lookup(&map, 0), ==, 1);
+    g_assert_cmpint(interval_map_lookup(&map, 0xf), ==, 1);
+    g_assert_cmpint(interval_map_lookup(&map, 0x10), ==, 2);
+    g_assert_cmpint(interval_map_lookup(&map, 0x11), ==, DFLT);
+    g_assert_cmpint(interval_map_lookup(&map, 0x1f), ==, DFLT);
+    g_assert_cmpint(interval_map_lookup(&map, 0x20), ==, 3);
+    g_assert_cmpint(interval_map_lookup(&map, 0x11f), ==, 3);
+    g_assert_cmpint(interval_map_lookup(&map, 0x120), ==, DFLT);
+    g_assert_cmpint(interval_map_lookup(&map, UINT64_MAX), ==, DFLT);
+    interval_map_destroy(&map);
+}
+
+static void test_full(void)
+{
+    IntervalMap map;
+
+    interval_map_init(&map, DFLT);
+    interval_map_append(&map, 0, 0, 1);
+    g_assert_cmpint(map.nb, ==, 1);
+    g_assert_cmpint(interval_map_lookup(&map, UINT64_MAX), ==, 1);
+    interval_map_destroy(&map);
+
+    interval_map_init(&map, DFLT);
+    interval_map_append(&map, 1ULL << 63, 0, 1);
+    g_assert_cmpint(interval_map_lookup(&map, (1ULL << 63) - 1), ==, DFLT);
+    g_assert_cmpint(interval_map_lookup(&map, 1ULL << 63), ==, 1);
+    g_assert_cmpint(interval_map_lookup(&map, UINT64_MAX), ==, 1);
+    interval_map_destroy(&map);
+}
+
+/* Compare against a linear scan on many randomly spaced intervals */
+static void test_random(void)
+{
+    const int n = 1000;
+    uint64_t *start = g_new(uint64_t, n), *end = g_new(uint64_t, n);
+    IntervalMap map;
+    uint64_t pos = 0;
+    int i, j;
+
+    interval_map_init(&map, DFLT);
+    for (i = 0; i < n; i++) {
+        pos += g_test_rand_int_range(0, 3);
+        start[i] = pos;
+        pos += g_test_rand_int_range(1, 5);
+        end[i] = pos;
+        interval_map_append(&map, start[i], end[i] - start[i], i + 1);
+    }
+
+    for (pos = 0; pos < end[n - 1] + 2; pos++) {
+        uint16_t expected = DFLT;
+
+        for (j = 0; j < n; j++) {
+            if (pos >= start[j] && pos < end[j]) {
+                expected = j + 1;
+                break;
+            }
+        }
+        g_assert_cmpint(interval_map_lookup(&map, pos), ==, expected);
+    }
+
+    interval_map_destroy(&map);
+    g_free(start);
+    g_free(end);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/interval-map/empty", test_empty);
+    g_test_add_func("/interval-map/gaps", test_gaps);
+    g_test_add_func("/interval-map/full", test_full);
+    g_test_add_func("/interval-map/random", test_random);
+    return g_test_run();
+}
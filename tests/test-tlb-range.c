@@ -0,0 +1,117 @@
+/*
+ * Test the page ranges of TLB flushes
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "exec/tlb-range.h"
+
+#define TEST_PAGE_BITS 12
+#define TEST_PAGE_SIZE (1ULL << TEST_PAGE_BITS)
+
+typedef struct {
+    uint64_t addr, len;
+    unsigned addr_bits;
+    bool ok;
+    uint64_t aligned_addr, aligned_len;
+} AlignTest;
+
+static const AlignTest align_tests[] = {
+    /* Within a page */
+    { 0x1000, 1, 32, true, 0x1000, TEST_PAGE_SIZE },
+    { 0x1fff, 1, 32, true, 0x1000, TEST_PAGE_SIZE },
+    /* Straddling pages */
+    { 0x1fff, 2, 32, true, 0x1000, 2 * TEST_PAGE_SIZE },
+    { 0x1800, 0x2000, 64, true, 0x1000, 3 * TEST_PAGE_SIZE },
+    /* Wrapping around the end of the address space */
+    { 0xfffff800, 0x1000, 32, true, 0xfffff000, 2 * TEST_PAGE_SIZE },
+    { -0x800ULL, 0x1000, 64, true, -TEST_PAGE_SIZE, 2 * TEST_PAGE_SIZE },
+    /* All pages but one */
+    { 0, 0xfffff000, 32, true, 0, 0xfffff000 },
+    { 0x10, 0xffffefe0, 32, true, 0, 0xfffff000 },
+    { 0, -TEST_PAGE_SIZE, 64, true, 0, -TEST_PAGE_SIZE },
+    /* Every page */
+    { 0, 0xffffffff, 32, false },
+    { 0x10, 0xfffff000, 32, false },
+    { 0xfffff000, 0xffffffff, 32, false },
+    { 0, -1ULL, 64, false },
+    { 0x10, -TEST_PAGE_SIZE - 0xf, 64, false },
+    { -1ULL, -1ULL, 64, false },
+};
+
+static void test_align(void)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(align_tests); i++) {
+        const AlignTest *t = &align_tests[i];
+        uint64_t addr = t->addr, len = t->len;
+
+        g_assert_cmpint(tlb_range_align(&addr, &len, TEST_PAGE_BITS,
+                                        t->addr_bits), ==, t->ok);
+        if (t->ok) {
+            g_assert_cmphex(addr, ==, t->aligned_addr);
+            g_assert_cmphex(len, ==, t->aligned_len);
+        } else {
+            g_assert_cmphex(addr, ==, t->addr);
+            g_assert_cmphex(len, ==, t->len);
+        }
+    }
+}
+
+typedef struct {
+    uint64_t to_addr, to_len, addr, len;
+    unsigned addr_bits;
+    bool ok;
+    uint64_t merged_addr, merged_len;
+} MergeTest;
+
+static const MergeTest merge_tests[] = {
+    /* Adjacent, either way round */
+    { 0x1000, 0x1000, 0x2000, 0x1000, 32, true, 0x1000, 0x2000 },
+    { 0x2000, 0x1000, 0x1000, 0x1000, 32, true, 0x1000, 0x2000 },
+    /* Overlapping and nested */
+    { 0x1000, 0x3000, 0x2000, 0x3000, 32, true, 0x1000, 0x4000 },
+    { 0x1000, 0x4000, 0x2000, 0x1000, 64, true, 0x1000, 0x4000 },
+    { 0x2000, 0x1000, 0x1000, 0x4000, 64, true, 0x1000, 0x4000 },
+    /* Disjoint */
+    { 0x1000, 0x1000, 0x3000, 0x1000, 32, false },
+    { 0x3000, 0x1000, 0x1000, 0x1000, 64, false },
+    /* Reaching the end of the address space */
+    { 0xfffff000, 0x1000, 0xffffe000, 0x1000, 32, false },
+    { 0xffffe000, 0x1000, 0xfffff000, 0x1000, 32, false },
+    { 0xffffe000, 0x1000, 0xfffff000, 0x1000, 64, true,
+      0xffffe000, 0x2000 },
+    { -TEST_PAGE_SIZE, TEST_PAGE_SIZE, -2 * TEST_PAGE_SIZE, TEST_PAGE_SIZE,
+      64, false },
+};
+
+static void test_merge(void)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(merge_tests); i++) {
+        const MergeTest *t = &merge_tests[i];
+        uint64_t addr = t->to_addr, len = t->to_len;
+
+        g_assert_cmpint(tlb_range_merge(&addr, &len, t->addr, t->len,
+                                        t->addr_bits), ==, t->ok);
+        if (t->ok) {
+            g_assert_cmphex(addr, ==, t->merged_addr);
+            g_assert_cmphex(len, ==, t->merged_len);
+        } else {
+            g_assert_cmphex(addr, ==, t->to_addr);
+            g_assert_cmphex(len, ==, t->to_len);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/tlb-range/align", test_align);
+    g_test_add_func("/tlb-range/merge", test_merge);
+    return g_test_run();
+}
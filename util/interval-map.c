@@ -0,0 +1,66 @@
+/*
+ * Sorted interval map
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/interval-map.h"
+
+static void interval_map_push(IntervalMap *map, uint64_t start, uint16_t value)
+{
+    if (map->nb == map->nb_alloc) {
+        map->nb_alloc = MAX(map->nb_alloc * 2, 16);
+        map->starts = g_renew(uint64_t, map->starts, map->nb_alloc);
+        map->values = g_renew(uint16_t, map->values, map->nb_alloc);
+    }
+    map->starts[map->nb] = start;
+    map->values[map->nb] = value;
+    map->nb++;
+}
+
+void interval_map_init(IntervalMap *map, uint16_t dflt)
+{
+    memset(map, 0, sizeof(*map));
+    map->dflt = dflt;
+    interval_map_push(map, 0, dflt);
+}
+
+void interval_map_destroy(IntervalMap *map)
+{
+    g_free(map->starts);
+    g_free(map->values);
+    memset(map, 0, sizeof(*map));
+}
+
+void interval_map_append(IntervalMap *map, uint64_t start, uint64_t len,
+                         uint16_t value)
+{
+    unsigned last = map->nb - 1;
+    /* 0 stands for the end of the key space, both as @len and as @end */
+    uint64_t end = len ? start + len : 0;
+
+    /*
+     * The last interval is always the default one that extends to the
+     * end of the key space, or the key space is full.
+     */
+    assert(map->values[last] == map->dflt && start >= map->starts[last]);
+    assert(end > start || end == 0);
+
+    if (map->starts[last] == start) {
+        map->values[last] = value;
+    } else {
+        interval_map_push(map, start, value);
+    }
+    if (end) {
+        interval_map_push(map, end, map->dflt);
+    }
+}
+
+void interval_map_trim(IntervalMap *map)
+{
+    map->nb_alloc = map->nb;
+    map->starts = g_renew(uint64_t, map->starts, map->nb_alloc);
+    map->values = g_renew(uint16_t, map->values, map->nb_alloc);
+}